@@ -1,9 +1,13 @@
 #pragma once
 #include "string_view.hpp"
 #include "arena.hpp"
+#include <boost/container/small_vector.hpp>
+#include <boost/container/vector.hpp>
+#include <array>
+#include <cstdint>
 #include <iosfwd>
 #include <iterator>
-#include <list>
+#include <memory>
 
 struct Url
 {
@@ -20,20 +24,58 @@ struct Message
 	{
 		using lowercase_string_view = string_view;
 
+		// headers recognized by the parser
+		enum class Known: std::uint8_t
+		{
+			other,
+			accept,
+			accept_encoding,
+			accept_language,
+			authorization,
+			cache_control,
+			connection,
+			content_length,
+			content_type,
+			cookie,
+			expect,
+			host,
+			if_modified_since,
+			if_none_match,
+			if_range,
+			origin,
+			range,
+			referer,
+			transfer_encoding,
+			upgrade,
+			user_agent,
+		};
+		static constexpr std::size_t n_known = static_cast<std::size_t>(Known::user_agent);
+
 		string_view name;
-		lowercase_string_view lowercase_name;
 		string_view value;
+		Known known = Known::other;
 
 		constexpr Header(string_view name, string_view value) noexcept : name{name}, value{value} {}
 
 		bool operator==(const Header& rhs) const noexcept
 		{
-			return lowercase_name == rhs.lowercase_name && value == rhs.value;
+			return is(rhs.name) && value == rhs.value;
+		}
+
+		// names are compared ignoring the case of ASCII letters
+		[[nodiscard]] bool is(string_view name) const noexcept
+		{
+			if (this->name.size() != name.size())
+				return false;
+			for (std::size_t i = 0; i < name.size(); ++i)
+				if (to_lower(this->name[i]) != to_lower(name[i]))
+					return false;
+			return true;
 		}
 
-		[[nodiscard]] bool is(lowercase_string_view name) const noexcept
+		[[nodiscard]] bool is(Known k) const noexcept
 		{
-			return lowercase_name == name;
+			return known == k;
 		}
 
 		[[nodiscard]] static auto make_is(lowercase_string_view name) noexcept
@@ -41,6 +83,19 @@ struct Message
 			return [name](const Header& hdr) { return hdr.is(name); };
 		}
 
+		[[nodiscard]] static auto make_is(Known k) noexcept
+		{
+			return [k](const Header& hdr) { return hdr.is(k); };
+		}
+
+		// the name folded to lower case, copied to the arena
+		[[nodiscard]] auto lowercase_name(Arena& a) const -> lowercase_string_view;
+
+		static constexpr char to_lower(char c) noexcept
+		{
+			return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c;
+		}
+
 		static constexpr string_view sep = ": "sv;
 	};
 
@@ -50,13 +105,17 @@ struct Message
 		http_1_1 = 1,
 	};
 
-	using HeaderList = std::list<Header, Arena::Allocator<Header>>;
-	using ChunkList = std::list<string_view, Arena::Allocator<string_view>>;
+	// contiguous; the usual number of elements is kept inside the message,
+	// more go to the arena. Growth invalidates references to the elements.
+	static constexpr std::size_t n_inline_headers = 12;
+	static constexpr std::size_t n_inline_chunks = 4;
+	using HeaderList = boost::container::small_vector<Header, n_inline_headers, Arena::Allocator<Header>>;
+	using ChunkList = boost::container::small_vector<string_view, n_inline_chunks, Arena::Allocator<string_view>>;
 
 	explicit Message(Arena& a) noexcept :
 	    http_version{},
-	    headers{a.make_allocator<Header>("message::headers")},
-	    body{a.make_allocator<string_view>("message::body")},
+	    headers{HeaderList::allocator_type{a.make_allocator<Header>("message::headers")}},
+	    body{ChunkList::allocator_type{a.make_allocator<string_view>("message::body")}},
 	    a{a}
 	{}
 
@@ -93,10 +152,21 @@ struct Request : Message
 
 	explicit Request(Arena& a) noexcept : Message{a} {}
 
+	// the first header of the kind, or null
+	[[nodiscard]] auto header(Header::Known k) const noexcept -> const Header*
+	{
+		if (k == Header::Known::other)
+			return nullptr;
+		const auto pos = known_headers[static_cast<std::size_t>(k) - 1];
+		return pos ? &headers[pos - 1] : nullptr;
+	}
+
 	Method method;
 	Url url;
 	bool keep_alive = false;
 	std::size_t content_length = 0;
+	// positions of the known headers in the list, plus one; filled by the parser
+	std::array<std::uint32_t, Header::n_known> known_headers{};
 };
 
 struct Response : Message
@@ -104,9 +174,39 @@ struct Response : Message
 	enum class Status;
 	class const_iterator;
 
+	// part of an open file, sent after the body chunks without copying it
+	struct File
+	{
+		int fd = -1;
+		std::uint64_t offset = 0;
+		std::uint64_t size = 0;
+		// keeps the descriptor open if the response does not own it
+		std::shared_ptr<const void> owner;
+	};
+
+	// another part of the file, sent after its chunk; a part with no bytes
+	// of the file ends the body with its chunk
+	struct FilePart
+	{
+		string_view before;
+		std::uint64_t offset;
+		std::uint64_t size;
+	};
+	using FilePartList = boost::container::vector<FilePart, Arena::Allocator<FilePart>>;
+
 	explicit Response(Arena& a) noexcept;
+	~Response();
+
+	// the response closes the descriptor it had, unless it has an owner;
+	// the parts of that file are dropped
+	auto set_file(File f) noexcept -> void;
 
 	Status code;
+	File file;
+	// sent one by one after the file
+	FilePartList file_parts;
+	// keeps the shared memory of the body chunks, if any
+	std::shared_ptr<const void> body_owner;
 
 	const_iterator begin() const noexcept;
 	const_iterator cbegin() const noexcept;
@@ -224,11 +324,18 @@ private:
 	ChunkList::const_iterator body_it;
 };
 
-inline Response::Response(Arena& a) noexcept : Message{a}, code{Status::internal_server_error} {}
+inline Response::Response(Arena& a) noexcept :
+	Message{a},
+	code{Status::internal_server_error},
+	file_parts{FilePartList::allocator_type{a.make_allocator<FilePart>("response::file_parts")}}
+{}
 
 string_view to_string(Response::Status status);
 
 std::ostream& operator<<(std::ostream& stream, Response::Status status);
 
 auto calc_content_length(const Message& msg) noexcept -> std::size_t;
+
+// Status line and headers as one block allocated in the response arena
+auto serialize_head(const Response& resp) -> string_view;
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
 #include "base_request_handler.hpp"
 #include "string_view.hpp"
+#include <array>
+#include <cstddef>
+#include <optional>
 
 class Arena;
 class Logger;
@@ -10,12 +13,46 @@ namespace http
 struct Request;
 struct Response;
 
+// Values of the {name} segments of the route, viewing the request path
+class PathParams
+{
+public:
+	struct Param
+	{
+		string_view name;
+		string_view value;
+	};
+
+	static constexpr std::size_t capacity = 8;
+
+	auto begin() const noexcept -> const Param* { return params.data(); }
+	auto end() const noexcept -> const Param* { return params.data() + n; }
+	auto size() const noexcept -> std::size_t { return n; }
+	auto empty() const noexcept -> bool { return n == 0; }
+
+	auto get(string_view name) const noexcept -> std::optional<string_view>
+	{
+		for (auto& p : *this)
+			if (p.name == name)
+				return p.value;
+		return std::nullopt;
+	}
+
+	auto push_back(Param p) noexcept -> void { params[n++] = p; }
+	auto resize(std::size_t size) noexcept -> void { n = size; }
+
+private:
+	std::array<Param, capacity> params;
+	std::size_t n = 0;
+};
+
 struct RequestHandler : BaseRequestHandler
 {
 	struct Context
 	{
 		Arena& a;
 		Logger& lg;
+		const PathParams& params;
 	};
 
 	RequestHandler() = default;
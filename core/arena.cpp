@@ -1,8 +1,11 @@
 #include "arena.hpp"
 #include "arena_imp.hpp"
 #include "logger.hpp"
+#include "page_cache.hpp"
 #include <boost/assert.hpp>
 #include <boost/align/aligned_alloc.hpp>
+#include <boost/align/align_up.hpp>
+#include <boost/align/is_aligned.hpp>
 #include <algorithm>
 #include <memory>
 #include <new>
@@ -34,6 +37,10 @@ constexpr size_t block_align_wanted = 16;
 constexpr size_t block_align = std::max(block_align_wanted, alignof(std::max_align_t));
 constexpr size_t min_block_useful_size = 32;
 constexpr size_t max_alloc_compact_size = stateful_block_size - min_block_useful_size;
+// blocks tried before allocating a new one
+constexpr size_t max_avail_blocks = 3;
+// larger allocations are rounded up to a size class, to reuse freed chunks
+constexpr size_t max_small_size = 256;
 
 constexpr bool is_power_of_two(size_t n) { return (n & (n - 1)) == 0; }
 
@@ -42,6 +49,26 @@ static_assert(is_power_of_two(block_align_wanted));
 static_assert(is_power_of_two(block_align));
 static_assert(max_alloc_compact_size < stateful_block_size);
 
+// 512, 1024, 2048 and the largest compact allocation
+constexpr size_t size_class(size_t size) noexcept
+{
+	size_t c = 0;
+	for (auto n = (size - 1) / (2 * max_small_size); n; n /= 2)
+		++c;
+	return c;
+}
+
+constexpr size_t class_size(size_t c) noexcept
+{
+	return std::min(2 * max_small_size << c, max_alloc_compact_size);
+}
+
+static_assert(size_class(max_small_size + 1) == 0);
+static_assert(size_class(2 * max_small_size) == 0);
+static_assert(size_class(2 * max_small_size + 1) == 1);
+static_assert(size_class(max_alloc_compact_size) == 3);
+static_assert(class_size(3) == max_alloc_compact_size);
+
 void* sys_alloc(size_t size)
 {
 	auto p = boost::alignment::aligned_alloc(block_align, size);
@@ -54,31 +81,87 @@ void sys_free(void* p) noexcept
 {
 	boost::alignment::aligned_free(p);
 }
+
+// blocks of a page come from the page cache of the thread
+void* memory_alloc(size_t size)
+{
+	return size == PageCache::page_size ? PageCache::local().take() : sys_alloc(size);
+}
+
+void memory_free(void* p, size_t size) noexcept
+{
+	if (size == PageCache::page_size)
+		PageCache::local().give(p);
+	else
+		sys_free(p);
+}
+
+static_assert(page_size == PageCache::page_size);
 }
 
 struct ArenaImp::AllocTag {};
 constexpr ArenaImp::AllocTag alloc_tag{};
 
-void* ArenaImp::Block::operator new(size_t size, AllocTag, size_t space)
+void ArenaCache::clear() noexcept
+{
+	std::lock_guard lock{ mutex };
+	blocks.clear_and_dispose([](Memory* m)
+	{
+		const auto size = m->size;
+		m->~Memory();
+		memory_free(m, size);
+	});
+	n_bytes = 0;
+}
+
+size_t ArenaCache::n_bytes_cached() const noexcept
+{
+	std::lock_guard lock{ mutex };
+	return n_bytes;
+}
+
+void* ArenaCache::take(size_t& size) noexcept
+{
+	std::lock_guard lock{ mutex };
+	auto best = blocks.end();
+	for (auto it = blocks.begin(); it != blocks.end(); ++it)
+		if (it->size >= size && (best == blocks.end() || it->size < best->size))
+			best = it;
+	if (best == blocks.end())
+		return nullptr;
+
+	Memory& m = *best;
+	blocks.erase(best);
+	size = m.size;
+	n_bytes -= size;
+	return &m;
+}
+
+bool ArenaCache::put(void* p, size_t size) noexcept
 {
-	return sys_alloc(size + space);
+	std::lock_guard lock{ mutex };
+	if (n_bytes + size > max_bytes)
+		return false;
+	blocks.push_front(*new (p) Memory{ size });
+	n_bytes += size;
+	return true;
 }
 
-void ArenaImp::Block::operator delete(void* p)
+
+void* ArenaImp::Block::operator new(size_t, AllocTag, void* place) noexcept
 {
-	sys_free(p);
+	return place;
 }
 
-void ArenaImp::Block::operator delete(void* p, AllocTag, size_t)
+void ArenaImp::Block::operator delete(void*, AllocTag, void*) noexcept
 {
-	operator delete(p);
 }
 
 void* ArenaImp::Block::free_space() { return this + 1; }
 
 
-ArenaImp::StatefulBlock::StatefulBlock(size_t size):
-	Block{size},
+ArenaImp::StatefulBlock::StatefulBlock(size_t size, size_t memory_size):
+	Block{ size, memory_size },
 	current{ free_space() },
 	space{ size }
 {}
@@ -95,17 +178,47 @@ void* ArenaImp::StatefulBlock::alloc(size_t size) noexcept
 void* ArenaImp::StatefulBlock::free_space() { return this + 1; }
 
 
-template <typename Block, typename BlockList>
-Block* make(size_t size, BlockList& where, size_t& n_bytes)
+template <typename B, typename BlockList>
+B* ArenaImp::make(size_t size, BlockList& where)
 {
-	auto b = new (alloc_tag, size) Block{ size };
+	auto memory_size = sizeof(B) + size;
+	auto p = cache ? cache->take(memory_size) : nullptr;
+	if (!p)
+		p = memory_alloc(memory_size);
+	if (account) {
+		try {
+			account->charge(memory_size, !overdraft);
+		} catch (...) {
+			dispose(p, memory_size);
+			throw;
+		}
+	}
+	auto b = new (alloc_tag, p) B{ size, memory_size };
 	where.push_front(*b);
-	n_bytes += size + sizeof(Block);
+	n_bytes += memory_size;
 	return b;
 }
 
-ArenaImp::ArenaImp(Logger& lg) noexcept:
-	lg{lg}
+template <typename B>
+void ArenaImp::release(B* b) noexcept
+{
+	const auto memory_size = b->memory_size;
+	b->~B();
+	if (account)
+		account->release(memory_size);
+	dispose(b, memory_size);
+}
+
+void ArenaImp::dispose(void* p, size_t memory_size) noexcept
+{
+	if (!cache || !cache->put(p, memory_size))
+		memory_free(p, memory_size);
+}
+
+ArenaImp::ArenaImp(Logger& lg, ArenaCache* cache, MemoryBudget::Account* account) noexcept:
+	lg{lg},
+	cache{cache},
+	account{account}
 {
 	lg.debug("arena: creating arena");
 }
@@ -115,15 +228,16 @@ ArenaImp::~ArenaImp()
 	lg.debug("arena: destroying arena with ", n_blocks_allocated(),
 		" blocks and ", n_bytes_allocated(), " bytes");
 
-	separate_blocks.clear_and_dispose(std::default_delete<Block>{});
-	unavail_blocks.clear_and_dispose(std::default_delete<StatefulBlock>{});
-	avail_blocks.clear_and_dispose(std::default_delete<StatefulBlock>{});
+	// blocks used often go to the cache first
+	avail_blocks.clear_and_dispose([this](StatefulBlock* b) { release(b); });
+	unavail_blocks.clear_and_dispose([this](StatefulBlock* b) { release(b); });
+	separate_blocks.clear_and_dispose([this](Block* b) { release(b); });
 }
 
 void* ArenaImp::alloc_as_separate_block(size_t size)
 {
 	lg.debug("arena: allocating separate block of ", size, " bytes");
-	auto b = make<Block>(size, separate_blocks, n_bytes);
+	auto b = make<Block>(size, separate_blocks);
 	return b->free_space();
 }
 
@@ -137,15 +251,27 @@ void* ArenaImp::alloc_from_block(StatefulBlock& b, size_t size)
 	return p;
 }
 
+auto ArenaImp::add_block(size_t size) -> StatefulBlock&
+{
+	auto b = make<StatefulBlock>(size, avail_blocks);
+	// the rest of the oldest block is not worth trying each time
+	if (avail_blocks.size() > max_avail_blocks) {
+		auto& old = avail_blocks.back();
+		avail_blocks.pop_back();
+		unavail_blocks.push_back(old);
+	}
+	return *b;
+}
+
 void* ArenaImp::alloc_in_new_block(size_t size)
 {
 	lg.debug("arena: allocating block of ", size, " bytes");
-	auto b = make<StatefulBlock>(stateful_block_size, avail_blocks, n_bytes);
-	return alloc_from_block(*b, size);
+	return alloc_from_block(add_block(stateful_block_size), size);
 }
 
 void* ArenaImp::alloc_compact(size_t alignment, size_t size)
 {
+	// the cost does not depend on the number of blocks
 	for (auto& b : avail_blocks)
 		if (std::align(alignment, size, b.current, b.space))
 			return alloc_from_block(b, size);
@@ -153,21 +279,57 @@ void* ArenaImp::alloc_compact(size_t alignment, size_t size)
 	return alloc_in_new_block(size);
 }
 
+void* ArenaImp::alloc_sized(size_t alignment, size_t size)
+{
+	const auto c = size_class(size);
+	if (auto chunk = free_chunks[c];
+		chunk && boost::alignment::is_aligned(chunk, alignment)) {
+		free_chunks[c] = chunk->next;
+		return chunk;
+	}
+	return alloc_compact(std::max(alignment, block_align), class_size(c));
+}
+
 void* ArenaImp::aligned_alloc(size_t alignment, size_t size, const char* msg)
 {
 	BOOST_ASSERT(is_power_of_two(alignment));
 	
 	lg.trace(msg, " allocate ", size);
+	n_used += size;
 	
-	if (size <= max_alloc_compact_size)
+	if (size <= max_small_size)
 		return alloc_compact(alignment, size);
+	if (size <= max_alloc_compact_size)
+		return alloc_sized(alignment, size);
+	// the current block may be a reserved one
+	if (!avail_blocks.empty()) {
+		auto& b = avail_blocks.front();
+		if (std::align(alignment, size, b.current, b.space))
+			return alloc_from_block(b, size);
+	}
 	return alloc_as_separate_block(size);
 }
 
-void ArenaImp::free(size_t size, const char* msg) const noexcept
+void ArenaImp::reserve(size_t size)
+{
+	// a block of the usual size is allocated when needed anyway
+	if (size <= stateful_block_size)
+		return;
+	if (!avail_blocks.empty() && avail_blocks.front().space >= size)
+		return;
+	lg.debug("arena: reserving block of ", size, " bytes");
+	add_block(boost::alignment::align_up(size, block_align));
+}
+
+void ArenaImp::free(void* p, size_t size, const char* msg) noexcept
 {
 	// this may throw in trace build, we don't care
 	lg.trace(msg, " free ", size);
+
+	if (size <= max_small_size || size > max_alloc_compact_size)
+		return;
+	const auto c = size_class(size);
+	free_chunks[c] = new (p) FreeChunk{ free_chunks[c] };
 }
 
 auto ArenaImp::n_blocks_allocated() const noexcept -> size_t
@@ -197,9 +359,9 @@ void* Arena::aligned_alloc(size_t alignment, size_t size, const char* msg)
 	return impl(this)->aligned_alloc(alignment, size, msg);
 }
 
-void Arena::free(void*, size_t size, const char* msg) noexcept
+void Arena::free(void* p, size_t size, const char* msg) noexcept
 {
-	impl(this)->free(size, msg);
+	impl(this)->free(p, size, msg);
 }
 
 auto Arena::n_blocks_allocated() const noexcept -> size_t
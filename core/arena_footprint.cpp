@@ -0,0 +1,57 @@
+#include "arena_footprint.hpp"
+
+namespace
+{
+using std::size_t;
+
+// samples between updates of the estimate
+constexpr std::uint32_t update_period = 64;
+constexpr unsigned percentile = 90;
+
+// 1K, 1.5K, 2K, 3K, 4K, 6K...
+constexpr size_t bucket_bound(size_t i) noexcept
+{
+	const size_t base = size_t{ 1024 } << (i / 2);
+	return i % 2 ? base + base / 2 : base;
+}
+
+size_t bucket_of(size_t n_bytes, size_t n_buckets) noexcept
+{
+	size_t i = 0;
+	while (i + 1 < n_buckets && bucket_bound(i) < n_bytes)
+		++i;
+	return i;
+}
+
+static_assert(bucket_bound(0) == 1024);
+static_assert(bucket_bound(1) == 1536);
+static_assert(bucket_bound(2) == 2048);
+}
+
+void ArenaFootprint::add(size_t n_bytes) noexcept
+{
+	counts[bucket_of(n_bytes, n_buckets)].fetch_add(1, std::memory_order_relaxed);
+	if (n_samples.fetch_add(1, std::memory_order_relaxed) % update_period == update_period - 1)
+		update();
+}
+
+void ArenaFootprint::update() noexcept
+{
+	std::uint32_t snapshot[n_buckets];
+	std::uint64_t total = 0;
+	for (size_t i = 0; i < n_buckets; ++i)
+		total += snapshot[i] = counts[i].load(std::memory_order_relaxed);
+
+	std::uint64_t n = 0;
+	for (size_t i = 0; i < n_buckets; ++i) {
+		n += snapshot[i];
+		if (n * 100 >= total * percentile) {
+			estimate.store(bucket_bound(i), std::memory_order_relaxed);
+			break;
+		}
+	}
+
+	// the next estimate weighs these samples by half
+	for (size_t i = 0; i < n_buckets; ++i)
+		counts[i].fetch_sub(snapshot[i] / 2, std::memory_order_relaxed);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <boost/core/noncopyable.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Arena memory used by the recent tasks of a route: the size not exceeded
+// by 90% of them. Older tasks count less, so the size follows the route.
+// Thread-safe.
+class ArenaFootprint: boost::noncopyable
+{
+public:
+	void add(std::size_t n_bytes) noexcept;
+	// zero until enough tasks are seen
+	std::size_t expected() const noexcept { return estimate.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr std::size_t n_buckets = 40;
+
+	void update() noexcept;
+
+	std::atomic<std::uint32_t> counts[n_buckets] = {};
+	std::atomic<std::uint32_t> n_samples{ 0 };
+	std::atomic<std::size_t> estimate{ 0 };
+};
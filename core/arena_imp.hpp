@@ -1,43 +1,92 @@
 #pragma once
 #include "arena.hpp"
+#include "memory_budget.hpp"
+#include <boost/core/noncopyable.hpp>
 #include <boost/intrusive/list.hpp>
+#include <cstddef>
+#include <mutex>
+#include <utility>
 
 class Logger;
 
+// Memory blocks of finished arenas kept for the next ones, up to the limit.
+// Thread-safe: arenas sharing the cache may be destroyed by any thread.
+class ArenaCache: boost::noncopyable
+{
+public:
+	explicit ArenaCache(std::size_t max_bytes) noexcept: max_bytes{ max_bytes } {}
+	~ArenaCache() { clear(); }
+
+	void clear() noexcept;
+	std::size_t n_bytes_cached() const noexcept;
+
+private:
+	struct Memory : boost::intrusive::list_base_hook<>
+	{
+		explicit Memory(std::size_t size) noexcept: size{ size } {}
+
+		const std::size_t size;
+	};
+
+	// the smallest cached block of at least size bytes; size is updated
+	void* take(std::size_t& size) noexcept;
+	bool put(void* p, std::size_t size) noexcept;
+
+	const std::size_t max_bytes;
+	std::size_t n_bytes = 0;
+	mutable std::mutex mutex;
+	boost::intrusive::list<Memory, boost::intrusive::constant_time_size<false>> blocks;
+
+	friend class ArenaImp;
+};
+
 class ArenaImp : public Arena
 {
 public:
-	explicit ArenaImp(Logger& lg) noexcept;
+	// the blocks are charged to the account, if any
+	explicit ArenaImp(Logger& lg, ArenaCache* cache = nullptr,
+		MemoryBudget::Account* account = nullptr) noexcept;
 	~ArenaImp();
 
 	void* aligned_alloc(size_t alignment, size_t size, const char* msg = "");
+	// the next allocations of about that many bytes go to one block
+	void reserve(size_t size);
+	// the next blocks are charged even beyond the limits
+	void allow_overdraft() noexcept { overdraft = true; }
+	template <typename T> class OverdraftAllocator;
 
-	void free(size_t size, const char* msg) const noexcept;
+	// not thread-safe: freed chunks are reused by the next allocations
+	void free(void* p, size_t size, const char* msg = "") noexcept;
 
 	size_t n_blocks_allocated() const noexcept;
 	size_t n_bytes_allocated() const noexcept;
+	// requested by the allocations, not counting the free ones
+	size_t n_bytes_used() const noexcept { return n_used; }
 
 	static constexpr size_t StatefulBlock_size() { return sizeof(StatefulBlock); }
 	struct AllocTag;
 
 private:
 	
-	struct Block : boost::intrusive::list_base_hook<>
+	// the free space following a block is aligned as the block
+	struct alignas(std::max_align_t) Block : boost::intrusive::list_base_hook<>
 	{
-		explicit Block(size_t) {}
+		// memory may be larger than the block needs, when it was cached
+		Block(size_t, size_t memory_size) noexcept: memory_size{ memory_size } {}
 		Block(const Block&) = delete;
 		Block(Block&&) = delete;
 
 		void* operator new(size_t size) = delete;
-		void* operator new(size_t size, AllocTag, size_t space);
-		void operator delete(void* p);
-		void operator delete(void* p, AllocTag, size_t);
+		void* operator new(size_t size, AllocTag, void* place) noexcept;
+		void operator delete(void* p, AllocTag, void* place) noexcept;
 		void* free_space();
+
+		const size_t memory_size;
 	};
 
 	struct StatefulBlock : Block
 	{
-		explicit StatefulBlock(size_t size);
+		StatefulBlock(size_t size, size_t memory_size);
 
 		void* alloc(size_t size) noexcept;
 		void* free_space();
@@ -46,15 +95,79 @@ private:
 		size_t space;
 	};
 
+	template <typename B, typename BlockList>
+	B* make(size_t size, BlockList& where);
+	template <typename B>
+	void release(B* b) noexcept;
+	void dispose(void* p, size_t memory_size) noexcept;
+
+	StatefulBlock& add_block(size_t size);
 	void* alloc_as_separate_block(size_t size);
 	void* alloc_from_block(StatefulBlock& b, size_t size);
 	void* alloc_in_new_block(size_t size);
 	void* alloc_compact(size_t alignment, size_t size);
+	void* alloc_sized(size_t alignment, size_t size);
+
+	// chunks of a size class freed by their users
+	struct FreeChunk
+	{
+		FreeChunk* next;
+	};
+	static constexpr size_t n_size_classes = 4;
 
 	Logger& lg;
+	ArenaCache* const cache;
+	MemoryBudget::Account* const account;
+	bool overdraft = false;
 	size_t n_bytes = 0;
+	size_t n_used = 0;
+	FreeChunk* free_chunks[n_size_classes] = {};
 
+	// the first one is current, only a few others are tried before a new one
 	boost::intrusive::list<StatefulBlock> avail_blocks;
 	boost::intrusive::list<StatefulBlock> unavail_blocks;
 	boost::intrusive::list<Block> separate_blocks;
+};
+
+// Implements std::Allocator, allowing overdraft for its allocations only
+template <typename T>
+class ArenaImp::OverdraftAllocator
+{
+public:
+	using value_type = T;
+
+	explicit OverdraftAllocator(ArenaImp& a, const char* name = "") noexcept: a{ a }, name{ name } {}
+	template <typename U>
+	OverdraftAllocator(const OverdraftAllocator<U>& rhs) noexcept: a{ rhs.a }, name{ rhs.name } {}
+
+	T* allocate(std::size_t n)
+	{
+		const auto was_allowed = std::exchange(a.overdraft, true);
+		try {
+			auto p = a.aligned_alloc(alignof(T), n * sizeof(T), name);
+			a.overdraft = was_allowed;
+			return static_cast<T*>(p);
+		} catch (...) {
+			a.overdraft = was_allowed;
+			throw;
+		}
+	}
+	void deallocate(T* p, std::size_t n) noexcept
+	{
+		a.free(p, n * sizeof(T), name);
+	}
+
+	friend bool operator==(const OverdraftAllocator& a1, const OverdraftAllocator& a2) noexcept
+	{
+		return &a1.a == &a2.a;
+	}
+	friend bool operator!=(const OverdraftAllocator& a1, const OverdraftAllocator& a2) noexcept
+	{
+		return &a1.a != &a2.a;
+	}
+
+private:
+	ArenaImp& a;
+	const char* const name;
+	template <typename> friend class OverdraftAllocator;
 };
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+#include <boost/core/noncopyable.hpp>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+// Storage for the handler of one asynchronous operation at a time.
+// Handlers not fitting into it, or overlapping, are allocated from the heap.
+class HandlerMemory: boost::noncopyable
+{
+public:
+	template <typename T> class Allocator;
+
+	template <typename T>
+	Allocator<T> make_allocator() noexcept { return Allocator<T>{ *this }; }
+
+	void* allocate(std::size_t size)
+	{
+		if (!in_use && size <= sizeof storage) {
+			in_use = true;
+			return &storage;
+		}
+		return ::operator new(size);
+	}
+
+	void deallocate(void* p) noexcept
+	{
+		if (p == &storage)
+			in_use = false;
+		else
+			::operator delete(p);
+	}
+
+private:
+	static constexpr std::size_t size = 256;
+
+	std::aligned_storage_t<size> storage;
+	bool in_use = false;
+};
+
+// Implements std::Allocator
+template <typename T>
+class HandlerMemory::Allocator
+{
+public:
+	using value_type = T;
+
+	explicit Allocator(HandlerMemory& m) noexcept: m{ m } {}
+	template <typename U>
+	Allocator(const Allocator<U>& rhs) noexcept: m{ rhs.m } {}
+
+	T* allocate(std::size_t n)
+	{
+		return static_cast<T*>(m.allocate(n * sizeof(T)));
+	}
+	void deallocate(T* p, std::size_t) noexcept
+	{
+		m.deallocate(p);
+	}
+
+	friend bool operator==(const Allocator& a1, const Allocator& a2) noexcept
+	{
+		return &a1.m == &a2.m;
+	}
+	friend bool operator!=(const Allocator& a1, const Allocator& a2) noexcept
+	{
+		return &a1.m != &a2.m;
+	}
+
+private:
+	HandlerMemory& m;
+	template <typename> friend class Allocator;
+};
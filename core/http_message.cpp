@@ -3,6 +3,11 @@
 #include <boost/concept_check.hpp>
 #include <boost/range/numeric.hpp>
 #include <boost/range/adaptor/transformed.hpp>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <functional>
@@ -10,6 +15,7 @@
 #include <ostream>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 using namespace std::string_literals;
 
@@ -163,6 +169,32 @@ const string_view& to_string_ref(Response::Status status)
 
 	return to_string_other(status_n);
 }
+
+void fold_to_lower(const char* from, std::size_t n, char* to) noexcept
+{
+	std::size_t i = 0;
+#ifdef __SSE2__
+	// letters are those above '@' and below '[' at once
+	const auto above = _mm_set1_epi8('A' - 1);
+	const auto below = _mm_set1_epi8('Z' + 1);
+	const auto bit = _mm_set1_epi8('a' - 'A');
+	for (; i + 16 <= n; i += 16) {
+		const auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i));
+		const auto is_upper = _mm_and_si128(_mm_cmpgt_epi8(c, above), _mm_cmplt_epi8(c, below));
+		const auto lower = _mm_or_si128(c, _mm_and_si128(is_upper, bit));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(to + i), lower);
+	}
+#endif
+	for (; i < n; ++i)
+		to[i] = Message::Header::to_lower(from[i]);
+}
+}
+
+auto Message::Header::lowercase_name(Arena& a) const -> lowercase_string_view
+{
+	const auto lc = static_cast<char*>(a.aligned_alloc(1, name.size(), "lowercase header"));
+	fold_to_lower(name.data(), name.size(), lc);
+	return { lc, name.size() };
 }
 
 auto Response::begin() const noexcept -> const_iterator
@@ -195,6 +227,19 @@ std::ostream& operator<<(std::ostream& stream, Response::Status status)
 	return stream << static_cast<int>(status);
 }
 
+Response::~Response()
+{
+	set_file({});
+}
+
+auto Response::set_file(File f) noexcept -> void
+{
+	if (file.fd >= 0 && !file.owner)
+		::close(file.fd);
+	file = std::move(f);
+	file_parts.clear();
+}
+
 auto calc_content_length(const Message& msg) noexcept -> std::size_t
 {
 	auto length = accumulate(
@@ -203,6 +248,36 @@ auto calc_content_length(const Message& msg) noexcept -> std::size_t
 	return length;
 }
 
+auto serialize_head(const Response& resp) -> string_view
+{
+	const auto version = to_string_ref(resp.http_version);
+	const auto status = to_string_ref(resp.code);
+
+	auto size = version.size() + status.size() + 2 * Message::nl.size();
+	for (auto& h : resp.headers)
+		size += h.name.size() + Message::Header::sep.size() + h.value.size() + Message::nl.size();
+
+	const auto begin = static_cast<char*>(resp.a.aligned_alloc(1, size, "response head"));
+	auto p = begin;
+	auto append = [&p](string_view s)
+	{
+		p = std::copy(s.begin(), s.end(), p);
+	};
+	append(version);
+	append(status);
+	append(Message::nl);
+	for (auto& h : resp.headers) {
+		append(h.name);
+		append(Message::Header::sep);
+		append(h.value);
+		append(Message::nl);
+	}
+	append(Message::nl);
+	BOOST_ASSERT(p == begin + size);
+
+	return { begin, size };
+}
+
 enum class Response::const_iterator::State
 {
 	http_version,
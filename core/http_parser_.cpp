@@ -1,6 +1,10 @@
 #include "http_parser_.hpp"
 #include "http_message.hpp"
-#include <boost/algorithm/string/case_conv.hpp>
+#include "memory_budget.hpp"
+#include <array>
+#include <climits>
+#include <cstdint>
+#include <new>
 
 namespace http
 {
@@ -12,7 +16,75 @@ enum CallbackResult
 	error = 3 // on_headers_complete reserves 1 and 2
 };
 
-const auto& header_locale = std::locale::classic();
+using Known = Message::Header::Known;
+
+// Perfect hash of the known header names by their length and the first and last letters
+constexpr std::array<std::pair<string_view, Known>, Message::Header::n_known> known_names = {{
+	{ "accept"sv, Known::accept },
+	{ "accept-encoding"sv, Known::accept_encoding },
+	{ "accept-language"sv, Known::accept_language },
+	{ "authorization"sv, Known::authorization },
+	{ "cache-control"sv, Known::cache_control },
+	{ "connection"sv, Known::connection },
+	{ "content-length"sv, Known::content_length },
+	{ "content-type"sv, Known::content_type },
+	{ "cookie"sv, Known::cookie },
+	{ "expect"sv, Known::expect },
+	{ "host"sv, Known::host },
+	{ "if-modified-since"sv, Known::if_modified_since },
+	{ "if-none-match"sv, Known::if_none_match },
+	{ "if-range"sv, Known::if_range },
+	{ "origin"sv, Known::origin },
+	{ "range"sv, Known::range },
+	{ "referer"sv, Known::referer },
+	{ "transfer-encoding"sv, Known::transfer_encoding },
+	{ "upgrade"sv, Known::upgrade },
+	{ "user-agent"sv, Known::user_agent },
+}};
+constexpr std::size_t known_slots = 64;
+
+constexpr auto known_slot(string_view name) noexcept -> std::size_t
+{
+	const auto first = static_cast<unsigned char>(Message::Header::to_lower(name.front()));
+	const auto last = static_cast<unsigned char>(Message::Header::to_lower(name.back()));
+	return (name.size() + first + 4 * last) % known_slots;
+}
+
+// the names by slot; a collision leaves the table empty
+constexpr auto make_known_table() noexcept
+{
+	std::array<Known, known_slots> table{};
+	for (auto [name, known] : known_names) {
+		auto& slot = table[known_slot(name)];
+		if (slot != Known::other)
+			return std::array<Known, known_slots>{};
+		slot = known;
+	}
+	return table;
+}
+constexpr auto known_table = make_known_table();
+
+constexpr auto is_known_table_valid() noexcept
+{
+	for (std::size_t i = 0; i < known_names.size(); ++i) {
+		const auto [name, known] = known_names[i];
+		if (static_cast<std::size_t>(known) != i + 1 || known_table[known_slot(name)] != known)
+			return false;
+	}
+	return true;
+}
+static_assert(is_known_table_valid(), "known header names should be in order and not collide");
+
+auto classify(string_view name) noexcept -> Known
+{
+	if (name.empty())
+		return Known::other;
+	const auto known = known_table[known_slot(name)];
+	if (known == Known::other)
+		return Known::other;
+	const auto candidate = known_names[static_cast<std::size_t>(known) - 1].first;
+	return Message::Header{ name, {} }.is(candidate) ? known : Known::other;
+}
 
 auto method_from(http_method m) -> Request::Method
 {
@@ -69,6 +141,13 @@ struct ParserInternal: Parser
 		return cb::f(p, ctx, r, s);
 	}
 
+	// callbacks run inside the C parser, so exceptions must stay here
+	static auto memory_error(Context& ctx, const std::bad_alloc& e) noexcept -> CallbackResult
+	{
+		ctx.error.emplace(http::memory_error(e));
+		return error;
+	}
+
 	static auto make_work_settings() -> http_parser_settings;
 	static auto make_drop_settings();
 };
@@ -87,7 +166,10 @@ auto ParserInternal::make_work_settings() -> http_parser_settings
 				r.url.all = s;
 			else
 				prolong(r.url.all, s);
-			
+			// the rest of the URL is in the next chunk
+			if (s.data() + s.size() == ctx.chunk_end)
+				return ok;
+
 			auto method = static_cast<http_method>(p->method);
 			r.method = method_from(method);
 
@@ -116,7 +198,11 @@ auto ParserInternal::make_work_settings() -> http_parser_settings
 		              Request& r, string_view s) noexcept
 		{
 			if (BOOST_LIKELY(ctx.hdr_state == HeaderState::value)) {
-				r.headers.emplace_back(s, string_view{});
+				try {
+					r.headers.emplace_back(s, string_view{});
+				} catch (std::bad_alloc& e) {
+					return memory_error(ctx, e);
+				}
 				ctx.hdr_state = HeaderState::key;
 			} else {
 				prolong(r.headers.back().name, s);
@@ -144,13 +230,25 @@ auto ParserInternal::make_work_settings() -> http_parser_settings
 
 	struct OnHeadersComplete
 	{
-		static auto f(const http_parser* p, Context& ctx, Request& r) noexcept
+		static auto f(http_parser* p, Context& ctx, Request& r) noexcept
 		{
 			if (BOOST_UNLIKELY(p->http_major != 1 || p->http_minor > 1)) {
 				ctx.error.emplace(Response::Status::http_version_not_supported);
 				return error;
 			}
+			// refused before the body is read; unknown length is all ones
+			if (BOOST_UNLIKELY(ctx.max_content_length && p->content_length != ULLONG_MAX
+				&& p->content_length > ctx.max_content_length)) {
+				ctx.error.emplace(Response::Status::payload_too_large);
+				return error;
+			}
 			r.http_version = static_cast<Message::ProtocolVersion>(p->http_minor);
+			if (ctx.report_headers) {
+				http_parser_pause(p, 1);
+				ctx.state = State::headers_end;
+			} else {
+				ctx.state = State::content;
+			}
 
 			return ok;
 		}
@@ -159,10 +257,14 @@ auto ParserInternal::make_work_settings() -> http_parser_settings
 
 	struct OnBody
 	{
-		static auto f(const http_parser*, Context&,
+		static auto f(const http_parser*, Context& ctx,
 		              Request& r, string_view s) noexcept
 		{
-			r.body.emplace_back(s);
+			try {
+				r.body.emplace_back(s);
+			} catch (std::bad_alloc& e) {
+				return memory_error(ctx, e);
+			}
 			return ok;
 		}
 	};
@@ -190,11 +292,23 @@ auto ParserInternal::make_drop_settings()
 	http_parser_settings s;
 	http_parser_settings_init(&s);
 
+	struct OnHeadersComplete
+	{
+		static auto f(const http_parser*, Context& ctx, Request&) noexcept
+		{
+			ctx.state = State::content;
+			return ok;
+		}
+	};
+	s.on_headers_complete = parser_cb<OnHeadersComplete>;
+
 	struct OnMessageComplete
 	{
 		static auto f(http_parser* p, Context& ctx,
 			Request& r) noexcept
 		{
+			// a request dropped after its headers keeps the connection
+			r.keep_alive = http_should_keep_alive(p) != 0;
 			ctx.state = State::body;
 			http_parser_pause(p, 1);
 			return ok;
@@ -209,11 +323,15 @@ const auto work_settings = ParserInternal::make_work_settings();
 const auto drop_settings = ParserInternal::make_drop_settings();
 }
 
-auto Parser::reset(Request& req, bool& drop_mode) noexcept -> void
+auto Parser::reset(Request& req, bool& drop_mode, std::size_t max_content_length,
+	bool report_headers) noexcept -> void
 {
 	http_parser_init(&p, HTTP_REQUEST); // TODO check out if we need to do this every time
 	ctx.r = &req;
+	req.known_headers = {};
 	ctx.drop_mode = &drop_mode;
+	ctx.max_content_length = max_content_length;
+	ctx.report_headers = report_headers;
 	ctx.state = State::start;
 	ctx.hdr_state = HeaderState::value;
 	ctx.error = boost::none;
@@ -223,6 +341,7 @@ auto Parser::reset(Request& req, bool& drop_mode) noexcept -> void
 auto Parser::parse_chunk(string_view chunk) noexcept -> Result
 {
 	auto settings = *ctx.drop_mode ? &drop_settings : &work_settings;
+	ctx.chunk_end = chunk.data() + chunk.size();
 	auto nparsed = http_parser_execute(&p, settings, chunk.data(), chunk.size());
 
 	auto err = HTTP_PARSER_ERRNO(&p);
@@ -243,8 +362,16 @@ auto Parser::parse_chunk(string_view chunk) noexcept -> Result
 		//TODO
 	}
 
-	if (ctx.state == State::request_line)
+	if (ctx.state == State::request_line) {
+		// reported once, the rest of the request may come with later chunks
+		ctx.state = State::headers;
 		return { RequestLine{}, chunk.substr(nparsed) };
+	}
+	if (ctx.state == State::headers_end) {
+		// the body goes on after the pause, as the request is routed by then
+		ctx.state = State::content;
+		return { HeadersComplete{}, chunk.substr(nparsed) };
+	}
 	if (ctx.state == State::body)
 		return { CompleteRequest{}, chunk.substr(nparsed) };
 
@@ -256,13 +383,27 @@ auto Parser::finalize(Request& req) const -> void
 {
 	if (*ctx.drop_mode)
 		return;
-	
-	auto allocator = req.a.make_allocator<char>("lowercase header");
-	for (auto& hdr : req.headers) {
-		auto lc_length = hdr.name.length();
-		auto lc_begin = allocator.allocate(lc_length);
-		boost::to_lower_copy(lc_begin, hdr.name, header_locale);
-		hdr.lowercase_name = { lc_begin, lc_length };
+	classify_headers(req);
+}
+
+auto memory_error(const std::bad_alloc& e) noexcept -> Error
+{
+	const auto me = dynamic_cast<const MemoryBudget::Exceeded*>(&e);
+	return Error{ me && me->by_account
+		? Response::Status::payload_too_large
+		: Response::Status::service_unavailable };
+}
+
+void classify_headers(Request& req) noexcept
+{
+	for (std::size_t i = 0; i < req.headers.size(); ++i) {
+		auto& hdr = req.headers[i];
+		hdr.known = classify(hdr.name);
+		if (hdr.known == Known::other)
+			continue;
+		auto& pos = req.known_headers[static_cast<std::size_t>(hdr.known) - 1];
+		if (!pos)
+			pos = static_cast<std::uint32_t>(i + 1);
 	}
 }
-}
\ No newline at end of file
+}
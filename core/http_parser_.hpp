@@ -4,6 +4,8 @@
 #include "http_parser.h"
 #include <boost/core/noncopyable.hpp>
 #include <boost/optional/optional.hpp>
+#include <cstddef>
+#include <new>
 #include <utility>
 #include <variant>
 
@@ -15,20 +17,34 @@ class Parser: boost::noncopyable
 {
 public:
 	struct RequestLine {};
+	struct HeadersComplete {};
 	struct IncompleteRequest {};
 	struct CompleteRequest {};
-	using Result = std::pair<std::variant<Error, RequestLine, IncompleteRequest, CompleteRequest>, string_view>;
+	using Result = std::pair<std::variant<Error, RequestLine, HeadersComplete, IncompleteRequest, CompleteRequest>,
+		string_view>;
 
 	Parser() = default;
 
-	auto reset(Request& req, bool& drop_mode) noexcept -> void;
+	// a longer body is refused, if the limit is not zero;
+	// the end of the headers is reported before the body if asked
+	auto reset(Request& req, bool& drop_mode, std::size_t max_content_length = 0,
+		bool report_headers = false) noexcept -> void;
 	auto parse_chunk(string_view chunk) noexcept -> Result;
 	auto finalize(Request& req) const -> void;
 
+	auto is_started() const noexcept -> bool { return ctx.state != State::start; }
+	auto headers_complete() const noexcept -> bool
+	{
+		return ctx.state == State::headers_end || ctx.state == State::content || ctx.state == State::body;
+	}
+
 protected:
 	enum class State {
 		start,
 		request_line,
+		headers,
+		headers_end,
+		content,
 		body
 	};
 	
@@ -41,10 +57,18 @@ protected:
 		HeaderState hdr_state;
 		boost::optional<Error> error;
 		bool* drop_mode;
+		const char* chunk_end;
+		std::size_t max_content_length;
+		bool report_headers;
 	};
 
 	//TODO pImpl
 	http_parser p;
 	Context ctx;
 };
+
+// the answer to a request which has run out of memory
+auto memory_error(const std::bad_alloc& e) noexcept -> Error;
+// marks the well-known headers and fills their positions in the request
+void classify_headers(Request& req) noexcept;
 }
\ No newline at end of file
@@ -2,72 +2,77 @@
 #include "http_request_handler.hpp"
 #include "module_manager.hpp"
 #include <algorithm>
-#include <regex>
+#include <limits>
 #include <string>
 
 namespace http
 {
 namespace
 {
-class ExactMatcher: public Router::Matcher
+constexpr auto no_route = std::numeric_limits<std::uint32_t>::max();
+
+struct PatternBuilder
 {
-public:
-	explicit ExactMatcher(std::string patt) : patt{ move(patt) } {}
-	bool match(string_view s) const noexcept override
-	{
-		return s == patt;
-	}
-private:
-	const std::string patt;
+	auto operator()(const Options::Route::Equal& r) const { return r.str; }
+	auto operator()(const Options::Route::Prefix& r) const { return r.str; }
+	auto operator()(const Options::Route::Regex& r) const { return r.re; }
 };
+}
 
-class PrefixMatcher: public Router::Matcher
+struct Router::Search
 {
-public:
-	explicit PrefixMatcher(std::string prefix) : prefix{ move(prefix) } {}
-	bool match(string_view s) const noexcept override
+	const Router& r;
+	const string_view path;
+	const string_view method;
+	PathParams& params;
+	PathParams captured = {};
+	Index best = no_route;
+
+	void consider(const std::vector<Index>& routes)
 	{
-		return prefix.length() <= s.length()
-			&& equal(prefix.begin(), prefix.end(), s.begin());
+		const auto route = r.first_allowed(routes, method);
+		if (route < best) {
+			best = route;
+			params = captured;
+		}
 	}
-private:
-	const std::string prefix;
-};
 
-class RegexMatcher: public Router::Matcher
-{
-public:
-	explicit RegexMatcher(const std::string& s) : re{ s, std::regex_constants::optimize } {}
-	bool match(string_view s) const override
+	void visit(Index n, std::size_t pos)
 	{
-		return regex_match(s.begin(), s.end(), re);
-	}
-private:
-	const std::regex re;
-};
+		auto& node = r.nodes[n];
+		if (node.min_route >= best)
+			return;
+		consider(node.prefix);
+		if (pos == path.size()) {
+			consider(node.exact);
+			return;
+		}
 
-struct MatchBuilder
-{
-	using result_type = std::unique_ptr<Router::Matcher>;
+		if (auto i = node.firsts.find(path[pos]); i != std::string::npos) {
+			const auto child = node.children[i];
+			const string_view label = r.nodes[child].label;
+			if (path.compare(pos, label.size(), label) == 0)
+				visit(child, pos + label.size());
+		}
 
-	auto operator()(const Options::Route::Equal& r) const -> result_type
-	{
-		return std::make_unique<ExactMatcher>(r.str);
-	}
-	auto operator()(const Options::Route::Prefix& r) const -> result_type
-	{
-		return std::make_unique<PrefixMatcher>(r.str);
-	}
-	auto operator()(const Options::Route::Regex& r) const -> result_type
-	{
-		return std::make_unique<RegexMatcher>(r.re);
+		if (node.param_children.empty())
+			return;
+		const auto end = std::min(path.find('/', pos), path.size());
+		if (end == pos)
+			return;
+		const auto n_captured = captured.size();
+		for (auto child : node.param_children) {
+			captured.push_back({ r.nodes[child].label, path.substr(pos, end - pos) });
+			visit(child, end);
+			captured.resize(n_captured);
+		}
 	}
 };
-}
 
-Router::Router(const ModuleManager& manager, const Options::RouteList& routes)
+Router::Router(const ModuleManager& manager, const Options::RouteList& routes):
+	nodes(1, Node{ {}, {}, {}, {}, {}, {}, no_route })
 {
-	matchers.reserve(routes.size());
+	entries.reserve(routes.size());
 	for (auto& r: routes) {
 		auto rh = manager.get_handler(r.handler);
 		if (!rh)
@@ -75,18 +80,149 @@ Router::Router(const ModuleManager& manager, const Options::RouteList& routes)
 		auto http_rh = std::dynamic_pointer_cast<RequestHandler>(rh);
 		if (!http_rh)
 			throw Options::Error{ r.handler + ": not HTTP request handler" };
-		matchers.emplace_back(
-			visit(MatchBuilder{}, r.matcher),
-			move(http_rh));
+
+		const auto route = static_cast<Index>(entries.size());
+		const auto pattern = visit(PatternBuilder{}, r.matcher);
+		if (!std::holds_alternative<Options::Route::Regex>(r.matcher))
+			add_pattern(pattern, std::holds_alternative<Options::Route::Prefix>(r.matcher), route);
+		else if (regex_set.add(pattern))
+			regex_routes.push_back(route);
+		else
+			regexes.push_back({ std::regex{ pattern, std::regex_constants::optimize }, route });
+
+		entries.push_back({
+			move(http_rh),
+			std::make_unique<ArenaFootprint>(),
+			r.method });
+	}
+
+	if (!regex_set.compile()) {
+		// too many states for one automaton; the patterns are tried one by one
+		regexes.clear();
+		Index route = 0;
+		for (auto& r: routes) {
+			if (auto re = std::get_if<Options::Route::Regex>(&r.matcher))
+				regexes.push_back({ std::regex{ re->re, std::regex_constants::optimize }, route });
+			++route;
+		}
+		regex_set = {};
+		regex_set.compile();
+		regex_routes.clear();
+	}
+}
+
+auto Router::add_pattern(string_view pattern, bool is_prefix, Index route) -> void
+{
+	Index node = 0;
+	nodes[node].min_route = std::min(nodes[node].min_route, route);
+	std::size_t n_params = 0;
+	while (!pattern.empty()) {
+		const auto open = pattern.find('{');
+		node = add_literal(node, pattern.substr(0, open), route);
+		if (open == string_view::npos)
+			break;
+
+		const auto close = pattern.find('}', open);
+		if (close == string_view::npos || close == open + 1)
+			throw Options::Error{ std::string{ pattern } + ": bad path parameter" };
+		if (close + 1 != pattern.size() && pattern[close + 1] != '/')
+			throw Options::Error{ std::string{ pattern } + ": path parameter must end a segment" };
+		if (++n_params > PathParams::capacity)
+			throw Options::Error{ std::string{ pattern } + ": too many path parameters" };
+		node = add_param(node, pattern.substr(open + 1, close - open - 1), route);
+		pattern.remove_prefix(close + 1);
 	}
+	(is_prefix ? nodes[node].prefix : nodes[node].exact).push_back(route);
+}
+
+auto Router::add_literal(Index node, string_view s, Index route) -> Index
+{
+	while (!s.empty()) {
+		const auto i = nodes[node].firsts.find(s[0]);
+		if (i == std::string::npos) {
+			const auto child = static_cast<Index>(nodes.size());
+			nodes.push_back({ std::string{ s }, {}, {}, {}, {}, {}, route });
+			nodes[node].firsts += s[0];
+			nodes[node].children.push_back(child);
+			return child;
+		}
+
+		auto child = nodes[node].children[i];
+		const string_view label = nodes[child].label;
+		const auto common = static_cast<std::size_t>(
+			std::mismatch(label.begin(), label.end(), s.begin(), s.end()).first - label.begin());
+		if (common < label.size()) {
+			// the edge is split where the pattern leaves it
+			const auto middle = static_cast<Index>(nodes.size());
+			nodes.push_back({ std::string{ label.substr(0, common) },
+				std::string(1, label[common]), { child }, {}, {}, {}, nodes[child].min_route });
+			nodes[child].label.erase(0, common);
+			nodes[node].children[i] = middle;
+			child = middle;
+		}
+		nodes[child].min_route = std::min(nodes[child].min_route, route);
+		node = child;
+		s.remove_prefix(common);
+	}
+	return node;
+}
+
+auto Router::add_param(Index node, string_view name, Index route) -> Index
+{
+	for (auto child : nodes[node].param_children)
+		if (nodes[child].label == name) {
+			nodes[child].min_route = std::min(nodes[child].min_route, route);
+			return child;
+		}
+	const auto child = static_cast<Index>(nodes.size());
+	nodes.push_back({ std::string{ name }, {}, {}, {}, {}, {}, route });
+	nodes[node].param_children.push_back(child);
+	return child;
 }
 
-RequestHandler* Router::resolve(string_view path) const
+auto Router::allows(Index route, string_view method) const noexcept -> bool
 {
-	for (auto& [matcher, handler]: matchers)
-		if (matcher->match(path))
-			return handler.get();
+	const string_view allowed = entries[route].method;
+	// a GET route serves HEAD as well
+	return allowed.empty() || allowed == method || (allowed == "GET"sv && method == "HEAD"sv);
+}
+
+auto Router::first_allowed(const std::vector<Index>& routes, string_view method) const noexcept -> Index
+{
+	for (auto route : routes)
+		if (allows(route, method))
+			return route;
+	return no_route;
+}
+
+RequestHandler* Router::resolve(string_view path, string_view method) const
+{
+	PathParams params;
+	auto r = find(path, method, params);
+	return r ? r->handler.get() : nullptr;
+}
+
+auto Router::find(string_view path, string_view method, PathParams& params) const -> const Route*
+{
+	params.resize(0);
+	Search s{ *this, path, method, params };
+	s.visit(0, 0);
+	if (s.best != no_route)
+		return &entries[s.best];
+
+	auto best = no_route;
+	for (auto i : regex_set.match(path))
+		if (allows(regex_routes[i], method)) {
+			best = regex_routes[i];
+			break;
+		}
+	for (auto& r: regexes) {
+		if (r.route > best)
+			break;
+		if (allows(r.route, method) && regex_match(path.begin(), path.end(), r.re))
+			return &entries[r.route];
+	}
 
-	return nullptr;
+	return best != no_route ? &entries[best] : nullptr;
 }
 }
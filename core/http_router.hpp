@@ -1,33 +1,80 @@
 #pragma once
+#include "arena_footprint.hpp"
+#include "http_request_handler.hpp"
 #include "string_view.hpp"
 #include "options.hpp"
+#include "regex_set.hpp"
 #include <boost/core/noncopyable.hpp>
+#include <cstdint>
 #include <memory>
-#include <utility>
+#include <regex>
+#include <string>
 #include <vector>
 
 class ModuleManager;
 
 namespace http
 {
-struct RequestHandler;
-
+// Exact and prefix routes are compiled to a radix trie of their patterns,
+// regex routes are tried only if none of these matches, all at once
+// by a combined automaton, or one by one if it does not understand them.
+// Of the matching routes, the first configured one is chosen.
+// A {name} pattern segment matches a nonempty path segment, which is captured.
 class Router: boost::noncopyable
 {
 public:
+	struct Route
+	{
+		std::shared_ptr<RequestHandler> handler;
+		// memory used by its tasks, learned while serving
+		std::unique_ptr<ArenaFootprint> footprint;
+		// any method if empty
+		std::string method;
+	};
+
 	Router(const ModuleManager& manager, const Options::RouteList& routes);
 
-	RequestHandler* resolve(string_view path) const;
-	
-	struct Matcher
+	RequestHandler* resolve(string_view path, string_view method = "GET"sv) const;
+	const Route* find(string_view path, string_view method, PathParams& params) const;
+
+private:
+	using Index = std::uint32_t;
+
+	struct Node
 	{
-		virtual ~Matcher() = default;
+		// the pattern part leading from the parent; the name, for a parameter
+		std::string label;
+		// the first characters of the labels of the literal children
+		std::string firsts;
+		std::vector<Index> children;
+		std::vector<Index> param_children;
+		// routes ending here, in the configuration order
+		std::vector<Index> exact;
+		std::vector<Index> prefix;
+		// the first route of the subtree
+		Index min_route;
+	};
 
-		virtual bool match(string_view s) const = 0;
+	struct RegexRoute
+	{
+		std::regex re;
+		Index route;
 	};
 
-private:
-	std::vector<std::pair<std::unique_ptr<const Matcher>,
-		std::shared_ptr<RequestHandler>>> matchers;
+	struct Search;
+
+	auto add_pattern(string_view pattern, bool is_prefix, Index route) -> void;
+	auto add_literal(Index node, string_view s, Index route) -> Index;
+	auto add_param(Index node, string_view name, Index route) -> Index;
+	auto allows(Index route, string_view method) const noexcept -> bool;
+	auto first_allowed(const std::vector<Index>& routes, string_view method) const noexcept -> Index;
+
+	std::vector<Route> entries;
+	std::vector<Node> nodes;
+	RegexSet regex_set;
+	// by the pattern of the set
+	std::vector<Index> regex_routes;
+	// the regex routes not in the set, in order
+	std::vector<RegexRoute> regexes;
 };
-}
\ No newline at end of file
+}
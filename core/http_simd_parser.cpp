@@ -0,0 +1,580 @@
+#include "http_simd_parser.hpp"
+#include "http_message.hpp"
+#include <boost/assert.hpp>
+#include <boost/config.hpp>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEMON_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace http
+{
+namespace
+{
+using std::size_t;
+
+constexpr auto uc(char c) noexcept
+{
+	return static_cast<unsigned char>(c);
+}
+
+// Bytes a scan passes over, and the same set in the forms the vector
+// instructions need
+struct CharClass
+{
+	std::array<bool, 256> allowed{};
+	// bit h of the entry l is set if the byte 0xhl is allowed, for bytes below 0x80
+	std::array<std::uint8_t, 16> by_low{};
+	bool high_allowed = false;
+	// pairs of bounds including every byte not allowed, and maybe some allowed ones
+	std::array<char, 16> ranges{};
+	int n_ranges = 0;
+};
+
+template <typename Allowed>
+constexpr auto make_class(Allowed is_allowed, string_view ranges) noexcept
+{
+	CharClass cc;
+	for (unsigned c = 0; c < 256; ++c) {
+		cc.allowed[c] = is_allowed(static_cast<unsigned char>(c));
+		if (c < 0x80 && cc.allowed[c])
+			cc.by_low[c & 0xf] |= static_cast<std::uint8_t>(1 << (c >> 4));
+	}
+	cc.high_allowed = cc.allowed[0x80];
+	for (size_t i = 0; i < ranges.size(); ++i)
+		cc.ranges[i] = ranges[i];
+	cc.n_ranges = static_cast<int>(ranges.size());
+	return cc;
+}
+
+enum CharClassId { token_chars, url_chars, value_chars };
+
+constexpr std::array<CharClass, 3> char_classes = {
+	// a method or a header name
+	make_class([](unsigned char c)
+	{
+		return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+			|| (c && "!#$%&'*+-.^_`|~"sv.find(static_cast<char>(c)) != string_view::npos);
+	}, "\x00 \"\"(),,//:@[]{\xff"sv),
+	make_class([](unsigned char c) { return c > ' ' && c != 0x7f; },
+		"\x00 \x7f\x7f"sv),
+	make_class([](unsigned char c) { return c == '\t' || (c >= ' ' && c != 0x7f); },
+		"\x00\x08\n\x1f\x7f\x7f"sv),
+};
+
+using Find = auto (*)(const char* p, const char* end) noexcept -> const char*;
+
+// the first byte not allowed, or end
+template <int C>
+auto find_scalar(const char* p, const char* end) noexcept -> const char*
+{
+	const auto& cc = char_classes[C];
+	while (p != end && cc.allowed[uc(*p)])
+		++p;
+	return p;
+}
+
+#ifdef LEMON_X86_SIMD
+template <int C>
+__attribute__((target("sse4.2")))
+auto find_sse42(const char* p, const char* end) noexcept -> const char*
+{
+	const auto& cc = char_classes[C];
+	const auto ranges = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cc.ranges.data()));
+	while (end - p >= 16) {
+		const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		const auto i = _mm_cmpestri(ranges, cc.n_ranges, bytes, 16,
+			_SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+		p += i;
+		if (i != 16) {
+			if (!cc.allowed[uc(*p)])
+				return p;
+			++p;
+		}
+	}
+	return find_scalar<C>(p, end);
+}
+
+// the entries of the class table are selected by the low nibbles,
+// and their bits by the high ones
+template <int C>
+__attribute__((target("avx2")))
+auto find_avx2(const char* p, const char* end) noexcept -> const char*
+{
+	const auto& cc = char_classes[C];
+	const auto by_low = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128(reinterpret_cast<const __m128i*>(cc.by_low.data())));
+	const auto bit_by_high = _mm256_setr_epi8(
+		1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0,
+		1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+	const auto nibble = _mm256_set1_epi8(0xf);
+	while (end - p >= 32) {
+		const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		const auto low = _mm256_and_si256(bytes, nibble);
+		const auto high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble);
+		const auto bits = _mm256_and_si256(
+			_mm256_shuffle_epi8(by_low, low), _mm256_shuffle_epi8(bit_by_high, high));
+		auto stop = static_cast<std::uint32_t>(
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, _mm256_setzero_si256())));
+		if (cc.high_allowed)
+			stop &= ~static_cast<std::uint32_t>(_mm256_movemask_epi8(bytes));
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+	return find_scalar<C>(p, end);
+}
+#endif
+
+struct Scanner
+{
+	Find token;
+	Find url;
+	Find value;
+};
+
+auto pick_scanner() noexcept -> Scanner
+{
+#ifdef LEMON_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return { find_avx2<token_chars>, find_avx2<url_chars>, find_avx2<value_chars> };
+	if (__builtin_cpu_supports("sse4.2"))
+		return { find_sse42<token_chars>, find_sse42<url_chars>, find_sse42<value_chars> };
+#endif
+	return { find_scalar<token_chars>, find_scalar<url_chars>, find_scalar<value_chars> };
+}
+
+const Scanner scan = pick_scanner();
+
+// the methods http-parser 2.7.1 knows, as requests with others are refused by it
+constexpr string_view other_methods[] = {
+	"DELETE"sv, "PUT"sv, "CONNECT"sv, "OPTIONS"sv, "TRACE"sv, "COPY"sv, "LOCK"sv,
+	"MKCOL"sv, "MOVE"sv, "PROPFIND"sv, "PROPPATCH"sv, "SEARCH"sv, "UNLOCK"sv,
+	"BIND"sv, "REBIND"sv, "UNBIND"sv, "ACL"sv, "REPORT"sv, "MKACTIVITY"sv,
+	"CHECKOUT"sv, "MERGE"sv, "M-SEARCH"sv, "NOTIFY"sv, "SUBSCRIBE"sv,
+	"UNSUBSCRIBE"sv, "PATCH"sv, "PURGE"sv, "MKCALENDAR"sv, "LINK"sv, "UNLINK"sv,
+};
+
+auto method_from(string_view name) noexcept -> std::optional<Request::Method>
+{
+	using M = Request::Method::Type;
+	if (name == "GET"sv)
+		return Request::Method{ M::get, name };
+	if (name == "HEAD"sv)
+		return Request::Method{ M::head, name };
+	if (name == "POST"sv)
+		return Request::Method{ M::post, name };
+	if (std::find(std::begin(other_methods), std::end(other_methods), name) != std::end(other_methods))
+		return Request::Method{ M::other, name };
+	return std::nullopt;
+}
+
+auto is_alpha(char c) noexcept
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// origin form, absolute form, or authority form for CONNECT
+auto parse_url(Url& url, bool is_connect) noexcept -> bool
+{
+	const auto s = url.all;
+	if (is_connect) {
+		url.path = url.query = {};
+		return true;
+	}
+	size_t path_begin = 0;
+	if (s[0] == '*') {
+		url.path = s;
+		url.query = {};
+		return true;
+	}
+	if (s[0] != '/') {
+		const auto scheme_end = static_cast<size_t>(std::find_if_not(s.begin(), s.end(), is_alpha) - s.begin());
+		if (scheme_end == 0 || s.substr(scheme_end, 3) != "://"sv)
+			return false;
+		path_begin = s.find_first_of("/?#"sv, scheme_end + 3);
+		if (path_begin == scheme_end + 3)
+			return false;
+		if (path_begin == string_view::npos)
+			path_begin = s.size();
+	}
+	const auto rest = s.substr(path_begin);
+	const auto path_end = std::min(rest.find_first_of("?#"sv), rest.size());
+	url.path = rest.substr(0, path_end);
+	url.query = {};
+	if (path_end < rest.size() && rest[path_end] == '?') {
+		const auto query = rest.substr(path_end + 1);
+		url.query = query.substr(0, query.find('#'));
+	}
+	return true;
+}
+
+auto trim(string_view s) noexcept
+{
+	while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+		s.remove_suffix(1);
+	return s;
+}
+
+// whether the comma-separated list has the token
+auto has_token(string_view list, string_view token) noexcept
+{
+	while (!list.empty()) {
+		const auto comma = std::min(list.find(','), list.size());
+		auto item = trim(list.substr(0, comma));
+		while (!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+			item.remove_prefix(1);
+		if (Message::Header{ item, {} }.is(token))
+			return true;
+		list.remove_prefix(std::min(comma + 1, list.size()));
+	}
+	return false;
+}
+
+// the last of the transfer codings
+auto is_chunked(string_view codings) noexcept
+{
+	const auto comma = codings.rfind(',');
+	auto last = comma == string_view::npos ? codings : codings.substr(comma + 1);
+	while (!last.empty() && (last.front() == ' ' || last.front() == '\t'))
+		last.remove_prefix(1);
+	return Message::Header{ trim(last), {} }.is("chunked"sv);
+}
+
+auto hex_digit(char c) noexcept -> int
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// more is refused by any limit anyway
+constexpr std::uint64_t max_length = std::uint64_t{ 1 } << 60;
+}
+
+auto SimdParser::reset(Request& req, bool& drop_mode, size_t max_content_length,
+	bool report_headers) noexcept -> void
+{
+	r = &req;
+	req.known_headers = {};
+	this->drop_mode = &drop_mode;
+	this->max_content_length = max_content_length;
+	this->report_headers = report_headers;
+	state = State::start;
+	step = Step::request_line;
+	pending = {};
+	carry_size = 0;
+	carried = false;
+	carry_truncated = false;
+	http_minor = 0;
+	connection = Connection::none;
+	has_content_length = false;
+	chunked = false;
+	content_length = 0;
+	remaining = 0;
+	error.reset();
+}
+
+auto SimdParser::parse_chunk(string_view chunk) noexcept -> Result
+{
+	auto p = chunk.data();
+	const auto end = p + chunk.size();
+	// the buffer has ended in the middle of the headers
+	if (!pending.empty() && pending.data() + pending.size() != p)
+		return { Error{ Response::Status::request_header_fields_too_large }, string_view{} };
+	try {
+		while (p != end) {
+			switch (step) {
+			case Step::request_line: {
+				auto result = parse_request_line(p, end);
+				if (!std::holds_alternative<RequestLine>(result))
+					return { result, string_view{} };
+				// reported once, the rest of the request may come with later chunks
+				state = State::headers;
+				if (!*drop_mode)
+					return { result, { p, static_cast<size_t>(end - p) } };
+				break;
+			}
+			case Step::body:
+			case Step::chunk_data:
+				take_body(p, end);
+				break;
+			case Step::done:
+				BOOST_ASSERT(!"parsing beyond the request");
+				return { CompleteRequest{}, { p, static_cast<size_t>(end - p) } };
+			default: {
+				string_view line;
+				if (!next_line(p, end, line))
+					return { IncompleteRequest{}, string_view{} };
+				const auto in_head = state == State::headers;
+				if (auto e = parse_line(line))
+					return { *e, string_view{} };
+				// a request without a body is routed when it is complete
+				if (in_head && state == State::content && step != Step::done && report_headers && !*drop_mode)
+					return { HeadersComplete{}, { p, static_cast<size_t>(end - p) } };
+				break;
+			}
+			}
+			if (step == Step::done)
+				return { CompleteRequest{}, { p, static_cast<size_t>(end - p) } };
+		}
+	} catch (std::bad_alloc& e) {
+		return { memory_error(e), string_view{} };
+	}
+	return { IncompleteRequest{}, string_view{} };
+}
+
+auto SimdParser::move_unfinished(char* dest) noexcept -> void
+{
+	std::copy(pending.begin(), pending.end(), dest);
+	pending = { dest, pending.size() };
+}
+
+auto SimdParser::finalize(Request& req) const -> void
+{
+	if (*drop_mode)
+		return;
+	classify_headers(req);
+}
+
+auto SimdParser::parse_request_line(const char*& p, const char* end) -> Result::first_type
+{
+	auto begin = p;
+	if (pending.empty()) {
+		// empty lines before a request are ignored
+		while (begin != end && (*begin == '\r' || *begin == '\n'))
+			++begin;
+		if (begin == end) {
+			p = end;
+			return IncompleteRequest{};
+		}
+	} else {
+		begin = pending.data();
+		pending = {};
+	}
+
+	const auto method_end = scan.token(begin, end);
+	if (method_end != end && (*method_end != ' ' || method_end == begin))
+		return Error{ Response::Status::bad_request, "invalid HTTP method"sv };
+	const auto url_begin = method_end + 1;
+	const auto url_end = method_end == end ? end : scan.url(url_begin, end);
+	if (url_end == end) {
+		keep(begin, end);
+		p = end;
+		return IncompleteRequest{};
+	}
+	if (*url_end != ' ' || url_end == url_begin)
+		return Error{ Response::Status::bad_request, "invalid URL"sv };
+
+	const auto method = method_from({ begin, static_cast<size_t>(method_end - begin) });
+	if (!method)
+		return Error{ Response::Status::bad_request, "invalid HTTP method"sv };
+	r->method = *method;
+	r->url.all = { url_begin, static_cast<size_t>(url_end - url_begin) };
+	if (!parse_url(r->url, r->method.name == "CONNECT"sv))
+		return Error{ Response::Status::bad_request, "bad URL"sv };
+	p = url_end + 1;
+	step = Step::version;
+	return RequestLine{};
+}
+
+auto SimdParser::next_line(const char*& p, const char* end, string_view& line) noexcept -> bool
+{
+	const auto nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+	const auto line_end = nl ? nl : end;
+	if (carried) {
+		const auto n = std::min(static_cast<size_t>(line_end - p), max_carry - carry_size);
+		std::copy_n(p, n, carry.data() + carry_size);
+		carry_size += n;
+		carry_truncated = carry_truncated || n < static_cast<size_t>(line_end - p);
+		if (!nl) {
+			p = end;
+			return false;
+		}
+		line = { carry.data(), carry_size };
+		carried = false;
+		carry_size = 0;
+	} else {
+		const auto begin = pending.empty() ? p : pending.data();
+		pending = {};
+		if (!nl) {
+			keep(begin, end);
+			p = end;
+			return false;
+		}
+		line = { begin, static_cast<size_t>(nl - begin) };
+	}
+	p = nl + 1;
+	if (!line.empty() && line.back() == '\r')
+		line.remove_suffix(1);
+	return true;
+}
+
+void SimdParser::keep(const char* begin, const char* end) noexcept
+{
+	// the buffer is reused when dropping, and the body comes in separate ones
+	if (*drop_mode || state == State::content) {
+		const auto n = std::min(static_cast<size_t>(end - begin), max_carry);
+		std::copy_n(begin, n, carry.data());
+		carry_size = n;
+		carry_truncated = n < static_cast<size_t>(end - begin);
+		carried = true;
+	} else {
+		pending = { begin, static_cast<size_t>(end - begin) };
+	}
+}
+
+auto SimdParser::parse_line(string_view line) -> const Error*
+{
+	const auto truncated = std::exchange(carry_truncated, false);
+
+	switch (step) {
+	case Step::version: {
+		if (line.size() != 8 || line.substr(0, 5) != "HTTP/"sv || line[6] != '.'
+			|| line[5] < '0' || line[5] > '9' || line[7] < '0' || line[7] > '9')
+			return fail(Error{ Response::Status::bad_request, "invalid HTTP version"sv });
+		if (!*drop_mode && (line[5] != '1' || line[7] > '1'))
+			return fail(Error{ Response::Status::http_version_not_supported });
+		http_minor = static_cast<unsigned>(line[7] - '0');
+		step = Step::header;
+		return nullptr;
+	}
+	case Step::header:
+		if (line.empty())
+			return end_headers();
+		// the values of the headers which matter are short
+		if (truncated)
+			return fail(Error{ Response::Status::request_header_fields_too_large });
+		return parse_header(line);
+	case Step::chunk_size:
+		return parse_chunk_size(line);
+	case Step::chunk_end:
+		if (!line.empty())
+			return fail(Error{ Response::Status::bad_request, "invalid chunk end"sv });
+		step = Step::chunk_size;
+		return nullptr;
+	case Step::trailer:
+		// trailer fields are not used
+		if (line.empty())
+			complete();
+		return nullptr;
+	default:
+		BOOST_UNREACHABLE_RETURN(nullptr);
+	}
+}
+
+auto SimdParser::parse_header(string_view line) -> const Error*
+{
+	const auto end = line.data() + line.size();
+	const auto name_end = scan.token(line.data(), end);
+	if (name_end == end || *name_end != ':' || name_end == line.data())
+		return fail(Error{ Response::Status::bad_request, "invalid character in header"sv });
+	const string_view name{ line.data(), static_cast<size_t>(name_end - line.data()) };
+
+	auto value_begin = name_end + 1;
+	while (value_begin != end && (*value_begin == ' ' || *value_begin == '\t'))
+		++value_begin;
+	if (scan.value(value_begin, end) != end)
+		return fail(Error{ Response::Status::bad_request, "invalid character in header"sv });
+	const auto value = trim({ value_begin, static_cast<size_t>(end - value_begin) });
+
+	const Message::Header header{ name, value };
+	if (header.is("content-length"sv)) {
+		std::uint64_t length = 0;
+		for (auto c : value) {
+			if (c < '0' || c > '9' || length >= max_length)
+				return fail(Error{ Response::Status::bad_request, "invalid content length"sv });
+			length = length * 10 + static_cast<unsigned>(c - '0');
+		}
+		if (value.empty() || (has_content_length && length != content_length))
+			return fail(Error{ Response::Status::bad_request, "invalid content length"sv });
+		has_content_length = true;
+		content_length = length;
+	} else if (header.is("transfer-encoding"sv)) {
+		chunked = is_chunked(value);
+	} else if (header.is("connection"sv)) {
+		if (has_token(value, "close"sv))
+			connection = Connection::close;
+		else if (has_token(value, "keep-alive"sv))
+			connection = Connection::keep_alive;
+	}
+
+	if (!*drop_mode)
+		r->headers.push_back(header);
+	return nullptr;
+}
+
+auto SimdParser::parse_chunk_size(string_view line) noexcept -> const Error*
+{
+	std::uint64_t size = 0;
+	size_t i = 0;
+	for (int d; i < line.size() && (d = hex_digit(line[i])) >= 0; ++i) {
+		if (size >= max_length)
+			return fail(Error{ Response::Status::bad_request, "invalid chunk size"sv });
+		size = size * 16 + static_cast<unsigned>(d);
+	}
+	// chunk extensions are ignored
+	if (i == 0 || (i < line.size() && line[i] != ';' && line[i] != ' ' && line[i] != '\t'))
+		return fail(Error{ Response::Status::bad_request, "invalid chunk size"sv });
+	remaining = size;
+	step = size ? Step::chunk_data : Step::trailer;
+	return nullptr;
+}
+
+auto SimdParser::end_headers() noexcept -> const Error*
+{
+	if (!*drop_mode) {
+		// refused before the body is read
+		if (max_content_length && !chunked && content_length > max_content_length)
+			return fail(Error{ Response::Status::payload_too_large });
+		r->http_version = static_cast<Message::ProtocolVersion>(http_minor);
+	}
+	state = State::content;
+	if (chunked) {
+		step = Step::chunk_size;
+	} else if (content_length) {
+		remaining = content_length;
+		step = Step::body;
+	} else {
+		complete();
+	}
+	return nullptr;
+}
+
+auto SimdParser::take_body(const char*& p, const char* end) -> void
+{
+	const auto n = static_cast<size_t>(std::min<std::uint64_t>(remaining, static_cast<std::uint64_t>(end - p)));
+	if (!*drop_mode)
+		r->body.emplace_back(p, n);
+	p += n;
+	remaining -= n;
+	if (remaining)
+		return;
+	if (step == Step::chunk_data)
+		step = Step::chunk_end;
+	else
+		complete();
+}
+
+auto SimdParser::fail(Error e) noexcept -> const Error*
+{
+	error.emplace(e);
+	return &*error;
+}
+
+auto SimdParser::complete() noexcept -> void
+{
+	r->keep_alive = http_minor ? connection != Connection::close : connection == Connection::keep_alive;
+	r->content_length = chunked ? 0 : static_cast<size_t>(content_length);
+	state = State::body;
+	step = Step::done;
+}
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "string_view.hpp"
+#include "http_error.hpp"
+#include "http_parser_.hpp"
+#include <boost/core/noncopyable.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace http
+{
+struct Request;
+
+// HTTP/1.x request parser scanning many bytes at once, with SSE4.2 or AVX2
+// if the processor has them. Gives the same results as Parser.
+// The request line and headers are expected to be contiguous in memory;
+// when they go on in another buffer, their unfinished line has to be moved
+// to its start. The body may come in any chunks.
+class SimdParser: boost::noncopyable
+{
+public:
+	using RequestLine = Parser::RequestLine;
+	using HeadersComplete = Parser::HeadersComplete;
+	using IncompleteRequest = Parser::IncompleteRequest;
+	using CompleteRequest = Parser::CompleteRequest;
+	using Result = Parser::Result;
+
+	SimdParser() = default;
+
+	// a longer body is refused, if the limit is not zero;
+	// the end of the headers is reported before the body if asked
+	auto reset(Request& req, bool& drop_mode, std::size_t max_content_length = 0,
+		bool report_headers = false) noexcept -> void;
+	auto parse_chunk(string_view chunk) noexcept -> Result;
+	auto finalize(Request& req) const -> void;
+
+	// the unfinished line of the head, which the next chunk has to follow
+	auto unfinished() const noexcept -> string_view { return pending; }
+	auto move_unfinished(char* dest) noexcept -> void;
+
+	auto is_started() const noexcept -> bool { return state != State::start; }
+	auto headers_complete() const noexcept -> bool
+	{
+		return state == State::content || state == State::body;
+	}
+
+private:
+	enum class State {
+		start,
+		headers,
+		content,
+		body
+	};
+
+	// what comes next in the bytes
+	enum class Step {
+		request_line,
+		version,
+		header,
+		body,
+		chunk_size,
+		chunk_data,
+		chunk_end,
+		trailer,
+		done
+	};
+
+	enum class Connection: std::uint8_t { none, close, keep_alive };
+
+	auto parse_request_line(const char*& p, const char* end) -> Result::first_type;
+	auto next_line(const char*& p, const char* end, string_view& line) noexcept -> bool;
+	void keep(const char* begin, const char* end) noexcept;
+	auto parse_line(string_view line) -> const Error*;
+	auto parse_header(string_view line) -> const Error*;
+	auto parse_chunk_size(string_view line) noexcept -> const Error*;
+	auto end_headers() noexcept -> const Error*;
+	auto take_body(const char*& p, const char* end) -> void;
+	auto fail(Error e) noexcept -> const Error*;
+	auto complete() noexcept -> void;
+
+	// an unfinished line is copied when its buffer may be reused
+	static constexpr std::size_t max_carry = 128;
+
+	Request* r = nullptr;
+	bool* drop_mode = nullptr;
+	std::size_t max_content_length = 0;
+	bool report_headers = false;
+	State state = State::start;
+	Step step = Step::request_line;
+	// the unfinished line, or request line, of the previous chunk
+	string_view pending;
+	std::array<char, max_carry> carry;
+	std::size_t carry_size = 0;
+	bool carried = false;
+	bool carry_truncated = false;
+
+	unsigned http_minor = 0;
+	Connection connection = Connection::none;
+	bool has_content_length = false;
+	bool chunked = false;
+	std::uint64_t content_length = 0;
+	// of the body or the current chunk
+	std::uint64_t remaining = 0;
+	std::optional<Error> error;
+};
+}
@@ -2,10 +2,14 @@
 #include "http_error.hpp"
 #include "http_request_handler.hpp"
 #include "http_router.hpp"
+#include "http_virtual_hosts.hpp"
+#include "memory_budget.hpp"
+#include "slab_allocator.hpp"
 #include "string_builder.hpp"
 #include "tcp_session.hpp"
-#include <boost/pool/pool_alloc.hpp>
 #include <boost/concept_check.hpp>
+#include <algorithm>
+#include <new>
 #include <ostream>
 
 namespace http
@@ -14,7 +18,11 @@ namespace
 {
 BOOST_CONCEPT_ASSERT((boost::BidirectionalIterator<Task::Result::const_iterator>));
 
-boost::fast_pool_allocator<Task, boost::default_user_allocator_malloc_free> task_allocator;
+// tasks are made by the reading thread and freed by the sending one
+SlabAllocator<Task> task_allocator;
+
+// a route with large bodies must not make every task allocate as much
+constexpr std::size_t max_reserve = 1024 * 1024;
 }
 
 static auto operator<<(std::ostream& stream, const RequestHandler& handler) -> std::ostream&
@@ -26,28 +34,52 @@ Task::Task(Ident id, std::shared_ptr<tcp::Session> session) noexcept:
 	id{id},
 	session{session},
 	lg{session->get_logger(), id},
-	a{lg},
+	a{lg, &session->get_arena_cache(), &session->get_memory_account()},
 	req{a},
 	resp{a},
-	router{session->get_router()}
+	hosts{session->get_hosts()}
 {
 	lg.debug("task created");
 }
 
 Task::~Task()
 {
+	if (footprint)
+		footprint->add(a.n_bytes_used() - n_used_unresolved);
 	lg.debug("task removed");
 }
 
+auto Task::resolves_by_host() const noexcept -> bool
+{
+	return hosts.by_name();
+}
+
 auto Task::resolve() noexcept -> bool
 {
 	const auto path = req.url.path;
 	BOOST_ASSERT(!path.empty());
 	
 	lg.debug("resolving: ", path);
-	handler = router.resolve(path);
-	if (handler) {
+	string_view host;
+	if (hosts.by_name())
+		if (auto h = req.header(Request::Header::Known::host))
+			host = h->value;
+	auto route = hosts.find(host).find(path, req.method.name, params);
+	if (route) {
+		handler = route->handler.get();
 		lg.debug("handler found: ", *handler);
+		// the rest of the request and the response as the route usually needs
+		footprint = route->footprint.get();
+		n_used_unresolved = a.n_bytes_used();
+		auto size = std::min(footprint->expected(), max_reserve);
+		const auto& account = session->get_memory_account();
+		if (const auto limit = account.get_limit())
+			size = std::min(size, limit - std::min(limit, account.used()));
+		try {
+			a.reserve(size);
+		} catch (std::bad_alloc&) {
+			// the blocks are allocated when needed then
+		}
 	} else {
 		lg.debug("handler not found; switch to drop mode");
 		drop_mode = true;
@@ -77,6 +109,9 @@ auto Task::run() -> void
 	} catch (Exception &he) {
 		lg.debug("HTTP error ", he.status_code(), " ", he.detail_string());
 		make_error(he.status_code());
+	} catch (MemoryBudget::Exceeded &me) {
+		lg.warning("module ", *handler, ": ", me.what());
+		make_error(memory_error(me).code);
 	} catch (std::exception &e) {
 		lg.error("internal error in module: ", *handler, ": ", e.what());
 		make_error(Response::Status::internal_server_error);
@@ -84,6 +119,15 @@ auto Task::run() -> void
 		lg.error("unknown exception in module: ", *handler);
 		make_error(Response::Status::internal_server_error);
 	}
+
+	try {
+		serialize();
+	} catch (MemoryBudget::Exceeded& me) {
+		// the head may not fit where the response did
+		lg.warning("response head: ", me.what());
+		make_error(memory_error(me).code);
+		serialize();
+	}
 }
 
 auto Task::handle_request() -> void
@@ -91,7 +135,7 @@ auto Task::handle_request() -> void
 	BOOST_ASSERT(handler);
 	
 	HandlerLoggerGuard mlg{ lg, handler->get_name() };
-	RequestHandler::Context ctx{ a, lg };
+	RequestHandler::Context ctx{ a, lg, params };
 	
 	switch (req.method.type) {
 	using method = Request::Method::Type;
@@ -107,11 +151,14 @@ auto Task::handle_request() -> void
 
 auto Task::make_error(Response::Status code) noexcept -> void
 {
+	// an error is answered even when the memory is short
+	a.allow_overdraft();
 	//TODO cache buffers
 	resp.http_version = req.http_version;
 	resp.code = code;
 	resp.body.clear();
 	resp.body.emplace_back(to_string(code));
+	resp.set_file({});
 
 	resp.headers.clear();
 	resp.headers.emplace_back("Content-Type"sv, "text/plain"sv);
@@ -119,4 +166,9 @@ auto Task::make_error(Response::Status code) noexcept -> void
 	auto clen_str = StringBuilder{ a }.convert(resp.body.front().length());
 	resp.headers.emplace_back("Content-Length"sv, clen_str);
 }
+
+auto Task::serialize() -> void
+{
+	resp_head = serialize_head(resp);
+}
 }
@@ -1,15 +1,19 @@
 #pragma once
 #include "arena_imp.hpp"
 #include "http_message.hpp"
+#include "http_request_handler.hpp"
 #include "leak_checked.hpp"
 #include "logger_imp.hpp"
 #include "task_ident.hpp"
 #include <boost/core/noncopyable.hpp>
 #include <boost/asio/buffer.hpp>
-#include <boost/iterator/transform_iterator.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+#include <cstddef>
 #include <memory>
 #include <utility>
 
+class ArenaFootprint;
+
 namespace tcp
 {
 class Session;
@@ -17,8 +21,7 @@ class Session;
 
 namespace http
 {
-struct RequestHandler;
-class Router;
+class VirtualHosts;
 	
 class Task:
 	boost::noncopyable,
@@ -31,8 +34,9 @@ public:
 	{
 		explicit Ptr(std::shared_ptr<Task> t) noexcept: t{move(t)} {}
 
+		auto get_id() const noexcept -> Ident { return t->id; }
 		auto lg() const noexcept -> TaskLogger& { return t->lg; }
-		auto get_arena() const noexcept -> Arena& { return t->a; }
+		auto get_arena() const noexcept -> ArenaImp& { return t->a; }
 
 		std::shared_ptr<Task> t;
 	};
@@ -45,7 +49,11 @@ public:
 	~Task();
 
 	auto is_last() const { return !req.keep_alive; }
+	// the route is chosen when the headers are complete, not with the request line
+	auto resolves_by_host() const noexcept -> bool;
 	auto resolve() noexcept -> bool;
+	// there is a handler, or the request is dropped
+	auto is_resolved() const noexcept -> bool { return handler || drop_mode; }
 
 private:
 	static auto make(Ident id, std::shared_ptr<tcp::Session> session) -> std::shared_ptr<Task>;
@@ -53,6 +61,7 @@ private:
 	auto run() -> void;
 	auto handle_request() -> void;
 	auto make_error(Response::Status code) noexcept -> void;
+	auto serialize() -> void;
 
 	const Ident id;
 	const std::shared_ptr<const tcp::Session> session; // keep session alive
@@ -60,8 +69,12 @@ private:
 	ArenaImp a;
 	Request req;
 	Response resp;
-	const Router& router;
+	string_view resp_head;
+	const VirtualHosts& hosts;
 	RequestHandler* handler = nullptr;
+	PathParams params;
+	ArenaFootprint* footprint = nullptr;
+	std::size_t n_used_unresolved = 0;
 	bool drop_mode = false;
 
 	friend class TaskBuilder;
@@ -70,30 +83,23 @@ private:
 };
 
 class Task::Result: public Ptr
-// implements boost::asio::ConstBufferSequence
+// implements boost::asio::ConstBufferSequence:
+// the serialized response head followed by the body chunks;
+// the file of the response, if any, goes after them
 {
 	Result(std::shared_ptr<Task> t) noexcept: Ptr{ move(t) } {}
 	friend class TaskBuilder;
 	friend class ReadyTask;
 
-	struct BufferAdapter
-	{
-		const auto& operator()(string_view s) const noexcept
-		{
-			buffer = { s.data(), s.size() };
-			return buffer;
-		}
-	private:
-		mutable boost::asio::const_buffer buffer;
-	};
 public:
+	class const_iterator;
+
 	Result(const Result&) = default;
 	Result(Result&&) = default;
 	Result& operator=(const Result&) = default;
 	Result& operator=(Result&&) = default;
 	~Result() = default;
 
-	Ident get_id() const noexcept { return t->id; }
 	bool operator<(const Result& rhs) const noexcept
 	{
 		return get_id() < rhs.get_id();
@@ -104,13 +110,77 @@ public:
 	}
 
 	using value_type = boost::asio::const_buffer;
-	using const_iterator = boost::transform_iterator<BufferAdapter,
-		Response::const_iterator>;
 
-	const_iterator begin() const { return const_iterator{ t->resp.begin() }; }
-	const_iterator end()   const { return const_iterator{ t->resp.end() }; }
+	const_iterator begin() const noexcept;
+	const_iterator end() const noexcept;
+
+	auto file() const noexcept -> const Response::File& { return t->resp.file; }
+	auto file_parts() const noexcept -> const Response::FilePartList& { return t->resp.file_parts; }
 };
 
+class Task::Result::const_iterator: public boost::iterator_facade<const_iterator,
+	const boost::asio::const_buffer, boost::bidirectional_traversal_tag>
+{
+public:
+	const_iterator() = default;
+
+private:
+	using ChunkIterator = Message::ChunkList::const_iterator;
+
+	const_iterator(const Task* t, bool in_head, ChunkIterator body_it) noexcept:
+		t{ t }, in_head{ in_head }, body_it{ body_it }
+	{
+		update();
+	}
+
+	auto dereference() const noexcept -> const boost::asio::const_buffer& { return buffer; }
+	auto equal(const const_iterator& rhs) const noexcept -> bool
+	{
+		return in_head == rhs.in_head && body_it == rhs.body_it;
+	}
+	auto increment() noexcept -> void
+	{
+		if (in_head)
+			in_head = false;
+		else
+			++body_it;
+		update();
+	}
+	auto decrement() noexcept -> void
+	{
+		if (body_it == t->resp.body.begin())
+			in_head = true;
+		else
+			--body_it;
+		update();
+	}
+	auto update() noexcept -> void
+	{
+		if (in_head)
+			buffer = { t->resp_head.data(), t->resp_head.size() };
+		else if (body_it != t->resp.body.end())
+			buffer = { body_it->data(), body_it->size() };
+	}
+
+	const Task* t = nullptr;
+	bool in_head = false;
+	ChunkIterator body_it;
+	boost::asio::const_buffer buffer;
+
+	friend class boost::iterator_core_access;
+	friend class Result;
+};
+
+inline auto Task::Result::begin() const noexcept -> const_iterator
+{
+	return { t.get(), true, t->resp.body.begin() };
+}
+
+inline auto Task::Result::end() const noexcept -> const_iterator
+{
+	return { t.get(), false, t->resp.body.end() };
+}
+
 class ReadyTask : public Task::Ptr
 {
 	ReadyTask(std::shared_ptr<Task> t) noexcept: Ptr{ move(t) } {}
@@ -123,11 +193,15 @@ public:
 	~ReadyTask() = default;
 
 	Task::Result run() const { t->run(); return { t }; }
+	// the result of a task which failed to run keeps the place of its response;
+	// it must not be sent
+	Task::Result abandon() const noexcept { return { t }; }
 };
 
 class IncompleteTask : public Task::Ptr
 {
 	IncompleteTask(std::shared_ptr<Task> t) noexcept: Ptr{ move(t) } {}
+	auto resolves_by_host() const { return t->resolves_by_host(); }
 	auto resolve() { return t->resolve(); }
 
 	friend class TaskBuilder;
@@ -46,6 +46,8 @@ auto TaskBuilder::Results::next() -> std::optional<value>
 		if (stop)
 			return std::nullopt;
 		stop = true;
+		if (!it.t)
+			return Idle{ builder.task_id };
 		return it;
 	}
 
@@ -62,18 +64,34 @@ auto TaskBuilder::Results::next() -> std::optional<value>
 				               stop = true;
 				               return make_error_task(it, error);
 			               },
-			               [this, &repeat](Parser::RequestLine) -> Result
+			               [this, &repeat](RequestParser::RequestLine) -> Result
 			               {
-				               repeat = true;
-							   it.resolve();
+							   if (!it.resolves_by_host())
+								   it.resolve();
+				               // the request line may end the chunk
+				               if (data.empty())
+					               stop = true;
+				               else
+					               repeat = true;
 				               return it;
 			               },
-			               [this](Parser::IncompleteRequest) -> Result
+			               [this, &repeat](RequestParser::HeadersComplete) -> Result
+			               {
+				               // the Host header is known, and the body is read as the route needs
+				               classify_headers(it.t->req);
+				               it.resolve();
+				               if (data.empty())
+					               stop = true;
+				               else
+					               repeat = true;
+				               return it;
+			               },
+			               [this](RequestParser::IncompleteRequest) -> Result
 			               {
 				               stop = true;
 				               return it;
 			               },
-			               [this](Parser::CompleteRequest) -> Result
+			               [this](RequestParser::CompleteRequest) -> Result
 			               {
 				               return make_ready_task(session, it);
 			               },
@@ -87,6 +105,10 @@ auto TaskBuilder::Results::make_ready_task(const std::shared_ptr<tcp::Session>&
 {
 	const auto has_more_bytes = !data.empty();
 	const auto complete_task = move(it.t);
+	builder.parser.finalize(complete_task->req);
+	// a request ending with its headers may be routed by its Host only now
+	if (!complete_task->is_resolved())
+		complete_task->resolve();
 
 	if (complete_task->is_last()) {
 		if (BOOST_UNLIKELY(has_more_bytes)) {
@@ -95,14 +117,17 @@ auto TaskBuilder::Results::make_ready_task(const std::shared_ptr<tcp::Session>&
 		}
 		stop = true;
 	} else {
-		if (!stop || has_more_bytes)
-			it = builder.prepare_task(session);
-		if (BOOST_UNLIKELY(has_more_bytes))
-			boost::copy(data, static_cast<char*>(builder.recv_buf.data()));
+		// a task for an idle connection is made when it becomes readable
+		if (BOOST_UNLIKELY(has_more_bytes)) {
+			it = builder.prepare_task(session, true);
+			// the rest belongs to the next task, which may outlive this one
+			const auto dest = static_cast<char*>(builder.recv_buf.data());
+			boost::copy(data, dest);
+			data = { dest, data.size() };
+			builder.recv_buf += data.size();
+		}
 	}
 
-	builder.parser.finalize(complete_task->req);
-	
 	return { complete_task };
 }
 
@@ -115,14 +140,16 @@ TaskBuilder::TaskBuilder(Task::Ident start_id, const Options& opt):
 		throw std::runtime_error{ "headers_size too small: " + std::to_string(opt.headers_size) };
 }
 
-auto TaskBuilder::prepare_task(const std::shared_ptr<tcp::Session>& session) -> IncompleteTask
+auto TaskBuilder::prepare_task(const std::shared_ptr<tcp::Session>& session, bool received) -> IncompleteTask
 {
 	auto t = Task::make(task_id, session);
-	++task_id;
 	auto size = opt.headers_size;
-	head_buf = { t->a.alloc(size, "request headers buffer"), size };
+	const auto msg = "request headers buffer";
+	// bytes received already are kept whatever the memory limits
+	head_buf = { received ? ArenaImp::OverdraftAllocator<char>{ t->a, msg }.allocate(size) : t->a.alloc(size, msg), size };
+	++task_id;
 	recv_buf = head_buf;
-	parser.reset(t->req, t->drop_mode);
+	parser.reset(t->req, t->drop_mode, opt.memory.connection_limit, t->resolves_by_host());
 	return { t };
 }
 
@@ -131,12 +158,35 @@ auto TaskBuilder::get_memory(const IncompleteTask& it) -> boost::asio::mutable_b
 	if (it.t->drop_mode)
 		// reuse old buffer
 		recv_buf = head_buf;
-	else if (recv_buf.size() < min_buf_size)
+	else if (recv_buf.size() < min_buf_size) {
 		//TODO adaptive size
-		recv_buf = { it.t->a.alloc(optimum_buf_size, "request buffer"), optimum_buf_size };
+		const auto msg = "request buffer";
+#ifdef LEMON_SIMD_PARSER
+		// the parser needs the head contiguous from its unfinished line on;
+		// a line longer than the head buffer gets 431 anyway
+		const auto unfinished = parser.unfinished();
+		const auto n_moved = unfinished.size() <= opt.headers_size ? unfinished.size() : 0;
+		const auto size = optimum_buf_size + n_moved;
+		const auto buf = static_cast<char*>(it.t->a.alloc(size, msg));
+		if (n_moved)
+			parser.move_unfinished(buf);
+		recv_buf = { buf + n_moved, size - n_moved };
+#else
+		recv_buf = { it.t->a.alloc(optimum_buf_size, msg), optimum_buf_size };
+#endif
+	}
 	return recv_buf;
 }
 
+auto TaskBuilder::get_stage() const noexcept -> Stage
+{
+	if (parser.headers_complete())
+		return Stage::body;
+	if (parser.is_started() || recv_buf.data() != head_buf.data())
+		return Stage::headers;
+	return Stage::idle;
+}
+
 auto TaskBuilder::make_tasks(const std::shared_ptr<tcp::Session>& session,
 	const IncompleteTask& it, std::size_t bytes_recv, bool stop) -> Results
 {
@@ -145,11 +195,20 @@ auto TaskBuilder::make_tasks(const std::shared_ptr<tcp::Session>& session,
 	return Results{ *this, session, it, data, stop };
 }
 
+auto TaskBuilder::reject_task(const std::shared_ptr<tcp::Session>& session,
+	const Error& error) -> Task::Result
+{
+	auto t = Task::make(task_id, session);
+	++task_id;
+	return make_error_task({ t }, error);
+}
+
 auto TaskBuilder::make_error_task(IncompleteTask it, const Error& error) -> Task::Result
 {
 	it.lg().info("HTTP error ", error.code, " ", error.details);
 	auto t = move(it.t);
 	t->make_error(error.code);
+	t->serialize();
 	return { t };
 }
 }
\ No newline at end of file
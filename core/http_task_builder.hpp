@@ -1,6 +1,10 @@
 #pragma once
 #include "string_view.hpp"
+#ifdef LEMON_SIMD_PARSER
+#include "http_simd_parser.hpp"
+#else
 #include "http_parser_.hpp"
+#endif
 #include "http_task.hpp"
 #include <boost/core/noncopyable.hpp>
 #include <boost/asio/buffer.hpp>
@@ -20,10 +24,18 @@ namespace http
 class TaskBuilder: boost::noncopyable
 {
 public:
+	// the connection waits for the next request, which has no task yet
+	struct Idle
+	{
+		Task::Ident id;
+
+		auto get_id() const noexcept { return id; }
+	};
+
 	class Results
 	{
 	public:
-		using value = std::variant<IncompleteTask, ReadyTask, Task::Result>;
+		using value = std::variant<IncompleteTask, ReadyTask, Task::Result, Idle>;
 
 		class iterator : public boost::iterator_facade<
 			iterator, value, std::input_iterator_tag, value>
@@ -64,21 +76,38 @@ public:
 		
 		string_view data;
 		TaskBuilder& builder;
-		const std::shared_ptr<tcp::Session>& session;
+		const std::shared_ptr<tcp::Session> session;
 		IncompleteTask it;
 		bool stop;
 	};
 
+	// what the next read of the incomplete task is waiting for
+	enum class Stage {
+		idle,
+		headers,
+		body,
+	};
+
 	TaskBuilder(Task::Ident start_id, const Options& opt);
 
-	auto prepare_task(const std::shared_ptr<tcp::Session>& session) -> IncompleteTask;
+	// received: the task is for bytes read with the previous request
+	auto prepare_task(const std::shared_ptr<tcp::Session>& session, bool received = false) -> IncompleteTask;
 	auto get_memory(const IncompleteTask& it) -> boost::asio::mutable_buffer;
+	auto get_stage() const noexcept -> Stage;
 	auto make_tasks(const std::shared_ptr<tcp::Session>& session, const IncompleteTask& it,
 		std::size_t bytes_recv, bool stop) -> Results;
 	static auto make_error_task(IncompleteTask it, const Error& error) -> Task::Result;
+	// answers the next request without reading it
+	auto reject_task(const std::shared_ptr<tcp::Session>& session, const Error& error) -> Task::Result;
 
 private:
-	Parser parser;
+#ifdef LEMON_SIMD_PARSER
+	using RequestParser = SimdParser;
+#else
+	using RequestParser = Parser;
+#endif
+
+	RequestParser parser;
 	const Options& opt;
 	Task::Ident task_id;
 	boost::asio::mutable_buffer recv_buf;
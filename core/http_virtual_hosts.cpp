@@ -0,0 +1,100 @@
+#include "http_virtual_hosts.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <array>
+#include <limits>
+
+namespace http
+{
+namespace
+{
+constexpr auto no_router = std::numeric_limits<std::uint32_t>::max();
+// the longest DNS name
+constexpr std::size_t max_name = 253;
+
+// the name of the host without the port and the final dot, in lower case
+auto host_name(string_view host, std::array<char, max_name>& buf) noexcept -> string_view
+{
+	if (!host.empty() && host.front() == '[')
+		host = host.substr(0, host.find(']') + 1);
+	else
+		host = host.substr(0, host.find(':'));
+	if (!host.empty() && host.back() == '.')
+		host.remove_suffix(1);
+	if (host.size() > buf.size())
+		return {};
+	for (std::size_t i = 0; i < host.size(); ++i) {
+		const auto c = host[i];
+		buf[i] = c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+	}
+	return { buf.data(), host.size() };
+}
+}
+
+VirtualHosts::VirtualHosts(const ModuleManager& manager, const Options::Server& server):
+	wildcards(1, Node{ {}, no_router })
+{
+	if (server.hosts.empty())
+		throw Options::Error{ "no routes on port " + std::to_string(server.listen_port) };
+
+	routers.reserve(server.hosts.size());
+	for (auto& host : server.hosts) {
+		const auto router = static_cast<Index>(routers.size());
+		routers.push_back(std::make_unique<Router>(manager, host.routes));
+		for (auto& name : host.names) {
+			auto& key = names.emplace_back(boost::algorithm::to_lower_copy(name));
+			if (key.size() > 2 && key.compare(0, 2, "*.") == 0)
+				add_wildcard(string_view{ key }.substr(2), router);
+			else if (key.find('*') != std::string::npos || key.empty())
+				throw Options::Error{ name + ": bad server name" };
+			else
+				// the first host of a name serves it
+				exact.emplace(key, router);
+			named = true;
+		}
+	}
+}
+
+auto VirtualHosts::add_wildcard(string_view name, Index router) -> void
+{
+	Index node = 0;
+	while (!name.empty()) {
+		const auto dot = name.rfind('.');
+		const auto label = dot == string_view::npos ? name : name.substr(dot + 1);
+		name = dot == string_view::npos ? string_view{} : name.substr(0, dot);
+		const auto [it, added] = wildcards[node].children.emplace(label, static_cast<Index>(wildcards.size()));
+		node = it->second;
+		if (added)
+			wildcards.push_back({ {}, no_router });
+	}
+	if (wildcards[node].router == no_router)
+		wildcards[node].router = router;
+}
+
+auto VirtualHosts::find(string_view host) const noexcept -> const Router&
+{
+	if (!named)
+		return *routers.front();
+
+	std::array<char, max_name> buf;
+	auto name = host_name(host, buf);
+	if (auto it = exact.find(name); it != exact.end())
+		return *routers[it->second];
+
+	// the longest wildcard, which leaves some labels of the name
+	auto router = no_router;
+	Index node = 0;
+	while (!name.empty()) {
+		const auto dot = name.rfind('.');
+		const auto label = dot == string_view::npos ? name : name.substr(dot + 1);
+		name = dot == string_view::npos ? string_view{} : name.substr(0, dot);
+		auto& children = wildcards[node].children;
+		auto it = children.find(label);
+		if (it == children.end())
+			break;
+		node = it->second;
+		if (!name.empty() && wildcards[node].router != no_router)
+			router = wildcards[node].router;
+	}
+	return *routers[router == no_router ? 0 : router];
+}
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "http_router.hpp"
+#include "options.hpp"
+#include "string_view.hpp"
+#include <boost/core/noncopyable.hpp>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ModuleManager;
+
+namespace http
+{
+// Routers of the virtual hosts of a port. An exact name is found in a hash
+// table, a wildcard one in a trie of name labels from the last one.
+// An exact name wins over a wildcard, a longer wildcard over a shorter one.
+class VirtualHosts: boost::noncopyable
+{
+public:
+	VirtualHosts(const ModuleManager& manager, const Options::Server& server);
+
+	// if not, any request goes to the first host
+	auto by_name() const noexcept -> bool { return named; }
+	// the router of the host named by the Host header value
+	auto find(string_view host) const noexcept -> const Router&;
+
+private:
+	using Index = std::uint32_t;
+
+	struct Node
+	{
+		std::unordered_map<string_view, Index> children;
+		// of the wildcard name ending here
+		Index router;
+	};
+
+	auto add_wildcard(string_view name, Index router) -> void;
+
+	std::vector<std::unique_ptr<const Router>> routers;
+	// keys of the tables
+	std::deque<std::string> names;
+	std::unordered_map<string_view, Index> exact;
+	std::vector<Node> wildcards;
+	bool named = false;
+};
+}
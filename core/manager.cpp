@@ -1,11 +1,16 @@
 #include "manager.hpp"
 #include "algorithm.hpp"
 #include "logs.hpp"
+#include "memory_budget.hpp"
 #include "module_manager.hpp"
 #include "module_provider.hpp"
 #include "options.hpp"
+#include "page_cache.hpp"
 #include "parameters.hpp"
 #include "tcp_server.hpp"
+#ifdef LEMON_IO_URING
+# include "uring_service.hpp"
+#endif
 #ifndef LEMON_NO_CONFIG
 # include "config.hpp"
 # include "config_parser.hpp"
@@ -13,8 +18,14 @@
 #include <boost/asio/post.hpp>
 #include <boost/assert.hpp>
 #include <boost/range/adaptor/filtered.hpp>
+#include <boost/range/algorithm_ext/erase.hpp>
+#include <csignal>
 #include <set>
 #include <stdexcept>
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
 
 namespace
 {
@@ -28,8 +39,37 @@ auto n_workers_default()
 	auto n_cores = std::thread::hardware_concurrency();
 	return n_cores > 0 ? n_cores : 2u;
 }
+
+auto page_cache_huge_pages(Options::HugePages::Mode mode)
+{
+	switch (mode) {
+	case Options::HugePages::Mode::transparent:
+		return PageCache::HugePages::transparent;
+	case Options::HugePages::Mode::hugetlb:
+		return PageCache::HugePages::hugetlb;
+	default:
+		return PageCache::HugePages::off;
+	}
 }
 
+auto pin_to_cpu(std::thread& thread, unsigned cpu) -> bool
+{
+#ifdef __linux__
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof cpus, &cpus) == 0;
+#else
+	return false;
+#endif
+}
+}
+
+Manager::Shard::Shard():
+	ctx{ 1 },
+	work{ make_work_guard(ctx) }
+{}
+
 Manager::Manager(const Parameters& params):
 	master_ctx{ 1 },
 	master_work{ make_work_guard(master_ctx) },
@@ -37,10 +77,17 @@ Manager::Manager(const Parameters& params):
 	quit_signals{ master_ctx, SIGTERM, SIGINT },
 	config_path{ params.config_path }
 {
+	// sendfile to a closed connection has no flag against the signal, as send has
+	std::signal(SIGPIPE, SIG_IGN);
+
 	quit_signals.async_wait([this](const boost::system::error_code&, int sig)
 	{
 		lg.info("caught termination signal #", sig);
 		worker_ctx.stop();
+		for (auto& shard : shards)
+			shard->ctx.stop();
+		for (auto& shard : stopping_shards)
+			shard->ctx.stop();
 		if (workers.empty())
 			master_ctx.stop();
 	});
@@ -62,6 +109,15 @@ auto Manager::run() -> void
 
 	master_ctx.run();
 
+	const auto pages = PageCache::stats();
+	lg.info("page cache: hits ", pages.hits, ", misses ", pages.misses,
+		", retained bytes ", pages.retained_bytes, ", advised bytes ", pages.advised_bytes);
+	const auto& memory = MemoryBudget::process();
+	lg.info("arena memory: used ", memory.used(), " bytes, peak ", memory.peak(), " bytes");
+	if (pages.huge_bytes)
+		lg.info("page cache: huge page regions ", pages.huge_bytes, " bytes, ",
+			pages.huge_misses * 100 / std::max<std::uint64_t>(pages.misses, 1),
+			"% of new pages from them");
 	lg.trace("manager finished");
 }
 
@@ -90,13 +146,22 @@ auto Manager::init() -> void
 		if (opts->servers.empty())
 			throw std::runtime_error{ "no servers configured" };
 
+		if (n_workers == 0)
+			io = opts->io;
+		else if (opts->io != io)
+			lg.warning("init: I/O settings can not be changed at runtime, ignored");
+
 		logs::init(*opts);
+		PageCache::set_limit(opts->page_cache_size);
+		MemoryBudget::process().set_limit(opts->memory.limit);
+		PageCache::set_huge_pages(page_cache_huge_pages(opts->huge_pages.mode),
+			opts->huge_pages.region_size);
 		init_modules(p_config);
 		init_servers(opts);
-		init_workers(*opts);
+		init_workers(opts);
 	} catch (std::exception& e) {
 		lg.error("init: ", e.what());
-		if (srv.empty())
+		if (srv.empty() && shards.empty())
 			throw;
 		lg.warning("init: reconfiguration failed, fallback");
 	}
@@ -115,8 +180,18 @@ auto Manager::init_servers(const std::shared_ptr<const Options>& opts) -> void
 {
 	lg.trace("init_servers");
 
+	if (io.sharded)
+		for (auto& shard : shards)
+			update_servers(shard->srv, shard->ctx, opts);
+	else
+		update_servers(srv, worker_ctx, opts);
+}
+
+auto Manager::update_servers(ServerList& servers, boost::asio::io_context& ctx,
+	const std::shared_ptr<const Options>& opts) -> void
+{
 	std::set<decltype(Options::Server::listen_port)> running_servers;
-	for (auto it = srv.begin(); it != srv.end();)
+	for (auto it = servers.begin(); it != servers.end();)
 	{
 		auto& server = *it;
 		auto server_ok = contains(opts->servers, server->get_options());
@@ -125,7 +200,7 @@ auto Manager::init_servers(const std::shared_ptr<const Options>& opts) -> void
 			++it;
 		} else {
 			server->lg.trace("server not in config");
-			it = srv.erase(it);
+			it = servers.erase(it);
 		}
 	}
 
@@ -134,35 +209,43 @@ auto Manager::init_servers(const std::shared_ptr<const Options>& opts) -> void
 		return !contains(running_servers, opt.listen_port);
 	};
 	for (auto& s : opts->servers | boost::adaptors::filtered(not_running))
-		srv.push_back(std::make_unique<tcp::Server>(worker_ctx, opts, s, module_manager));
+		servers.push_back(std::make_unique<tcp::Server>(ctx, opts, s, module_manager, io.sharded));
 }
 
-auto Manager::init_workers(const Options& opts) -> void
+auto Manager::init_workers(const std::shared_ptr<const Options>& opts) -> void
 {
 	lg.trace("init_workers");
 
 	const auto current_n_workers = n_workers;
-	const auto required_n_workers = opts.n_workers.value_or_eval(n_workers_default);
+	const auto required_n_workers = opts->n_workers.value_or_eval(n_workers_default);
 	lg.trace("current worker number: ", current_n_workers, ", required: ", required_n_workers);
 
 	BOOST_ASSERT(required_n_workers > 0);
 
 	for (auto i = current_n_workers; i < required_n_workers; ++i)
-		add_worker();
+		if (io.sharded)
+			add_shard(opts);
+		else
+			add_worker(worker_ctx);
 	for (auto i = current_n_workers; i > required_n_workers; --i)
-		remove_worker();
+		if (io.sharded)
+			remove_shard();
+		else
+			remove_worker();
 
 	n_workers = required_n_workers;
+
+	steer_shards();
 }
 
-auto Manager::add_worker() -> void
+auto Manager::add_worker(boost::asio::io_context& ctx) -> std::thread&
 {
 	lg.trace("add worker");
 
-	auto worker = std::thread{ [this] { run_worker(); } };
+	auto worker = std::thread{ [this, &ctx] { run_worker(ctx); } };
 	auto id = worker.get_id();
 	BOOST_ASSERT(workers.find(id) == workers.end());
-	workers[id] = move(worker);
+	return workers[id] = move(worker);
 }
 
 auto Manager::remove_worker() -> void
@@ -173,16 +256,58 @@ auto Manager::remove_worker() -> void
 	post(worker_ctx, [] { throw FinishWorker{}; });
 }
 
-auto Manager::run_worker() noexcept -> void
+auto Manager::add_shard(const std::shared_ptr<const Options>& opts) -> void
+{
+	const auto n = static_cast<unsigned>(shards.size());
+	lg.trace("add shard #", n);
+
+	auto& shard = *shards.emplace_back(std::make_unique<Shard>());
+#ifdef LEMON_IO_URING
+	if (io.backend == Options::Io::Backend::uring)
+		boost::asio::make_service<uring::Service>(shard.ctx, uring::Service::Params{
+			io.uring_entries, io.uring_buffers, io.uring_buffer_size });
+#endif
+	update_servers(shard.srv, shard.ctx, opts);
+	auto& worker = add_worker(shard.ctx);
+	shard.worker = worker.get_id();
+
+	if (io.cpu_steering && !pin_to_cpu(worker, n))
+		lg.warning("failed to pin shard #", n, " to CPU");
+}
+
+auto Manager::remove_shard() -> void
+{
+	BOOST_ASSERT(!shards.empty());
+	auto shard = move(shards.back());
+	shards.pop_back();
+	lg.trace("remove shard #", shards.size());
+
+	shard->srv.clear();
+	post(shard->ctx, [] { throw FinishWorker{}; });
+	stopping_shards.push_back(move(shard));
+}
+
+auto Manager::steer_shards() -> void
+{
+	if (!io.cpu_steering || shards.empty())
+		return;
+
+	// a reuseport group enumerates listeners in bind order, i.e. by shards
+	const auto n_shards = static_cast<unsigned>(shards.size());
+	for (auto& server : shards.front()->srv)
+		server->steer_by_cpu(n_shards);
+}
+
+auto Manager::run_worker(boost::asio::io_context& ctx) noexcept -> void
 {
 	GlobalLogger lg;
 	auto n = std::this_thread::get_id();
 
 	lg.debug("started worker thread #", n);
 
-	while (!worker_ctx.stopped()) {
+	while (!ctx.stopped()) {
 		try {
-			worker_ctx.run();
+			ctx.run();
 		} catch (FinishWorker&) {
 			break;
 		} catch (std::exception& e) {
@@ -207,6 +332,7 @@ auto Manager::finalize_worker(std::thread::id id) -> void
 	} else {
 		it->second.join();
 		workers.erase(it);
+		boost::remove_erase_if(stopping_shards, [id](const auto& shard) { return shard->worker == id; });
 		lg.trace("finalized worker #", id, ", ", workers.size(), " workers left");
 
 		if (worker_ctx.stopped() && workers.empty())
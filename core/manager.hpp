@@ -1,5 +1,6 @@
 #pragma once
 #include "logger_imp.hpp"
+#include "options.hpp"
 #include <boost/asio/executor_work_guard.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/signal_set.hpp>
@@ -12,7 +13,6 @@
 
 class ModuleManager;
 struct Parameters;
-class Options;
 
 namespace config
 {
@@ -35,24 +35,46 @@ public:
 	auto reinit() -> void;
 
 private:
+	using WorkGuard = boost::asio::executor_work_guard<boost::asio::io_context::executor_type>;
+	using ServerList = std::vector<std::unique_ptr<tcp::Server>>;
+
+	// io_context with its own worker and listeners in sharded mode
+	struct Shard
+	{
+		Shard();
+
+		boost::asio::io_context ctx;
+		WorkGuard work;
+		ServerList srv;
+		std::thread::id worker;
+	};
+
 	auto init() -> void;
 	auto init_modules(const config::Table* config) -> void;
 	auto init_servers(const std::shared_ptr<const Options>& opts) -> void;
-	auto init_workers(const Options& opts) -> void;
-	auto add_worker() -> void;
+	auto update_servers(ServerList& servers, boost::asio::io_context& ctx,
+		const std::shared_ptr<const Options>& opts) -> void;
+	auto init_workers(const std::shared_ptr<const Options>& opts) -> void;
+	auto add_worker(boost::asio::io_context& ctx) -> std::thread&;
 	auto remove_worker() -> void;
-	auto run_worker() noexcept -> void;
+	auto add_shard(const std::shared_ptr<const Options>& opts) -> void;
+	auto remove_shard() -> void;
+	auto steer_shards() -> void;
+	auto run_worker(boost::asio::io_context& ctx) noexcept -> void;
 	auto finalize_worker(std::thread::id id) -> void;
 
 	boost::asio::io_context master_ctx;
 	boost::asio::io_context worker_ctx;
-	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> master_work;
-	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> worker_work;
+	WorkGuard master_work;
+	WorkGuard worker_work;
 	boost::asio::signal_set quit_signals;
 	std::map<std::thread::id, std::thread> workers;
 	unsigned n_workers = 0;
+	Options::Io io;
 	GlobalLogger lg;
 	std::shared_ptr<ModuleManager> module_manager;
-	std::vector<std::unique_ptr<tcp::Server>> srv;
+	ServerList srv;
+	std::vector<std::unique_ptr<Shard>> shards;
+	std::vector<std::unique_ptr<Shard>> stopping_shards;
 	const std::filesystem::path config_path;
 };
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "memory_budget.hpp"
+#include <boost/assert.hpp>
+
+namespace
+{
+using std::size_t;
+
+// the part of the limit which makes the budget tight
+constexpr size_t tight_part_num = 3;
+constexpr size_t tight_part_den = 4;
+}
+
+auto MemoryBudget::Exceeded::what() const noexcept -> const char*
+{
+	return by_account ? "connection memory limit exceeded" : "memory limit exceeded";
+}
+
+auto MemoryBudget::process() -> MemoryBudget&
+{
+	static MemoryBudget budget;
+	return budget;
+}
+
+bool MemoryBudget::is_tight() const noexcept
+{
+	const auto l = limit.load(std::memory_order_relaxed);
+	return l && used() >= l / tight_part_den * tight_part_num;
+}
+
+void MemoryBudget::charge(size_t bytes, bool enforce)
+{
+	const auto n = n_used.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	const auto l = limit.load(std::memory_order_relaxed);
+	if (enforce && l && n > l) {
+		n_used.fetch_sub(bytes, std::memory_order_relaxed);
+		throw Exceeded{ false };
+	}
+	auto peak = n_peak.load(std::memory_order_relaxed);
+	while (n > peak && !n_peak.compare_exchange_weak(peak, n, std::memory_order_relaxed))
+	{}
+}
+
+void MemoryBudget::release(size_t bytes) noexcept
+{
+	BOOST_ASSERT(used() >= bytes);
+	n_used.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+
+MemoryBudget::Account::Account(MemoryBudget& budget, size_t limit) noexcept:
+	budget{ budget },
+	limit{ limit }
+{
+	++budget.n_accounts;
+}
+
+MemoryBudget::Account::~Account()
+{
+	BOOST_ASSERT(used() == 0);
+	--budget.n_accounts;
+}
+
+void MemoryBudget::Account::charge(size_t bytes, bool enforce)
+{
+	const auto n = n_used.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	try {
+		if (enforce && limit && n > limit)
+			throw Exceeded{ true };
+		budget.charge(bytes, enforce);
+	} catch (...) {
+		n_used.fetch_sub(bytes, std::memory_order_relaxed);
+		throw;
+	}
+}
+
+void MemoryBudget::Account::release(size_t bytes) noexcept
+{
+	BOOST_ASSERT(used() >= bytes);
+	n_used.fetch_sub(bytes, std::memory_order_relaxed);
+	budget.release(bytes);
+}
+
+bool MemoryBudget::Account::is_heavy() const noexcept
+{
+	if (!budget.is_tight())
+		return false;
+	const auto n_accounts = budget.n_accounts.load(std::memory_order_relaxed);
+	return used() * n_accounts >= budget.used();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <boost/core/noncopyable.hpp>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+// Arena memory of all the connections, limited as a whole and for each of them.
+// Thread-safe.
+class MemoryBudget: boost::noncopyable
+{
+public:
+	class Account;
+
+	struct Exceeded: std::bad_alloc
+	{
+		explicit Exceeded(bool by_account) noexcept: by_account{ by_account } {}
+		auto what() const noexcept -> const char* override;
+
+		// the limit of the account, not the whole budget
+		const bool by_account;
+	};
+
+	// the budget of the process
+	static auto process() -> MemoryBudget&;
+
+	// zero means no limit
+	void set_limit(std::size_t bytes) noexcept { limit = bytes; }
+
+	std::size_t used() const noexcept { return n_used.load(std::memory_order_relaxed); }
+	std::size_t peak() const noexcept { return n_peak.load(std::memory_order_relaxed); }
+	// most of the limit is used
+	bool is_tight() const noexcept;
+
+private:
+	void charge(std::size_t bytes, bool enforce);
+	void release(std::size_t bytes) noexcept;
+
+	std::atomic<std::size_t> limit{ 0 };
+	std::atomic<std::size_t> n_used{ 0 };
+	std::atomic<std::size_t> n_peak{ 0 };
+	std::atomic<std::size_t> n_accounts{ 0 };
+};
+
+// Memory of a connection
+class MemoryBudget::Account: boost::noncopyable
+{
+public:
+	// zero means no limit
+	Account(MemoryBudget& budget, std::size_t limit) noexcept;
+	~Account();
+
+	// throws Exceeded if enforced and a limit is exceeded
+	void charge(std::size_t bytes, bool enforce = true);
+	void release(std::size_t bytes) noexcept;
+
+	std::size_t used() const noexcept { return n_used.load(std::memory_order_relaxed); }
+	// zero means no limit
+	std::size_t get_limit() const noexcept { return limit; }
+	// holds at least its share while the budget is tight
+	bool is_heavy() const noexcept;
+
+private:
+	MemoryBudget& budget;
+	const std::size_t limit;
+	std::atomic<std::size_t> n_used{ 0 };
+};
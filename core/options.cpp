@@ -1,5 +1,7 @@
 #include "options.hpp"
 #include "config.hpp"
+#include <algorithm>
+#include <sstream>
 #include <tuple>
 #include <unordered_map>
 
@@ -22,16 +24,37 @@ static bool operator==(const Options::Route::Regex& lhs, const Options::Route::R
 
 static bool operator==(const Options::Route& lhs, const Options::Route& rhs)
 {
-	auto tie = [](const auto& r) { return std::tie(r.matcher, r.handler); };
+	auto tie = [](const auto& r) { return std::tie(r.matcher, r.handler, r.method); };
+	return tie(lhs) == tie(rhs);
+}
+
+static bool operator==(const Options::VirtualHost& lhs, const Options::VirtualHost& rhs)
+{
+	auto tie = [](const auto& h) { return std::tie(h.names, h.routes); };
 	return tie(lhs) == tie(rhs);
 }
 
 bool operator==(const Options::Server& lhs, const Options::Server& rhs)
 {
-	auto tie = [](const auto& s) { return std::tie(s.listen_port, s.routes); };
+	auto tie = [](const auto& s) { return std::tie(s.listen_port, s.hosts); };
+	return tie(lhs) == tie(rhs);
+}
+
+bool operator==(const Options::Io& lhs, const Options::Io& rhs)
+{
+	auto tie = [](const auto& io)
+	{
+		return std::tie(io.sharded, io.cpu_steering, io.backend,
+			io.uring_entries, io.uring_buffers, io.uring_buffer_size);
+	};
 	return tie(lhs) == tie(rhs);
 }
 
+bool operator!=(const Options::Io& lhs, const Options::Io& rhs)
+{
+	return !(lhs == rhs);
+}
+
 namespace
 {
 decltype(Options::Route::matcher) parse_matcher(const string& s)
@@ -59,6 +82,31 @@ decltype(Options::LogTypes::AccessLog::dest) parse_access_dest(const string& s)
 	return Options::LogTypes::File{ s };
 }
 
+Options::HugePages::Mode parse_huge_pages_mode(const string& s)
+{
+	if (s == "off")
+		return Options::HugePages::Mode::off;
+	if (s == "transparent")
+		return Options::HugePages::Mode::transparent;
+	if (s == "hugetlb")
+		return Options::HugePages::Mode::hugetlb;
+	throw Options::Error{ "unknown huge pages mode: " + s };
+}
+
+Options::Io::Backend parse_io_backend(const string& s)
+{
+	if (s == "asio")
+		return Options::Io::Backend::asio;
+	if (s == "uring") {
+#ifdef LEMON_IO_URING
+		return Options::Io::Backend::uring;
+#else
+		throw Options::Error{ "io_uring backend is not built in" };
+#endif
+	}
+	throw Options::Error{ "unknown I/O backend: " + s };
+}
+
 Options::LogTypes::Severity parse_severity(const string& s)
 {
 	using severity = Options::LogTypes::Severity;
@@ -80,9 +128,10 @@ Options::LogTypes::Severity parse_severity(const string& s)
 Options::Options():
 	servers{
 		{8080, 
-			{
-			{Route::Prefix{"/"}, "Testing"},
-		},
+			{ { {},
+				{
+				{Route::Prefix{"/"}, "Testing"},
+			} } },
 		},
 	}
 {
@@ -100,6 +149,65 @@ Options::Options(const config::Table& config)
 	if (auto& headers_size_it = config["headers_size"]; headers_size_it)
 		headers_size = headers_size_it.as<Integer>();
 
+	if (auto& pipeline_depth_it = config["pipeline_depth"]; pipeline_depth_it)
+		pipeline_depth = pipeline_depth_it.as<Integer>();
+	if (pipeline_depth == 0)
+		throw Error{ "pipeline_depth should be positive" };
+
+	if (auto& arena_cache_size_it = config["arena_cache_size"]; arena_cache_size_it)
+		arena_cache_size = arena_cache_size_it.as<Integer>();
+
+	if (auto& page_cache_size_it = config["page_cache_size"]; page_cache_size_it)
+		page_cache_size = page_cache_size_it.as<Integer>();
+
+	if (auto& memory_limit_it = config["memory.limit"]; memory_limit_it)
+		memory.limit = memory_limit_it.as<Integer>();
+
+	if (auto& memory_connection_limit_it = config["memory.connection_limit"]; memory_connection_limit_it)
+		memory.connection_limit = memory_connection_limit_it.as<Integer>();
+
+	if (auto& huge_pages_mode_it = config["huge_pages.mode"]; huge_pages_mode_it)
+		huge_pages.mode = parse_huge_pages_mode(huge_pages_mode_it.as<string>());
+
+	if (auto& huge_pages_region_size_it = config["huge_pages.region_size"]; huge_pages_region_size_it)
+		huge_pages.region_size = huge_pages_region_size_it.as<Integer>();
+
+	if (auto& timeout_header_it = config["timeout.header"]; timeout_header_it)
+		timeout.header = std::chrono::seconds{ timeout_header_it.as<Integer>() };
+
+	if (auto& timeout_body_it = config["timeout.body"]; timeout_body_it)
+		timeout.body = std::chrono::seconds{ timeout_body_it.as<Integer>() };
+
+	if (auto& timeout_keep_alive_it = config["timeout.keep_alive"]; timeout_keep_alive_it)
+		timeout.keep_alive = std::chrono::seconds{ timeout_keep_alive_it.as<Integer>() };
+
+	if (auto& timeout_send_it = config["timeout.send"]; timeout_send_it)
+		timeout.send = std::chrono::seconds{ timeout_send_it.as<Integer>() };
+
+	if (auto& timeout_min_rate_it = config["timeout.min_rate"]; timeout_min_rate_it)
+		timeout.min_rate = timeout_min_rate_it.as<Integer>();
+
+	if (auto& io_sharded_it = config["io.sharded"]; io_sharded_it)
+		io.sharded = io_sharded_it.as<Boolean>();
+
+	if (auto& io_cpu_steering_it = config["io.cpu_steering"]; io_cpu_steering_it)
+		io.cpu_steering = io_cpu_steering_it.as<Boolean>();
+
+	if (auto& io_backend_it = config["io.backend"]; io_backend_it)
+		io.backend = parse_io_backend(io_backend_it.as<string>());
+
+	if (auto& io_uring_entries_it = config["io.uring.entries"]; io_uring_entries_it)
+		io.uring_entries = io_uring_entries_it.as<Integer>();
+
+	if (auto& io_uring_buffers_it = config["io.uring.buffers"]; io_uring_buffers_it)
+		io.uring_buffers = io_uring_buffers_it.as<Integer>();
+
+	if (auto& io_uring_buffer_size_it = config["io.uring.buffer_size"]; io_uring_buffer_size_it)
+		io.uring_buffer_size = io_uring_buffer_size_it.as<Integer>();
+
+	if (io.backend == Io::Backend::uring && !io.sharded)
+		throw Error{ "io_uring backend requires io.sharded" };
+
 	if (auto& log_messages_it = config["log.messages"]; log_messages_it)
 		log.messages.dest = parse_msg_dest(log_messages_it.as<string>());
 
@@ -111,11 +219,31 @@ Options::Options(const config::Table& config)
 
 	for (auto& srv_val : config.get_all("server")) {
 		auto& srv = srv_val->as<Table>();
-		auto& s = servers.emplace_back();
-		s.listen_port = static_cast<std::uint16_t>(srv["listen"].as<Integer>());
+		// the servers of a port are its virtual hosts
+		const auto port = static_cast<std::uint16_t>(srv["listen"].as<Integer>());
+		auto s = std::find_if(servers.begin(), servers.end(),
+			[port](const Server& other) { return other.listen_port == port; });
+		if (s == servers.end()) {
+			s = servers.emplace(servers.end());
+			s->listen_port = port;
+		}
+		auto& host = s->hosts.emplace_back();
+		if (auto& names_it = srv["server_name"]; names_it) {
+			std::istringstream names{ names_it.as<string>() };
+			for (string name; names >> name;)
+				host.names.push_back(move(name));
+		}
+		if (host.names.empty() && s->hosts.size() > 1)
+			throw Error{ "server_name required for more servers on port " + std::to_string(port) };
 		auto& routes = srv["route"].as<Table>();
-		for (auto& route : routes)
-			s.routes.push_back({ parse_matcher(route.key()), route.as<string>() });
+		for (auto& route : routes) {
+			// 'METHOD pattern' routes only requests with the method
+			const auto& key = route.key();
+			const auto space = key.find(' ');
+			const auto pattern = space == string::npos ? key : key.substr(space + 1);
+			const auto method = space == string::npos ? string{} : key.substr(0, space);
+			host.routes.push_back({ parse_matcher(pattern), route.as<string>(), method });
+		}
 	}
 
 	//TODO check unknown keys
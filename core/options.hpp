@@ -1,6 +1,7 @@
 #pragma once
 #include <boost/core/noncopyable.hpp>
 #include <boost/optional/optional.hpp>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <list>
@@ -61,14 +62,69 @@ public:
 
 		std::variant<Equal, Prefix, Regex> matcher;
 		std::string handler;
+		// any method if empty
+		std::string method = {};
 	};
 
 	using RouteList = std::list<Route>;
 
+	struct Io
+	{
+		enum class Backend {
+			asio,
+			uring,
+		};
+
+		// one io_context and SO_REUSEPORT acceptors per worker
+		bool sharded = false;
+		// steer connections to the shard running on their RX CPU
+		bool cpu_steering = false;
+		// io_uring requires sharded mode: a ring is owned by one thread
+		Backend backend = Backend::asio;
+		unsigned uring_entries = 256;
+		unsigned uring_buffers = 1024;
+		std::size_t uring_buffer_size = 4 * 1024;
+	};
+
+	struct Timeouts
+	{
+		// zero means no timeout
+		std::chrono::seconds header{ 20 };
+		std::chrono::seconds body{ 60 };
+		std::chrono::seconds keep_alive{ 75 };
+		std::chrono::seconds send{ 60 };
+		// every received byte adds 1/min_rate second to header and body timeouts
+		std::size_t min_rate = 500;
+	};
+
+	struct HugePages
+	{
+		enum class Mode { off, transparent, hugetlb };
+
+		Mode mode = Mode::off;
+		// memory a thread maps at once for arena pages
+		std::size_t region_size = 2 * 1024 * 1024;
+	};
+
+	// arena memory; zero means no limit
+	struct Memory
+	{
+		std::size_t limit = 0;
+		std::size_t connection_limit = 0;
+	};
+
+	struct VirtualHost
+	{
+		// exact, or "*.name" for the subdomains of the name
+		std::vector<std::string> names;
+		RouteList routes;
+	};
+
 	struct Server
 	{
 		std::uint16_t listen_port = 80;
-		RouteList routes;
+		// chosen by the Host header; the first one for any other host
+		std::vector<VirtualHost> hosts;
 	};
 
 	Options();
@@ -79,6 +135,16 @@ public:
 
 	boost::optional<unsigned> n_workers = 1;
 	std::size_t headers_size = 4 * 1024;
+	// maximum number of requests of a connection being processed at once
+	std::size_t pipeline_depth = 64;
+	// memory of finished requests a connection keeps for the next ones
+	std::size_t arena_cache_size = 16 * 1024;
+	// free arena pages a thread keeps for any connection
+	std::size_t page_cache_size = 1024 * 1024;
+	HugePages huge_pages;
+	Memory memory;
+	Io io;
+	Timeouts timeout;
 	LogTypes::Logs log = {
 		{ LogTypes::Console{}, LogTypes::Severity::debug },
 		{ LogTypes::Console{} }
@@ -86,4 +152,6 @@ public:
 	std::vector<Server> servers;
 };
 
-bool operator==(const Options::Server& lhs, const Options::Server& rhs);
\ No newline at end of file
+bool operator==(const Options::Server& lhs, const Options::Server& rhs);
+bool operator==(const Options::Io& lhs, const Options::Io& rhs);
+bool operator!=(const Options::Io& lhs, const Options::Io& rhs);
\ No newline at end of file
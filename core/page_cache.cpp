@@ -0,0 +1,409 @@
+#include "page_cache.hpp"
+#include <boost/align/align_up.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/assert.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+using std::size_t;
+
+constexpr auto trim_period = std::chrono::seconds{ 1 };
+// new pages are mapped by this many at once
+constexpr size_t chunk_pages = 64;
+// part of the limit kept by an idle thread
+constexpr size_t idle_part = 4;
+
+std::atomic<size_t> limit_pages{ 256 };
+std::atomic<std::uint64_t> n_hits{ 0 };
+std::atomic<std::uint64_t> n_misses{ 0 };
+std::atomic<size_t> n_retained{ 0 };
+std::atomic<size_t> n_advised{ 0 };
+std::atomic<size_t> n_huge_bytes{ 0 };
+std::atomic<std::uint64_t> n_huge_misses{ 0 };
+
+std::atomic<PageCache::HugePages> huge_mode{ PageCache::HugePages::off };
+std::atomic<size_t> huge_region_size{ PageCache::huge_page_size };
+
+// huge page regions of all the threads, sorted, and their pages not in use
+struct Region
+{
+	std::byte* begin;
+	std::byte* end;
+};
+struct SparePage
+{
+	SparePage* next;
+};
+std::mutex regions_mutex;
+std::vector<Region> regions;
+SparePage* spare_pages = nullptr;
+std::atomic<bool> have_spare_pages{ false };
+
+// pages of the chunks not kept by any thread, with memory given back
+std::mutex advised_mutex;
+std::vector<void*> advised_pages;
+std::atomic<bool> have_advised_pages{ false };
+
+std::mutex caches_mutex;
+std::vector<PageCache*> caches;
+// time of the last trim by any trimmer, since the clock epoch
+std::atomic<std::chrono::steady_clock::rep> last_trim{ 0 };
+
+auto can_advise() noexcept -> bool
+{
+#ifdef MADV_DONTNEED
+	static const bool same_page_size = sysconf(_SC_PAGESIZE) == static_cast<long>(PageCache::page_size);
+	return same_page_size;
+#else
+	return false;
+#endif
+}
+
+auto map_region(PageCache::HugePages mode, size_t size) noexcept -> std::byte*
+{
+	constexpr auto prot = PROT_READ | PROT_WRITE;
+	constexpr auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+	if (mode == PageCache::HugePages::hugetlb) {
+		if (auto p = mmap(nullptr, size, prot, flags | MAP_HUGETLB, -1, 0); p != MAP_FAILED)
+			return static_cast<std::byte*>(p);
+	}
+#endif
+
+	// aligned to a huge page, so that the whole region may be backed by them
+	auto p = mmap(nullptr, size + PageCache::huge_page_size, prot, flags, -1, 0);
+	if (p == MAP_FAILED)
+		return nullptr;
+	const auto mapped = static_cast<std::byte*>(p);
+	const auto begin = static_cast<std::byte*>(
+		boost::alignment::align_up(p, PageCache::huge_page_size));
+	const auto end = begin + size;
+	if (begin != mapped)
+		munmap(mapped, begin - mapped);
+	if (auto tail = mapped + size + PageCache::huge_page_size - end; tail)
+		munmap(end, tail);
+#ifdef MADV_HUGEPAGE
+	madvise(begin, size, MADV_HUGEPAGE);
+#endif
+	return begin;
+}
+
+// with regions_mutex locked
+auto in_region(const void* p) noexcept -> bool
+{
+	const auto b = static_cast<const std::byte*>(p);
+	auto it = std::upper_bound(regions.begin(), regions.end(), b,
+		[](const std::byte* b, const Region& r) { return b < r.begin; });
+	return it != regions.begin() && b < std::prev(it)->end;
+}
+
+auto is_huge(const void* p) noexcept -> bool
+{
+	if (n_huge_bytes.load(std::memory_order_relaxed) == 0)
+		return false;
+	std::lock_guard lock{ regions_mutex };
+	return in_region(p);
+}
+
+// pages of the regions are kept for any thread, and so are the address
+// ranges of the other ones
+void free_page(void* p, bool advised = false) noexcept
+{
+	if (n_huge_bytes.load(std::memory_order_relaxed)) {
+		std::lock_guard lock{ regions_mutex };
+		if (in_region(p)) {
+			spare_pages = new (p) SparePage{ spare_pages };
+			have_spare_pages = true;
+			return;
+		}
+	}
+
+#ifdef MADV_DONTNEED
+	if (!advised && can_advise())
+		madvise(p, PageCache::page_size, MADV_DONTNEED);
+#endif
+	try {
+		std::lock_guard lock{ advised_mutex };
+		advised_pages.push_back(p);
+		have_advised_pages = true;
+	} catch (...) {
+		if (can_advise())
+			munmap(p, PageCache::page_size);
+	}
+}
+}
+
+auto PageCache::local() -> PageCache&
+{
+	thread_local PageCache cache;
+	return cache;
+}
+
+void PageCache::set_limit(size_t bytes) noexcept
+{
+	limit_pages = bytes / page_size;
+}
+
+void PageCache::set_huge_pages(HugePages mode, size_t region_size) noexcept
+{
+	huge_mode = mode;
+	huge_region_size = boost::alignment::align_up(std::max(region_size, huge_page_size), huge_page_size);
+}
+
+auto PageCache::stats() noexcept -> Stats
+{
+	return { n_hits.load(), n_misses.load(),
+		n_retained.load() * page_size, n_advised.load() * page_size,
+		n_huge_bytes.load(), n_huge_misses.load() };
+}
+
+void PageCache::trim_all_if_idle() noexcept
+{
+	std::lock_guard lock{ caches_mutex };
+	for (auto cache : caches) {
+		std::unique_lock cache_lock{ cache->mutex, std::try_to_lock };
+		if (cache_lock)
+			cache->check_idle();
+	}
+}
+
+PageCache::PageCache()
+{
+	std::lock_guard lock{ caches_mutex };
+	caches.push_back(this);
+}
+
+PageCache::~PageCache()
+{
+	{
+		std::lock_guard lock{ caches_mutex };
+		caches.erase(std::find(caches.begin(), caches.end(), this));
+	}
+	release();
+	// the rest of the region and of the chunk is left for other threads
+	for (; region_next != region_end; region_next += page_size)
+		free_page(region_next);
+	for (; chunk_next != chunk_end; chunk_next += page_size)
+		free_page(chunk_next, true);
+}
+
+void* PageCache::take()
+{
+	std::lock_guard lock{ mutex };
+	++n_ops;
+	if (!warm.empty()) {
+		auto& page = warm.front();
+		warm.pop_front();
+		page.~Page();
+		++n_hits;
+		--n_retained;
+		return &page;
+	}
+	if (!cold.empty()) {
+		auto p = cold.back();
+		cold.pop_back();
+		++n_hits;
+		--n_retained;
+		if (can_advise())
+			--n_advised;
+		return p;
+	}
+
+	++n_misses;
+	if (auto p = take_huge()) {
+		++n_huge_misses;
+		return p;
+	}
+	return take_new();
+}
+
+void PageCache::give(void* p) noexcept
+{
+	BOOST_ASSERT(reinterpret_cast<std::uintptr_t>(p) % page_size == 0);
+	std::lock_guard lock{ mutex };
+	++n_ops;
+	if (warm.size() + cold.size() >= limit_pages.load(std::memory_order_relaxed)) {
+		free_page(p);
+		return;
+	}
+	warm.push_front(*new (p) Page);
+	++n_retained;
+}
+
+void PageCache::trim_if_idle() noexcept
+{
+	std::lock_guard lock{ mutex };
+	check_idle();
+}
+
+void PageCache::trim() noexcept
+{
+	std::lock_guard lock{ mutex };
+	trim_pages();
+}
+
+void PageCache::check_idle() noexcept
+{
+	if (n_ops == n_ops_seen)
+		trim_pages();
+	n_ops_seen = n_ops;
+}
+
+void PageCache::trim_pages() noexcept
+{
+	try {
+		cold.reserve(cold.size() + warm.size());
+	} catch (...) {
+		release();
+		return;
+	}
+
+	// the memory is reclaimed by the system, the address range stays ours
+	while (!warm.empty()) {
+		auto& page = warm.front();
+		warm.pop_front();
+		page.~Page();
+		// advising a part of a huge page would split it
+		if (is_huge(&page)) {
+			--n_retained;
+			free_page(&page);
+			continue;
+		}
+#ifdef MADV_DONTNEED
+		if (can_advise()) {
+			madvise(&page, page_size, MADV_DONTNEED);
+			++n_advised;
+		}
+#endif
+		cold.push_back(&page);
+	}
+	free_cold(limit_pages.load(std::memory_order_relaxed) / idle_part);
+}
+
+void PageCache::release() noexcept
+{
+	free_cold(0);
+	while (!warm.empty()) {
+		auto& page = warm.front();
+		warm.pop_front();
+		page.~Page();
+		--n_retained;
+		free_page(&page);
+	}
+}
+
+void PageCache::free_cold(size_t keep) noexcept
+{
+	while (cold.size() > keep) {
+		--n_retained;
+		if (can_advise())
+			--n_advised;
+		free_page(cold.back(), can_advise());
+		cold.pop_back();
+	}
+}
+
+void* PageCache::take_huge()
+{
+	if (have_spare_pages.load(std::memory_order_relaxed)) {
+		std::lock_guard lock{ regions_mutex };
+		if (auto page = spare_pages) {
+			spare_pages = page->next;
+			have_spare_pages = spare_pages != nullptr;
+			return page;
+		}
+	}
+
+	const auto mode = huge_mode.load(std::memory_order_relaxed);
+	if (mode == HugePages::off)
+		return nullptr;
+
+	if (region_next == region_end) {
+		const auto size = huge_region_size.load(std::memory_order_relaxed);
+		auto p = map_region(mode, size);
+		if (!p)
+			return nullptr;
+		try {
+			std::lock_guard lock{ regions_mutex };
+			auto it = std::upper_bound(regions.begin(), regions.end(), p,
+				[](const std::byte* p, const Region& r) { return p < r.begin; });
+			regions.insert(it, { p, p + size });
+		} catch (...) {
+			munmap(p, size);
+			throw;
+		}
+		n_huge_bytes += size;
+		region_next = p;
+		region_end = p + size;
+	}
+
+	auto page = region_next;
+	region_next += page_size;
+	return page;
+}
+
+void* PageCache::take_new()
+{
+	if (have_advised_pages.load(std::memory_order_relaxed)) {
+		std::lock_guard lock{ advised_mutex };
+		if (!advised_pages.empty()) {
+			auto page = advised_pages.back();
+			advised_pages.pop_back();
+			have_advised_pages = !advised_pages.empty();
+			return page;
+		}
+	}
+
+	// mapped by chunks of page aligned pages: an aligned malloc pads each of them
+	if (chunk_next == chunk_end) {
+		const auto size = chunk_pages * page_size;
+		auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			throw std::bad_alloc{};
+		chunk_next = static_cast<std::byte*>(p);
+		chunk_end = chunk_next + size;
+	}
+
+	auto page = chunk_next;
+	chunk_next += page_size;
+	return page;
+}
+
+boost::asio::execution_context::id PageCacheTrimmer::id;
+
+PageCacheTrimmer::PageCacheTrimmer(boost::asio::execution_context& ctx):
+	boost::asio::execution_context::service{ ctx },
+	timer{ static_cast<boost::asio::io_context&>(ctx) }
+{
+	start();
+}
+
+void PageCacheTrimmer::shutdown()
+{
+	timer.cancel();
+}
+
+void PageCacheTrimmer::start()
+{
+	timer.expires_after(trim_period);
+	timer.async_wait([this](const boost::system::error_code& ec)
+	{
+		if (ec)
+			return;
+		// other io_contexts are likely to have trimmed them just now
+		constexpr auto min_interval = std::chrono::steady_clock::duration{ trim_period } / 2;
+		const auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+		auto last = last_trim.load();
+		if (now - last >= min_interval.count() && last_trim.compare_exchange_strong(last, now))
+			PageCache::trim_all_if_idle();
+		start();
+	});
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <boost/asio/execution_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/intrusive/slist.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Free memory pages of a thread, kept for the arena blocks of a page size.
+// Up to the limit of pages is kept. When the thread is idle, the kept pages
+// are given back to the system with madvise, and most of them are freed.
+// New pages are carved from chunks, or from regions of huge pages, mapped by
+// every thread for itself. Neither is ever unmapped: their pages not needed
+// by a thread are shared by all of them, those of the chunks with memory
+// given back to the system.
+// The caches of all the threads are registered, so that they are trimmed
+// by any thread; the cache of a busy thread is skipped.
+class PageCache: boost::noncopyable
+{
+public:
+	static constexpr std::size_t page_size = 4 * 1024;
+	static constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+	enum class HugePages { off, transparent, hugetlb };
+
+	// counters of all the threads
+	struct Stats
+	{
+		std::uint64_t hits;
+		std::uint64_t misses;
+		std::size_t retained_bytes;
+		std::size_t advised_bytes;
+		// memory mapped for huge page regions, and the misses it served
+		std::size_t huge_bytes;
+		std::uint64_t huge_misses;
+	};
+
+	// the cache of the calling thread
+	static auto local() -> PageCache&;
+
+	// pages kept by every thread
+	static void set_limit(std::size_t bytes) noexcept;
+	// hugetlb falls back to transparent huge pages when the system has none
+	static void set_huge_pages(HugePages mode, std::size_t region_size) noexcept;
+	static auto stats() noexcept -> Stats;
+
+	// trims the caches of all the threads which are idle
+	static void trim_all_if_idle() noexcept;
+
+	PageCache();
+	~PageCache();
+
+	// page aligned memory of page_size bytes
+	void* take();
+	void give(void* p) noexcept;
+
+	// releases the pages if nothing happened since the last call
+	void trim_if_idle() noexcept;
+	void trim() noexcept;
+
+private:
+	struct Page: boost::intrusive::slist_base_hook<>
+	{};
+	using PageList = boost::intrusive::slist<Page, boost::intrusive::constant_time_size<true>>;
+
+	void check_idle() noexcept;
+	void trim_pages() noexcept;
+	void release() noexcept;
+	void free_cold(std::size_t keep) noexcept;
+	void* take_huge();
+	void* take_new();
+
+	// the rest of the region and of the chunk of the thread
+	std::byte* region_next = nullptr;
+	std::byte* region_end = nullptr;
+	std::byte* chunk_next = nullptr;
+	std::byte* chunk_end = nullptr;
+
+	// pages touched recently, and pages with memory given back; the latter
+	// are not written to, so that they are not faulted in again
+	PageList warm;
+	std::vector<void*> cold;
+	std::uint64_t n_ops = 0;
+	std::uint64_t n_ops_seen = 0;
+	// held by the thread, and by a trimming one
+	std::mutex mutex;
+};
+
+// Trims the page caches of all the threads once a while. Every io_context
+// has one, and the trims of all of them are done once a period.
+class PageCacheTrimmer: public boost::asio::execution_context::service
+{
+public:
+	using key_type = PageCacheTrimmer;
+	static boost::asio::execution_context::id id;
+
+	explicit PageCacheTrimmer(boost::asio::execution_context& ctx);
+
+private:
+	void shutdown() override;
+	void start();
+
+	boost::asio::steady_timer timer;
+};
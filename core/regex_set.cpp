@@ -0,0 +1,448 @@
+#include "regex_set.hpp"
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <optional>
+#include <utility>
+
+namespace
+{
+using Index = RegexSet::Index;
+using CharSet = std::bitset<256>;
+
+constexpr auto none = std::numeric_limits<Index>::max();
+// larger repetitions are left to std::regex
+constexpr int max_repeat = 1000;
+constexpr std::size_t max_nfa_states = 100'000;
+
+struct Node
+{
+	enum class Kind { chars, concat, alt, repeat };
+
+	Kind kind;
+	CharSet chars;
+	std::vector<Node> items;
+	// of the only item; max is negative if not limited
+	int min = 0;
+	int max = 0;
+};
+
+struct NotUnderstood {};
+
+auto make_chars(CharSet chars) -> Node
+{
+	return { Node::Kind::chars, chars, {} };
+}
+
+auto range(unsigned char first, unsigned char last) noexcept -> CharSet
+{
+	CharSet cs;
+	for (unsigned c = first; c <= last; ++c)
+		cs.set(c);
+	return cs;
+}
+
+auto one(unsigned char c) noexcept -> CharSet
+{
+	CharSet cs;
+	cs.set(c);
+	return cs;
+}
+
+const CharSet digits = range('0', '9');
+const CharSet word = range('0', '9') | range('A', 'Z') | range('a', 'z') | one('_');
+const CharSet spaces = range('\t', '\r') | one(' ');
+
+auto hex_value(char c) -> unsigned
+{
+	if (c >= '0' && c <= '9')
+		return static_cast<unsigned>(c - '0');
+	if (c >= 'a' && c <= 'f')
+		return static_cast<unsigned>(c - 'a' + 10);
+	if (c >= 'A' && c <= 'F')
+		return static_cast<unsigned>(c - 'A' + 10);
+	throw NotUnderstood{};
+}
+
+// Recursive descent over the pattern into a syntax tree
+class Parser
+{
+public:
+	explicit Parser(string_view s) noexcept: s{ s } {}
+
+	auto parse() -> std::optional<Node>
+	{
+		try {
+			if (!s.empty() && s.front() == '^')
+				s.remove_prefix(1);
+			if (!s.empty() && s.back() == '$' && !is_escaped(s.size() - 1))
+				s.remove_suffix(1);
+			auto n = alternation();
+			if (pos != s.size())
+				return std::nullopt;
+			return n;
+		} catch (NotUnderstood&) {
+			return std::nullopt;
+		}
+	}
+
+private:
+	auto is_escaped(std::size_t i) const noexcept -> bool
+	{
+		std::size_t n = 0;
+		while (i > n && s[i - n - 1] == '\\')
+			++n;
+		return n % 2 != 0;
+	}
+
+	auto at_end() const noexcept { return pos == s.size(); }
+	auto peek() const noexcept { return s[pos]; }
+	auto next() -> char
+	{
+		if (at_end())
+			throw NotUnderstood{};
+		return s[pos++];
+	}
+	auto accept(char c) noexcept -> bool
+	{
+		if (at_end() || peek() != c)
+			return false;
+		++pos;
+		return true;
+	}
+
+	auto alternation() -> Node
+	{
+		Node n{ Node::Kind::alt, {}, {} };
+		n.items.push_back(concatenation());
+		while (accept('|'))
+			n.items.push_back(concatenation());
+		return n.items.size() == 1 ? std::move(n.items.front()) : n;
+	}
+
+	auto concatenation() -> Node
+	{
+		Node n{ Node::Kind::concat, {}, {} };
+		while (!at_end() && peek() != '|' && peek() != ')')
+			n.items.push_back(quantified(atom()));
+		return n;
+	}
+
+	auto quantified(Node item) -> Node
+	{
+		while (!at_end()) {
+			int min = 0, max = -1;
+			if (accept('*')) {
+			} else if (accept('+')) {
+				min = 1;
+			} else if (accept('?')) {
+				max = 1;
+			} else if (accept('{')) {
+				min = max = number();
+				if (accept(',')) {
+					max = !at_end() && peek() == '}' ? -1 : number();
+					if (max >= 0 && max < min)
+						throw NotUnderstood{};
+				}
+				if (!accept('}'))
+					throw NotUnderstood{};
+			} else {
+				break;
+			}
+			// lazy quantifiers match the same whole strings
+			accept('?');
+			Node r{ Node::Kind::repeat, {}, {}, min, max };
+			r.items.push_back(std::move(item));
+			item = std::move(r);
+		}
+		return item;
+	}
+
+	auto number() -> int
+	{
+		int n = 0;
+		if (at_end() || peek() < '0' || peek() > '9')
+			throw NotUnderstood{};
+		while (!at_end() && peek() >= '0' && peek() <= '9') {
+			n = n * 10 + (next() - '0');
+			if (n > max_repeat)
+				throw NotUnderstood{};
+		}
+		return n;
+	}
+
+	auto atom() -> Node
+	{
+		switch (const auto c = next()) {
+		case '(':
+			if (accept('?') && !(accept(':')))
+				throw NotUnderstood{};
+			{
+				auto n = alternation();
+				if (!accept(')'))
+					throw NotUnderstood{};
+				return n;
+			}
+		case '[':
+			return make_chars(char_class());
+		case '.':
+			return make_chars(~(one('\n') | one('\r')));
+		case '\\':
+			return make_chars(escape(false));
+		case '^': case '$': case '*': case '+': case '?': case '{': case '}': case ']': case ')':
+			throw NotUnderstood{};
+		default:
+			return make_chars(one(static_cast<unsigned char>(c)));
+		}
+	}
+
+	auto escape(bool in_class) -> CharSet
+	{
+		switch (const auto c = next()) {
+		case 'd': return digits;
+		case 'D': return ~digits;
+		case 'w': return word;
+		case 'W': return ~word;
+		case 's': return spaces;
+		case 'S': return ~spaces;
+		case 't': return one('\t');
+		case 'n': return one('\n');
+		case 'r': return one('\r');
+		case 'f': return one('\f');
+		case 'v': return one('\v');
+		case '0': return one('\0');
+		case 'b':
+			if (in_class)
+				return one('\b');
+			throw NotUnderstood{};
+		case 'x': {
+			const auto high = hex_value(next());
+			return one(static_cast<unsigned char>(high * 16 + hex_value(next())));
+		}
+		default:
+			// backreferences, word boundaries, unicode and control escapes
+			if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+				throw NotUnderstood{};
+			return one(static_cast<unsigned char>(c));
+		}
+	}
+
+	auto char_class() -> CharSet
+	{
+		const bool negated = accept('^');
+		CharSet cs;
+		while (!accept(']')) {
+			auto first = class_atom();
+			if (!at_end() && peek() == '-' && pos + 1 < s.size() && s[pos + 1] != ']') {
+				++pos;
+				const auto last = class_atom();
+				if (first.count() != 1 || last.count() != 1)
+					throw NotUnderstood{};
+				const auto from = first_of(first), to = first_of(last);
+				if (from > to)
+					throw NotUnderstood{};
+				first = range(static_cast<unsigned char>(from), static_cast<unsigned char>(to));
+			}
+			cs |= first;
+		}
+		return negated ? ~cs : cs;
+	}
+
+	auto class_atom() -> CharSet
+	{
+		const auto c = next();
+		if (c == '\\')
+			return escape(true);
+		return one(static_cast<unsigned char>(c));
+	}
+
+	static auto first_of(const CharSet& cs) noexcept -> unsigned
+	{
+		unsigned c = 0;
+		while (!cs[c])
+			++c;
+		return c;
+	}
+
+	string_view s;
+	std::size_t pos = 0;
+};
+
+// Thompson construction, appending the states of a pattern
+class NfaBuilder
+{
+public:
+	template <typename State>
+	static auto emit(std::vector<State>& nfa, const Node& n, Index from) -> Index
+	{
+		switch (n.kind) {
+		case Node::Kind::chars: {
+			auto state = from;
+			// a state has one byte transition
+			if (nfa[from].next != none) {
+				state = add(nfa);
+				nfa[from].eps.push_back(state);
+			}
+			const auto to = add(nfa);
+			nfa[state].chars = n.chars;
+			nfa[state].next = to;
+			return to;
+		}
+		case Node::Kind::concat:
+			for (auto& item : n.items)
+				from = emit(nfa, item, from);
+			return from;
+		case Node::Kind::alt: {
+			const auto to = add(nfa);
+			for (auto& item : n.items) {
+				const auto branch = add(nfa);
+				nfa[from].eps.push_back(branch);
+				nfa[emit(nfa, item, branch)].eps.push_back(to);
+			}
+			return to;
+		}
+		case Node::Kind::repeat:
+			break;
+		}
+
+		auto& item = n.items.front();
+		for (int i = 0; i < n.min; ++i)
+			from = emit(nfa, item, from);
+		if (n.max < 0) {
+			const auto loop = add(nfa);
+			nfa[from].eps.push_back(loop);
+			nfa[emit(nfa, item, loop)].eps.push_back(loop);
+			return loop;
+		}
+		const auto to = add(nfa);
+		for (int i = n.min; i < n.max; ++i) {
+			nfa[from].eps.push_back(to);
+			from = emit(nfa, item, from);
+		}
+		nfa[from].eps.push_back(to);
+		return to;
+	}
+
+private:
+	template <typename State>
+	static auto add(std::vector<State>& nfa) -> Index
+	{
+		if (nfa.size() >= max_nfa_states)
+			throw NotUnderstood{};
+		nfa.push_back({ {}, none, {}, none });
+		return static_cast<Index>(nfa.size() - 1);
+	}
+};
+}
+
+auto RegexSet::add(string_view pattern) -> bool
+{
+	const auto tree = Parser{ pattern }.parse();
+	if (!tree)
+		return false;
+
+	const auto n_states = nfa.size();
+	try {
+		nfa.push_back({ {}, none, {}, none });
+		const auto begin = static_cast<Index>(n_states);
+		const auto end = NfaBuilder::emit(nfa, *tree, begin);
+		nfa[end].accept = static_cast<Index>(n_patterns);
+		starts.push_back(begin);
+	} catch (NotUnderstood&) {
+		nfa.resize(n_states);
+		return false;
+	}
+	++n_patterns;
+	return true;
+}
+
+auto RegexSet::compile(std::size_t max_states) -> bool
+{
+	// bytes no pattern tells apart share a class
+	byte_class.fill(0);
+	n_classes = 1;
+	for (auto& st : nfa) {
+		if (st.next == none)
+			continue;
+		std::vector<int> split(2 * n_classes, -1);
+		std::size_t n = 0;
+		for (unsigned c = 0; c < 256; ++c) {
+			auto& cls = split[2 * byte_class[c] + st.chars[c]];
+			if (cls < 0)
+				cls = static_cast<int>(n++);
+			byte_class[c] = static_cast<std::uint16_t>(cls);
+		}
+		n_classes = n;
+	}
+	std::vector<unsigned char> class_byte(n_classes);
+	for (unsigned c = 256; c-- > 0;)
+		class_byte[byte_class[c]] = static_cast<unsigned char>(c);
+
+	std::vector<char> seen(nfa.size());
+	auto closure = [&](std::vector<Index> states)
+	{
+		states.erase(std::remove_if(states.begin(), states.end(), [&](Index st)
+		{
+			return std::exchange(seen[st], char{ 1 });
+		}), states.end());
+		for (std::size_t i = 0; i < states.size(); ++i)
+			for (auto st : nfa[states[i]].eps)
+				if (!seen[st]) {
+					seen[st] = true;
+					states.push_back(st);
+				}
+		for (auto st : states)
+			seen[st] = false;
+		std::sort(states.begin(), states.end());
+		return states;
+	};
+
+	std::map<std::vector<Index>, Index> ids;
+	std::vector<const std::vector<Index>*> sets;
+	transitions.clear();
+	accepts.clear();
+	auto id_of = [&](std::vector<Index> states)
+	{
+		auto [it, added] = ids.emplace(std::move(states), static_cast<Index>(sets.size()));
+		if (added) {
+			sets.push_back(&it->first);
+			auto& acc = accepts.emplace_back();
+			for (auto st : it->first)
+				if (nfa[st].accept != none)
+					acc.push_back(nfa[st].accept);
+			std::sort(acc.begin(), acc.end());
+		}
+		return it->second;
+	};
+
+	id_of({});
+	start = id_of(closure(starts));
+	for (Index id = 0; id < sets.size(); ++id) {
+		if (sets.size() > max_states) {
+			transitions.clear();
+			accepts.clear();
+			return false;
+		}
+		for (std::size_t cls = 0; cls < n_classes; ++cls) {
+			std::vector<Index> next;
+			for (auto st : *sets[id])
+				if (nfa[st].next != none && nfa[st].chars[class_byte[cls]])
+					next.push_back(nfa[st].next);
+			transitions.push_back(id_of(closure(std::move(next))));
+		}
+	}
+	return true;
+}
+
+auto RegexSet::match(string_view s) const noexcept -> const std::vector<Index>&
+{
+	BOOST_ASSERT(!accepts.empty());
+	auto state = start;
+	for (auto c : s) {
+		state = transitions[state * n_classes + byte_class[static_cast<unsigned char>(c)]];
+		if (state == 0)
+			break;
+	}
+	return accepts[state];
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "string_view.hpp"
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+// Regular expressions matched together by one deterministic automaton,
+// in time linear in the length of the string whatever the patterns are.
+// Understands the ECMAScript syntax except backreferences, lookaheads and
+// word boundaries; ^ and $ only at the ends of a pattern.
+class RegexSet
+{
+public:
+	using Index = std::uint32_t;
+
+	// false if the pattern is not understood; nothing is added then
+	auto add(string_view pattern) -> bool;
+	// false if the automaton would have more states than allowed
+	auto compile(std::size_t max_states = 10'000) -> bool;
+
+	auto size() const noexcept -> std::size_t { return n_patterns; }
+	// the patterns matching the whole string, in the order added
+	auto match(string_view s) const noexcept -> const std::vector<Index>&;
+
+private:
+	using CharSet = std::bitset<256>;
+
+	struct NfaState
+	{
+		CharSet chars;
+		// on a byte of chars
+		Index next = 0;
+		std::vector<Index> eps;
+		// the pattern accepted here, if any
+		Index accept;
+	};
+
+	std::vector<NfaState> nfa;
+	std::vector<Index> starts;
+	std::size_t n_patterns = 0;
+
+	std::array<std::uint16_t, 256> byte_class{};
+	std::size_t n_classes = 1;
+	// by state and byte class; the state 0 matches nothing
+	std::vector<Index> transitions;
+	std::vector<std::vector<Index>> accepts;
+	Index start = 0;
+};
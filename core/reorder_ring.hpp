@@ -0,0 +1,88 @@
+#pragma once
+#include "task_ident.hpp"
+#include <boost/assert.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+// Fixed-size window of items numbered from the oldest one not taken yet.
+// Items may be put from any thread, but only one thread at a time
+// may take them, and they come out in order of their identifiers.
+template <typename T>
+class ReorderRing: boost::noncopyable
+{
+public:
+	using Ident = TaskIdent;
+
+	// capacity is rounded up to a power of 2
+	ReorderRing(Ident first, std::size_t capacity):
+		mask{ round_up(capacity) - 1 },
+		slots{ std::make_unique<Slot[]>(mask + 1) },
+		head{ first }
+	{}
+
+	auto capacity() const noexcept -> std::size_t { return mask + 1; }
+	// the window and readiness are sequentially consistent, so that a producer
+	// and the consumer can hand over work through a flag raised before the check
+	auto front_id() const noexcept -> Ident { return head.load(); }
+
+	// identifiers wrap around, so the distance is unsigned
+	auto fits(Ident id) const noexcept -> bool
+	{
+		return static_cast<Ident>(id - front_id()) <= mask;
+	}
+
+	void put(Ident id, T v)
+	{
+		BOOST_ASSERT(fits(id));
+		auto& s = slots[id & mask];
+		BOOST_ASSERT(!s.ready.load(std::memory_order_relaxed));
+		s.value.emplace(std::move(v));
+		s.ready.store(true);
+	}
+
+	auto has_front() const noexcept -> bool
+	{
+		return slots[front_id() & mask].ready.load();
+	}
+
+	// consumer only: the oldest item if it is there already
+	auto front() noexcept -> T*
+	{
+		auto& s = slots[head.load(std::memory_order_relaxed) & mask];
+		return s.ready.load(std::memory_order_acquire) ? &*s.value : nullptr;
+	}
+
+	// consumer only: frees the slot of the oldest item
+	void pop() noexcept
+	{
+		const auto id = head.load(std::memory_order_relaxed);
+		auto& s = slots[id & mask];
+		BOOST_ASSERT(s.ready.load(std::memory_order_relaxed));
+		s.value.reset();
+		s.ready.store(false, std::memory_order_relaxed);
+		head.store(id + 1);
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<bool> ready{ false };
+		std::optional<T> value;
+	};
+
+	static auto round_up(std::size_t n) noexcept -> std::size_t
+	{
+		std::size_t p = 1;
+		while (p < n)
+			p <<= 1;
+		return p;
+	}
+
+	const std::size_t mask;
+	const std::unique_ptr<Slot[]> slots;
+	std::atomic<Ident> head;
+};
@@ -0,0 +1,102 @@
+#include "slab_allocator.hpp"
+#include <boost/align/align_up.hpp>
+#include <boost/align/aligned_alloc.hpp>
+#include <boost/assert.hpp>
+#include <algorithm>
+#include <new>
+
+namespace
+{
+using std::size_t;
+
+constexpr size_t slab_size = 64 * 1024;
+constexpr size_t chunk_align = alignof(std::max_align_t);
+// added to the settled count when the owner finishes
+constexpr std::int64_t orphaned = std::int64_t{ 1 } << 62;
+}
+
+struct SlabPool::Slab
+{
+	SlabPool* const owner;
+	Slab* const next;
+};
+
+SlabPool::SlabPool(size_t chunk_size) noexcept:
+	chunk_size{ boost::alignment::align_up(std::max(chunk_size, sizeof(Chunk)), chunk_align) }
+{
+	BOOST_ASSERT(this->chunk_size <= slab_size / 2);
+}
+
+SlabPool::~SlabPool()
+{
+	while (slabs) {
+		auto next = slabs->next;
+		slabs->~Slab();
+		boost::alignment::aligned_free(slabs);
+		slabs = next;
+	}
+}
+
+auto SlabPool::owner_of(void* p) noexcept -> SlabPool&
+{
+	const auto slab = reinterpret_cast<std::uintptr_t>(p) & ~(slab_size - 1);
+	return *reinterpret_cast<Slab*>(slab)->owner;
+}
+
+void* SlabPool::allocate()
+{
+	if (!free_chunks)
+		free_chunks = remote_chunks.exchange(nullptr, std::memory_order_acquire);
+	++n_live;
+	if (auto c = free_chunks) {
+		free_chunks = c->next;
+		return c;
+	}
+
+	if (fresh == fresh_end) {
+		try {
+			add_slab();
+		} catch (...) {
+			--n_live;
+			throw;
+		}
+	}
+	auto p = fresh;
+	fresh += chunk_size;
+	return p;
+}
+
+void SlabPool::free_local(void* p) noexcept
+{
+	free_chunks = new (p) Chunk{ free_chunks };
+	--n_live;
+}
+
+void SlabPool::free_remote(void* p) noexcept
+{
+	auto c = new (p) Chunk{ remote_chunks.load(std::memory_order_relaxed) };
+	while (!remote_chunks.compare_exchange_weak(c->next, c,
+		std::memory_order_release, std::memory_order_relaxed))
+	{}
+	// the last object of a finished owner takes the pool with it
+	if (n_settled.fetch_sub(1, std::memory_order_acq_rel) == orphaned + 1)
+		delete this;
+}
+
+void SlabPool::orphan() noexcept
+{
+	const auto n = n_live + orphaned;
+	if (n_settled.fetch_add(n, std::memory_order_acq_rel) + n == orphaned)
+		delete this;
+}
+
+void SlabPool::add_slab()
+{
+	auto p = boost::alignment::aligned_alloc(slab_size, slab_size);
+	if (BOOST_UNLIKELY(!p))
+		throw std::bad_alloc{};
+	slabs = new (p) Slab{ this, slabs };
+	const auto begin = static_cast<std::byte*>(p);
+	fresh = begin + boost::alignment::align_up(sizeof(Slab), chunk_align);
+	fresh_end = fresh + (begin + slab_size - fresh) / chunk_size * chunk_size;
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <boost/core/noncopyable.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Objects of one size, allocated by a thread from its own slabs.
+// An object freed by the thread goes back without synchronization, an object
+// freed by another thread is pushed to a lock-free list taken by the owner at
+// its next allocation. The pool of a finished thread is destroyed with
+// the last of its objects.
+class SlabPool: boost::noncopyable
+{
+public:
+	// the pool of the calling thread
+	template <std::size_t Size>
+	static auto local() -> SlabPool&;
+	// p is allocated by the pool of some thread for objects of Size
+	template <std::size_t Size>
+	static void free(void* p) noexcept;
+
+	void* allocate();
+
+private:
+	struct Chunk
+	{
+		Chunk* next;
+	};
+	struct Slab;
+	template <std::size_t Size> struct Local;
+
+	explicit SlabPool(std::size_t chunk_size) noexcept;
+	~SlabPool();
+
+	static auto owner_of(void* p) noexcept -> SlabPool&;
+	void free_local(void* p) noexcept;
+	void free_remote(void* p) noexcept;
+	void orphan() noexcept;
+	void add_slab();
+
+	const std::size_t chunk_size;
+	Chunk* free_chunks = nullptr;
+	std::byte* fresh = nullptr;
+	std::byte* fresh_end = nullptr;
+	Slab* slabs = nullptr;
+	// objects allocated and not freed by the owner
+	std::int64_t n_live = 0;
+	// objects freed by other threads, negated; then also the objects
+	// not freed when the owner finished
+	std::atomic<std::int64_t> n_settled{ 0 };
+	alignas(64) std::atomic<Chunk*> remote_chunks{ nullptr };
+};
+
+template <std::size_t Size>
+struct SlabPool::Local
+{
+	~Local()
+	{
+		// objects freed later by this thread are not local any more
+		if (auto p = std::exchange(pool, nullptr))
+			p->orphan();
+	}
+
+	SlabPool* pool = nullptr;
+
+	static thread_local Local instance;
+};
+
+template <std::size_t Size>
+thread_local SlabPool::Local<Size> SlabPool::Local<Size>::instance;
+
+template <std::size_t Size>
+auto SlabPool::local() -> SlabPool&
+{
+	auto& l = Local<Size>::instance;
+	if (!l.pool)
+		l.pool = new SlabPool{ Size };
+	return *l.pool;
+}
+
+template <std::size_t Size>
+void SlabPool::free(void* p) noexcept
+{
+	auto& owner = owner_of(p);
+	if (&owner == Local<Size>::instance.pool)
+		owner.free_local(p);
+	else
+		owner.free_remote(p);
+}
+
+
+// Implements std::Allocator for single objects from the slab pool of their size
+template <typename T>
+class SlabAllocator
+{
+public:
+	using value_type = T;
+
+	SlabAllocator() noexcept = default;
+	template <typename U>
+	SlabAllocator(const SlabAllocator<U>&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+		if (n != 1)
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		return static_cast<T*>(SlabPool::local<sizeof(T)>().allocate());
+	}
+	void deallocate(T* p, std::size_t n) noexcept
+	{
+		if (n != 1)
+			::operator delete(p);
+		else
+			SlabPool::free<sizeof(T)>(p);
+	}
+
+	friend bool operator==(const SlabAllocator&, const SlabAllocator&) noexcept { return true; }
+	friend bool operator!=(const SlabAllocator&, const SlabAllocator&) noexcept { return false; }
+
+private:
+	static_assert(alignof(T) <= alignof(std::max_align_t));
+};
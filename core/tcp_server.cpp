@@ -1,21 +1,61 @@
 #include "tcp_server.hpp"
-#include "http_router.hpp"
+#include "http_virtual_hosts.hpp"
+#include "page_cache.hpp"
 #include "tcp_session.hpp"
+#include <boost/asio/detail/socket_option.hpp>
+#include <boost/system/system_error.hpp>
+#include <cerrno>
+#include <iterator>
+#include <stdexcept>
+#ifdef __linux__
+# include <linux/filter.h>
+# include <sys/socket.h>
+#endif
 
 namespace tcp
 {
+namespace
+{
+using Tcp = boost::asio::ip::tcp;
+
+#ifdef SO_REUSEPORT
+using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+auto make_acceptor(boost::asio::io_context& context, std::uint16_t port, bool reuse_port)
+	-> Tcp::acceptor
+{
+	const auto endpoint = Tcp::endpoint{ Tcp::v4(), port };
+	if (!reuse_port)
+		return { context, endpoint };
+
+#ifdef SO_REUSEPORT
+	auto acceptor = Tcp::acceptor{ context };
+	acceptor.open(endpoint.protocol());
+	acceptor.set_option(Tcp::acceptor::reuse_address{ true });
+	acceptor.set_option(ReusePort{ true });
+	acceptor.bind(endpoint);
+	return acceptor;
+#else
+	throw std::runtime_error{ "SO_REUSEPORT is not supported" };
+#endif
+}
+}
+
 Server::Server(boost::asio::io_context& context, std::shared_ptr<const Options> global_opt,
-	const Options::Server& server_opt, std::shared_ptr<ModuleManager> module_manager):
+	const Options::Server& server_opt, std::shared_ptr<ModuleManager> module_manager,
+	bool reuse_port):
 	lg{server_opt.listen_port},
 	context{context},
-	acceptor{context, Tcp::endpoint{ Tcp::v4(), server_opt.listen_port }},
+	acceptor{make_acceptor(context, server_opt.listen_port, reuse_port)},
 	global_opt{move(global_opt)},
 	server_opt{server_opt},
 	module_manager{ move(module_manager) },
-	router{ std::make_shared<http::Router>(*this->module_manager, server_opt.routes) }
+	hosts{ std::make_shared<http::VirtualHosts>(*this->module_manager, server_opt) }
 {
 	lg.debug("server created");
 
+	boost::asio::use_service<PageCacheTrimmer>(context);
 	acceptor.listen();
 	start_accept();
 }
@@ -25,13 +65,49 @@ Server::~Server()
 	lg.debug("server removed");
 }
 
+void Server::steer_by_cpu(unsigned n_shards)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+	lg.debug("steering by CPU among ", n_shards, " shards");
+
+	// return cpu % n_shards
+	sock_filter code[] = {
+		{ BPF_LD  | BPF_W   | BPF_ABS, 0, 0, static_cast<__u32>(SKF_AD_OFF + SKF_AD_CPU) },
+		{ BPF_ALU | BPF_MOD | BPF_K,   0, 0, n_shards },
+		{ BPF_RET | BPF_A,             0, 0, 0 },
+	};
+	const sock_fprog prog{ static_cast<unsigned short>(std::size(code)), code };
+
+	if (setsockopt(acceptor.native_handle(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+			&prog, sizeof prog) != 0)
+		throw boost::system::system_error{
+			{ errno, boost::system::system_category() }, "SO_ATTACH_REUSEPORT_CBPF" };
+#else
+	lg.warning("CPU steering is not supported");
+#endif
+}
+
 void Server::start_accept()
 {
+#ifdef LEMON_IO_URING
+	if (global_opt->io.backend == Options::Io::Backend::uring) {
+		uring_acceptor.emplace(context, acceptor.native_handle(),
+			[this](const boost::system::error_code& ec, uring::Socket sock)
+			{
+				if (!ec)
+					Session::make(std::move(sock), global_opt, module_manager, hosts, lg);
+				else
+					lg.error("accept error: ", ec);
+			});
+		return;
+	}
+#endif
+
 	//TODO allocate handler in pool
 	acceptor.async_accept([this](const boost::system::error_code& ec, Tcp::socket sock)
 	{
 		if (!ec)
-			Session::make(context, std::move(sock), global_opt, module_manager, router, lg);
+			Session::make(std::move(sock), global_opt, module_manager, hosts, lg);
 		else if (ec == boost::asio::error::operation_aborted)
 			return;
 		else
@@ -40,4 +116,4 @@ void Server::start_accept()
 		start_accept();
 	});
 }
-}
\ No newline at end of file
+}
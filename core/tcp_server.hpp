@@ -5,12 +5,16 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/core/noncopyable.hpp>
 #include <memory>
+#ifdef LEMON_IO_URING
+# include "uring_socket.hpp"
+# include <optional>
+#endif
 
 class ModuleManager;
 
 namespace http
 {
-class Router;
+class VirtualHosts;
 }
 
 namespace tcp
@@ -19,11 +23,16 @@ class Server: boost::noncopyable
 {
 public:
 	Server(boost::asio::io_context& context, std::shared_ptr<const Options> global_opt,
-		const Options::Server& server_opt, std::shared_ptr<ModuleManager> module_manager);
+		const Options::Server& server_opt, std::shared_ptr<ModuleManager> module_manager,
+		bool reuse_port = false);
 	~Server();
 
 	const Options::Server& get_options() const { return server_opt; }
 
+	// Distributes connections of the SO_REUSEPORT group among n_shards
+	// listeners by the number of CPU which received them
+	void steer_by_cpu(unsigned n_shards);
+
 	ServerLogger lg;
 
 private:
@@ -36,6 +45,9 @@ private:
 	const std::shared_ptr<const Options> global_opt;
 	const Options::Server& server_opt;
 	const std::shared_ptr<ModuleManager> module_manager;
-	const std::shared_ptr<const http::Router> router;
+	const std::shared_ptr<const http::VirtualHosts> hosts;
+#ifdef LEMON_IO_URING
+	std::optional<uring::Acceptor> uring_acceptor;
+#endif
 };
-}
\ No newline at end of file
+}
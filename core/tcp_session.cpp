@@ -1,13 +1,15 @@
 #include "tcp_session.hpp"
-#include "algorithm.hpp"
+#include "options.hpp"
+#include "slab_allocator.hpp"
 #include "visitor.hpp"
-#include <boost/asio/dispatch.hpp>
+#include <boost/asio/execution/context.hpp>
 #include <boost/asio/post.hpp>
-#include <boost/asio/write.hpp>
-#include <boost/pool/pool_alloc.hpp>
-#include <boost/range/algorithm/upper_bound.hpp>
-#include <boost/range/algorithm_ext/is_sorted.hpp>
+#include <boost/asio/query.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <algorithm>
+#include <climits>
 #include <exception>
+#include <iterator>
 #include <utility>
 
 namespace tcp
@@ -16,22 +18,51 @@ namespace
 {
 using boost::system::error_code;
 using std::size_t;
+using Clock = TimerService::Clock;
 
-boost::fast_pool_allocator<Session,
-	boost::default_user_allocator_malloc_free,
-	boost::details::pool::null_mutex> client_allocator;
+#ifdef IOV_MAX
+constexpr size_t max_send_buffers = IOV_MAX;
+#else
+constexpr size_t max_send_buffers = 1024;
+#endif
+
+// a file is sent by parts, the send timeout is started for each of them
+constexpr size_t max_file_chunk = 1024 * 1024;
+
+// sessions are made by every accepting thread and freed by any thread
+SlabAllocator<Session> client_allocator;
+
+// a request not fitting into the memory is refused, other failures are ours
+auto request_error(const std::exception& e) noexcept -> http::Error
+{
+	using Status = http::Response::Status;
+	if (auto me = dynamic_cast<const MemoryBudget::Exceeded*>(&e))
+		return http::Error{ me->by_account ? Status::payload_too_large : Status::service_unavailable, e.what() };
+	return http::Error{ Status::internal_server_error, e.what() };
+}
+
+// offset and size of the file being sent: the file of the response, then its parts
+auto file_segment(const http::Task::Result& tr, size_t part) noexcept
+	-> std::pair<std::uint64_t, std::uint64_t>
+{
+	if (part == 0)
+		return { tr.file().offset, tr.file().size };
+	const auto& p = tr.file_parts()[part - 1];
+	return { p.offset, p.size };
+}
 
 //TODO use memory pool instead of arena
+// operations of a task are started whatever memory it holds
 template <typename Task, typename Handler>
 struct ArenaHandler
 {
-	using allocator_type = Arena::Allocator<Handler>;
+	using allocator_type = ArenaImp::OverdraftAllocator<Handler>;
 
 	ArenaHandler(const Task& t, Handler h) noexcept: a{ t.get_arena() }, h{ std::move(h) } {}
 
 	allocator_type get_allocator() const noexcept
 	{
-		return a.make_allocator<Handler>("asio handler");
+		return allocator_type{ a, "asio handler" };
 	}
 
 	template <typename ...Args>
@@ -41,48 +72,114 @@ struct ArenaHandler
 	}
 
 private:
-	Arena& a;
+	ArenaImp& a;
+	const Handler h;
+};
+
+template <typename Handler>
+struct MemoryHandler
+{
+	using allocator_type = HandlerMemory::Allocator<Handler>;
+
+	MemoryHandler(HandlerMemory& m, Handler h) noexcept: m{ m }, h{ std::move(h) } {}
+
+	allocator_type get_allocator() const noexcept
+	{
+		return m.make_allocator<Handler>();
+	}
+
+	template <typename ...Args>
+	void operator()(Args&&... args)
+	{
+		h(std::forward<Args>(args)...);
+	}
+
+private:
+	HandlerMemory& m;
 	const Handler h;
 };
 }
 
-Session::Session(boost::asio::io_context& context, Socket sock, std::shared_ptr<const Options> opt,
-	std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::Router> router, ServerLogger& lg) noexcept:
+Session::Session(Socket sock, std::shared_ptr<const Options> opt,
+	std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::VirtualHosts> hosts, ServerLogger& lg) noexcept:
 	sock{ std::move(sock) },
 	opt{ std::move(opt) },
 	module_manager{ move(module_manager) },
-	router{ std::move(router) },
+	hosts{ std::move(hosts) },
 	lg{ lg, this->sock.remote_endpoint().address() },
 	builder{ start_task_id, *this->opt },
-	next_send_id{ start_task_id },
-	send_barrier{ context }
+	memory_account{ MemoryBudget::process(), this->opt->memory.connection_limit },
+	arena_cache{ this->opt->arena_cache_size },
+	timers{ boost::asio::use_service<TimerService>(
+		boost::asio::query(this->sock.get_executor(), boost::asio::execution::context)) },
+	send_ring{ start_task_id, this->opt->pipeline_depth }
 {
 	lg.info("connection established"sv);
 }
 
 Session::~Session()
 {
+	// waits for the timeout being expired by another thread
+	timers.cancel(recv_timeout);
+	timers.cancel(send_timeout);
+	timers.cancel(cache_trim);
 	if (sock.is_open()) {
 		error_code ec;
 		sock.shutdown(Socket::shutdown_both, ec);
-		if (ec)
+		// a timeout may have shut it down already
+		if (ec && ec != boost::asio::error::not_connected)
 			lg.error("socket shutdown failed: ", ec);
 	}
+	if (n_recv_pauses)
+		lg.info("reading was paused, times: "sv, n_recv_pauses);
 	lg.info("connection closed"sv);
 }
 
-void Session::make(boost::asio::io_context& context, Socket sock, std::shared_ptr<const Options> opt,
-	std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::Router> rout, ServerLogger& lg)
+void Session::make(Socket sock, std::shared_ptr<const Options> opt,
+	std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::VirtualHosts> hosts, ServerLogger& lg)
+{
+	auto c = std::allocate_shared<Session>(client_allocator, std::move(sock),
+		move(opt), move(module_manager), move(hosts), lg);
+	c->start_wait(start_task_id);
+}
+
+void Session::start_wait(TaskIdent id)
+{
+	// an idle connection holds no task and no buffer
+	start_recv_timeout(id, http::TaskBuilder::Stage::idle);
+	// memory of the last request is kept for a client sending the next one soon
+	if (opt->arena_cache_size)
+		timers.start(cache_trim, Clock::now() + cache_idle_time);
+	sock.async_wait_read(MemoryHandler{ wait_memory,
+		[self = shared_from_this()](const error_code& ec) { self->on_readable(ec); } });
+}
+
+void Session::on_readable(const error_code& ec) noexcept
 {
-	auto c = std::allocate_shared<Session>(client_allocator, context, std::move(sock),
-		move(opt), move(module_manager), move(rout), lg);
-	auto it = c->builder.prepare_task(c);
-	c->start_recv(it);
+	timers.cancel(recv_timeout);
+	timers.cancel(cache_trim);
+	// the client has closed an idle connection
+	if (ec == boost::asio::error::eof)
+		return;
+	if (BOOST_UNLIKELY(ec.failed())) {
+		lg.error("failed to wait for request: "sv, ec);
+		return;
+	}
+
+	try {
+		start_recv(builder.prepare_task(shared_from_this()));
+	} catch (MemoryBudget::Exceeded& e) {
+		lg.warning("request refused: "sv, e.what());
+		start_send(builder.reject_task(shared_from_this(), request_error(e)));
+	} catch (std::exception& e) {
+		lg.error("failed to read request: "sv, e.what());
+	}
 }
 
 void Session::start_recv(const http::IncompleteTask& it)
 {
 	const auto b = builder.get_memory(it);
+	start_recv_timeout(it.get_id(), builder.get_stage());
 	sock.async_read_some(buffer(b), ArenaHandler{ it,
 		                     [this, it](const error_code& ec, size_t bytes_transferred)
 		                     {
@@ -90,43 +187,151 @@ void Session::start_recv(const http::IncompleteTask& it)
 		                     } });
 }
 
+void Session::start_recv_timeout(TaskIdent id, http::TaskBuilder::Stage stage)
+{
+	using Stage = http::TaskBuilder::Stage;
+	if (id != recv_timeout_id || stage != recv_stage) {
+		recv_timeout_id = id;
+		recv_stage = stage;
+		const auto& t = opt->timeout;
+		// the client is not idle before the first request
+		const auto timeout = stage == Stage::body ? t.body
+			: stage == Stage::headers || id == start_task_id ? t.header
+			: t.keep_alive;
+		if (timeout.count())
+			recv_deadline = Clock::now() + timeout;
+		else
+			recv_deadline.reset();
+	}
+	if (recv_deadline)
+		timers.start(recv_timeout, *recv_deadline);
+}
+
 void Session::on_recv(const error_code& ec,
                      size_t bytes_transferred,
 	                 const http::IncompleteTask& it) noexcept
 {
+	timers.cancel(recv_timeout);
 	const auto eof = ec == boost::asio::error::eof;
 	it.lg().debug("received bytes: "sv, bytes_transferred, eof ? ", and EOF"sv : ""sv);
+	// a slow client is given time in proportion to what it sends
+	if (const auto rate = opt->timeout.min_rate; rate && recv_deadline && recv_stage != http::TaskBuilder::Stage::idle)
+		*recv_deadline += Clock::duration{ std::chrono::seconds{ bytes_transferred } } / rate;
 	if (BOOST_UNLIKELY(ec && !eof)) {
 		it.lg().error("failed to read request: "sv, ec);
 		return;
 	}
 
 	try {
-		for (auto&& t : builder.make_tasks(shared_from_this(), it, bytes_transferred, eof))
-			std::visit(Visitor{
-				           [this](const http::IncompleteTask& t) { start_recv(t); },
-				           [this](const http::ReadyTask& t)      { run(t); },
-				           [this](const http::Task::Result& t)   { start_send(t); },
-			           }, t);
+		parsed.emplace(builder.make_tasks(shared_from_this(), it, bytes_transferred, eof));
+		next_task = parsed->next();
 	} catch (std::exception& re) {
+		parsed.reset();
 		//TODO check if 'it' is actual task
 		it.lg().error(re.what());
-		start_send(http::TaskBuilder::make_error_task(it,
-		                                              http::Error{ http::Response::Status::internal_server_error, re.what()}));
+		start_send(http::TaskBuilder::make_error_task(it, request_error(re)));
+		return;
 	}
+	recv_task = it;
+	handle_tasks();
+}
+
+void Session::handle_tasks() noexcept
+{
+	std::optional<http::IncompleteTask> next_recv;
+	std::optional<TaskIdent> next_wait;
+	try {
+		for (; next_task; next_task = parsed->next()) {
+			const auto id = std::visit([](auto& t) { return t.get_id(); }, *next_task);
+			if (BOOST_UNLIKELY(must_pause_recv(id)) && pause_recv(id))
+				return;
+			std::visit(Visitor{
+				           [&](const http::IncompleteTask& t) { next_recv = t; },
+				           [this](const http::ReadyTask& t)   { run(t); },
+				           [this](const http::Task::Result& t){ start_send(t); },
+				           [&](const http::TaskBuilder::Idle& t) { next_wait = t.get_id(); },
+			           }, *next_task);
+		}
+	} catch (std::exception& re) {
+		next_task.reset();
+		//TODO check if 'it' is actual task
+		recv_task->lg().error(re.what());
+		start_send(http::TaskBuilder::make_error_task(*recv_task, request_error(re)));
+	}
+	parsed.reset();
+	recv_task.reset();
+
+	// the incomplete task or idle wait comes last; the next read may be completed by another thread at once
+	if (next_recv) {
+		try {
+			start_recv(*next_recv);
+		} catch (MemoryBudget::Exceeded& e) {
+			next_recv->lg().warning("request refused: "sv, e.what());
+			start_send(http::TaskBuilder::make_error_task(*next_recv, request_error(e)));
+		} catch (std::exception& e) {
+			next_recv->lg().error("failed to read request: "sv, e.what());
+		}
+	} else if (next_wait) {
+		try {
+			start_wait(*next_wait);
+		} catch (std::exception& e) {
+			lg.error("failed to wait for request: "sv, e.what());
+		}
+	}
+}
+
+auto Session::must_pause_recv(TaskIdent id) const noexcept -> bool
+{
+	if (!send_ring.fits(id))
+		return true;
+	// a connection holding much of the tight memory waits for its responses
+	return id != send_ring.front_id() && memory_account.is_heavy();
+}
+
+auto Session::pause_recv(TaskIdent id) noexcept -> bool
+{
+	recv_task->lg().debug("pipeline is full or memory is short, reading paused"sv);
+	++n_recv_pauses;
+	recv_paused = true;
+	// a response may have been sent before the flag was set
+	return !(!must_pause_recv(id) && recv_paused.exchange(false));
+}
+
+void Session::resume_recv()
+{
+	if (!recv_paused || !recv_paused.exchange(false))
+		return;
+	// the tasks were left by the reading side, which waits for us now;
+	// the task which was read may be running, so its arena is not used
+	lg.debug("reading resumed"sv);
+	post(sock.get_executor(), [self = shared_from_this()] { self->handle_tasks(); });
 }
 
 void Session::run(const http::ReadyTask& rt) noexcept
 {
 	post(sock.get_executor(), ArenaHandler{ rt, [this, rt]
 		{
+			std::optional<http::Task::Result> tr;
 			try {
-				auto tr = rt.run();
-				start_send(tr);
+				tr = rt.run();
 			} catch (std::exception& e) {
-				rt.lg().error("send response error: "sv, e.what());
+				rt.lg().error("response error: "sv, e.what());
 			} catch (...) {
-				rt.lg().error("send response unknown error"sv);
+				rt.lg().error("response unknown error"sv);
+			}
+			// the later responses wait for the place of this one, so it is
+			// taken anyway, and the connection is closed before it is sent
+			if (!tr) {
+				error_code ec;
+				sock.shutdown(Socket::shutdown_both, ec);
+				tr = rt.abandon();
+			}
+			try {
+				start_send(*tr);
+			} catch (std::exception& e) {
+				rt.lg().error("send response error: "sv, e.what());
+				error_code ec;
+				sock.shutdown(Socket::shutdown_both, ec);
 			}
 		}
 	});
@@ -134,41 +339,168 @@ void Session::run(const http::ReadyTask& rt) noexcept
 
 void Session::start_send(const http::Task::Result& tr)
 {
-	dispatch(send_barrier, ArenaHandler{ tr, [this, tr]
-		{
-			if (BOOST_LIKELY(tr.get_id() == next_send_id)) {
-				tr.lg().debug("sending task result..."sv);
-				async_write(sock, tr, ArenaHandler{ tr,
-					[this, tr](const error_code& ec, size_t) { on_sent(ec, tr); } });
-			} else {
-				tr.lg().debug("queueing task result"sv);
-				BOOST_ASSERT(!contains(send_q, tr));
-				auto it = boost::upper_bound(send_q, tr);
-				send_q.insert(it, tr);
-				BOOST_ASSERT(boost::is_sorted(send_q));
-			}
-		} });
+	send_ring.put(tr.get_id(), tr);
+	try_send();
+}
+
+void Session::try_send()
+{
+	// whoever sets the flag sends everything which is ready
+	while (!sending.exchange(true)) {
+		if (send_batch())
+			return;
+		sending = false;
+		// a result may have been put after the batch was collected
+		if (!send_ring.has_front())
+			return;
+	}
+}
+
+auto Session::send_batch() -> bool
+{
+	// pipelined results which are ready go in the same write
+	while (auto tr = send_ring.front()) {
+		const auto n_bufs = static_cast<size_t>(std::distance(tr->begin(), tr->end()));
+		if (!in_flight.empty() && send_bufs.size() + n_bufs > max_send_buffers)
+			break;
+		if (BOOST_UNLIKELY(send_failed)) {
+			tr->lg().debug("dropping task result"sv);
+		} else {
+			send_bufs.insert(send_bufs.end(), tr->begin(), tr->end());
+			in_flight.push_back(std::move(*tr));
+		}
+		send_ring.pop();
+		// the file has to follow the head of its response
+		if (!in_flight.empty() && in_flight.back().file().size)
+			break;
+	}
+	resume_recv();
+	if (in_flight.empty())
+		return false;
+
+	const auto& tr = in_flight.front();
+	tr.lg().debug("sending task results: "sv, in_flight.size());
+	if (const auto timeout = opt->timeout.send; timeout.count())
+		timers.start(send_timeout, Clock::now() + timeout);
+	sock.async_write(boost::make_iterator_range(send_bufs),
+		ArenaHandler{ tr, [this, tr](const error_code& ec, size_t) { on_sent(ec, tr); } });
+	// the write may be already completed by another thread
+	return true;
 }
 
 void Session::on_sent(const error_code& ec, const http::Task::Result& tr) noexcept
 {
+	timers.cancel(send_timeout);
 	try {
+		send_bufs.clear();
 		if (ec) {
 			tr.lg().error("failed to send task result: "sv, ec);
-			send_q.clear();  //TODO cancel tasks
+			send_failed = true;  //TODO cancel tasks
+		} else if (in_flight.back().file().size) {
+			file_part = 0;
+			file_sent = 0;
+			send_file(in_flight.back());
+			return;
 		} else {
-			tr.lg().debug("task result sent"sv);
+			tr.lg().debug("task results sent"sv);
 			//TODO check if tr was error task
-			++next_send_id;
-			if (BOOST_UNLIKELY(!send_q.empty())
-					&& send_q.front().get_id() == next_send_id) {
-				tr.lg().debug("dequeuing task", next_send_id);
-				start_send(send_q.front());
-				send_q.pop_front();
-			}
 		}
+		next_batch();
+	} catch (std::exception& e) {
+		tr.lg().error("response queue error: "sv, e.what());
+	}
+}
+
+void Session::send_file(const http::Task::Result& tr)
+{
+	const auto [offset, part_size] = file_segment(tr, file_part);
+	const auto size = static_cast<size_t>(std::min<std::uint64_t>(part_size - file_sent, max_file_chunk));
+	if (const auto timeout = opt->timeout.send; timeout.count())
+		timers.start(send_timeout, Clock::now() + timeout);
+	sock.async_send_file_some(tr.file().fd, offset + file_sent, size,
+		ArenaHandler{ tr, [this, tr](const error_code& ec, size_t n) { on_file_sent(ec, n, tr); } });
+}
+
+void Session::on_file_sent(const error_code& ec, size_t bytes_transferred, const http::Task::Result& tr) noexcept
+{
+	timers.cancel(send_timeout);
+	try {
+		file_sent += bytes_transferred;
+		if (ec) {
+			tr.lg().error("failed to send file: "sv, ec);
+			send_failed = true;
+			// the client waits for the rest of the body
+			error_code sec;
+			sock.shutdown(Socket::shutdown_both, sec);
+		} else if (file_sent < file_segment(tr, file_part).second) {
+			send_file(tr);
+			return;
+		} else {
+			send_file_part(tr);
+			return;
+		}
+		next_batch();
 	} catch (std::exception& e) {
 		tr.lg().error("response queue error: "sv, e.what());
 	}
 }
-}
\ No newline at end of file
+
+void Session::send_file_part(const http::Task::Result& tr)
+{
+	const auto& parts = tr.file_parts();
+	if (file_part == parts.size()) {
+		tr.lg().debug("task results sent"sv);
+		next_batch();
+		return;
+	}
+
+	const auto& part = parts[file_part++];
+	file_sent = 0;
+	send_bufs.assign(1, boost::asio::buffer(part.before));
+	if (const auto timeout = opt->timeout.send; timeout.count())
+		timers.start(send_timeout, Clock::now() + timeout);
+	sock.async_write(boost::make_iterator_range(send_bufs),
+		ArenaHandler{ tr, [this, tr](const error_code& ec, size_t) { on_file_part_sent(ec, tr); } });
+}
+
+void Session::on_file_part_sent(const error_code& ec, const http::Task::Result& tr) noexcept
+{
+	timers.cancel(send_timeout);
+	try {
+		send_bufs.clear();
+		if (ec) {
+			tr.lg().error("failed to send file part: "sv, ec);
+			send_failed = true;
+			error_code sec;
+			sock.shutdown(Socket::shutdown_both, sec);
+		} else if (file_segment(tr, file_part).second) {
+			send_file(tr);
+			return;
+		} else {
+			send_file_part(tr);
+			return;
+		}
+		next_batch();
+	} catch (std::exception& e) {
+		tr.lg().error("response queue error: "sv, e.what());
+	}
+}
+
+void Session::next_batch()
+{
+	in_flight.clear();
+	if (!send_batch()) {
+		sending = false;
+		if (send_ring.has_front())
+			try_send();
+	}
+}
+
+void Session::Timeout::expire() noexcept
+{
+	s.lg.info("timeout: "sv, what);
+	// pending operations fail, and the session goes away with them
+	error_code ec;
+	s.sock.shutdown(Socket::shutdown_both, ec);
+}
+}
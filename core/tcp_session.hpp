@@ -1,23 +1,31 @@
 #pragma once
+#include "arena_imp.hpp"
+#include "handler_memory.hpp"
 #include "http_task_builder.hpp"
 #include "leak_checked.hpp"
 #include "logger_imp.hpp"
+#include "memory_budget.hpp"
+#include "reorder_ring.hpp"
 #include "task_ident.hpp"
-#include <boost/asio/io_context.hpp>
-#include <boost/asio/ip/tcp.hpp>
-#include <boost/asio/strand.hpp>
-#include <boost/container/list.hpp>
+#include "tcp_socket.hpp"
+#include "timer_service.hpp"
+#include <boost/asio/buffer.hpp>
 #include <boost/core/noncopyable.hpp>
 #include <boost/system/error_code.hpp>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <vector>
 
 class ModuleManager;
 class Options;
 
 namespace http
 {
-class Router;
+class VirtualHosts;
 }
 
 namespace tcp
@@ -28,37 +36,108 @@ class Session:
 	LeakChecked<Session>
 {
 public:
-	using Socket = boost::asio::ip::tcp::socket;
-
-	Session(boost::asio::io_context& context, Socket sock, std::shared_ptr<const Options> opt,
-		std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::Router> router, ServerLogger& lg) noexcept;
+	Session(Socket sock, std::shared_ptr<const Options> opt,
+		std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::VirtualHosts> hosts, ServerLogger& lg) noexcept;
 	~Session();
 
-	static void make(boost::asio::io_context& context, Socket sock, std::shared_ptr<const Options> opt,
-		std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::Router> rout, ServerLogger& lg);
+	static void make(Socket sock, std::shared_ptr<const Options> opt,
+		std::shared_ptr<ModuleManager> module_manager, std::shared_ptr<const http::VirtualHosts> hosts, ServerLogger& lg);
 
 	ClientLogger& get_logger() noexcept { return lg; }
-	const http::Router& get_router() const noexcept { return *router; }
+	ArenaCache& get_arena_cache() noexcept { return arena_cache; }
+	MemoryBudget::Account& get_memory_account() noexcept { return memory_account; }
+	const MemoryBudget::Account& get_memory_account() const noexcept { return memory_account; }
+	const http::VirtualHosts& get_hosts() const noexcept { return *hosts; }
 
 private:
 	static constexpr TaskIdent start_task_id = http::Task::start_id;
 
+	// shuts the connection down when expires
+	class Timeout final: public TimerService::Timer
+	{
+	public:
+		Timeout(Session& s, string_view what) noexcept: s{ s }, what{ what } {}
+
+	private:
+		void expire() noexcept override;
+
+		Session& s;
+		const string_view what;
+	};
+
+	// frees the arena cache of a connection idle for a while
+	class CacheTrim final: public TimerService::Timer
+	{
+	public:
+		explicit CacheTrim(Session& s) noexcept: s{ s } {}
+
+	private:
+		void expire() noexcept override { s.arena_cache.clear(); }
+
+		Session& s;
+	};
+
+	static constexpr auto cache_idle_time = std::chrono::seconds{ 1 };
+
 	Socket sock;
 	const std::shared_ptr<const Options> opt;
 	const std::shared_ptr<ModuleManager> module_manager;
-	const std::shared_ptr<const http::Router> router;
+	const std::shared_ptr<const http::VirtualHosts> hosts;
 	ClientLogger lg;
 	http::TaskBuilder builder;
-	TaskIdent next_send_id;
-	boost::container::list<http::Task::Result> send_q;
-	boost::asio::io_context::strand send_barrier;
+	MemoryBudget::Account memory_account;
+	ArenaCache arena_cache;
+	TimerService& timers;
+	// the read timeout is set when a request or its stage changes
+	TaskIdent recv_timeout_id = 0;
+	http::TaskBuilder::Stage recv_stage = http::TaskBuilder::Stage::idle;
+	std::optional<TimerService::Clock::time_point> recv_deadline;
+	Timeout recv_timeout{ *this, "reading request"sv };
+	Timeout send_timeout{ *this, "sending response"sv };
+	CacheTrim cache_trim{ *this };
+	// the wait of an idle connection does not allocate
+	HandlerMemory wait_memory;
+	// requests waiting for room in the pipeline, and the read which brought them
+	std::optional<http::TaskBuilder::Results> parsed;
+	std::optional<http::TaskBuilder::Results::value> next_task;
+	std::optional<http::IncompleteTask> recv_task;
+	std::atomic<bool> recv_paused = false;
+	unsigned n_recv_pauses = 0;
+	// results in order of requests; the one holding the sending flag takes them
+	ReorderRing<http::Task::Result> send_ring;
+	std::atomic<bool> sending = false;
+	bool send_failed = false;
+	// results being written by one gathered write
+	std::vector<http::Task::Result> in_flight;
+	std::vector<boost::asio::const_buffer> send_bufs;
+	// of the file of the last result, which is sent after the write: the part
+	// being sent, zero for the file itself, and its bytes sent
+	std::size_t file_part = 0;
+	std::uint64_t file_sent = 0;
 
+	void start_wait(TaskIdent id);
+	void on_readable(const boost::system::error_code& ec) noexcept;
 	void start_recv(const http::IncompleteTask& it);
+	void start_recv_timeout(TaskIdent id, http::TaskBuilder::Stage stage);
 	void on_recv(const boost::system::error_code& ec,
 		         std::size_t bytes_transferred,
 		         const http::IncompleteTask& it) noexcept;
+	void handle_tasks() noexcept;
+	auto must_pause_recv(TaskIdent id) const noexcept -> bool;
+	auto pause_recv(TaskIdent id) noexcept -> bool;
+	void resume_recv();
 	void run(const http::ReadyTask& rt) noexcept;
 	void start_send(const http::Task::Result& tr);
+	void try_send();
+	// returns false if there is nothing to send
+	auto send_batch() -> bool;
 	void on_sent(const boost::system::error_code& ec, const http::Task::Result& tr) noexcept;
+	void send_file(const http::Task::Result& tr);
+	void on_file_sent(const boost::system::error_code& ec, std::size_t bytes_transferred,
+		const http::Task::Result& tr) noexcept;
+	// the chunk of the next part of the file, if any
+	void send_file_part(const http::Task::Result& tr);
+	void on_file_part_sent(const boost::system::error_code& ec, const http::Task::Result& tr) noexcept;
+	void next_batch();
 };
 }
\ No newline at end of file
@@ -0,0 +1,157 @@
+#pragma once
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/system/error_code.hpp>
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <variant>
+#ifdef LEMON_IO_URING
+# include "uring_socket.hpp"
+#endif
+
+namespace tcp
+{
+namespace detail
+{
+// Sends a part of a file once the socket is writable
+template <typename Handler>
+struct SendFileHandler
+{
+	using allocator_type = boost::asio::associated_allocator_t<Handler>;
+
+	allocator_type get_allocator() const noexcept
+	{
+		return boost::asio::get_associated_allocator(h);
+	}
+
+	void operator()(const boost::system::error_code& ec)
+	{
+		if (ec)
+			return h(ec, 0);
+		auto off = static_cast<off_t>(offset);
+		const auto n = ::sendfile(s.native_handle(), fd, &off, size);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return s.async_wait(boost::asio::ip::tcp::socket::wait_write, std::move(*this));
+		if (n < 0)
+			return h(boost::system::error_code{ errno, boost::system::system_category() }, 0);
+		// the file is shorter than it was
+		if (n == 0)
+			return h(boost::asio::error::eof, 0);
+		h(boost::system::error_code{}, static_cast<std::size_t>(n));
+	}
+
+	boost::asio::ip::tcp::socket& s;
+	int fd;
+	std::uint64_t offset;
+	std::size_t size;
+	Handler h;
+};
+}
+
+// Connected socket of any I/O backend
+class Socket
+{
+public:
+	using Asio = boost::asio::ip::tcp::socket;
+	using shutdown_type = boost::asio::socket_base::shutdown_type;
+	static constexpr auto shutdown_both = boost::asio::socket_base::shutdown_both;
+
+	Socket(Asio sock) noexcept: sock{ std::move(sock) } {}
+#ifdef LEMON_IO_URING
+	Socket(uring::Socket sock) noexcept: sock{ std::move(sock) } {}
+#endif
+
+	auto get_executor() noexcept -> boost::asio::any_io_executor
+	{
+		return std::visit([](auto& s) -> boost::asio::any_io_executor { return s.get_executor(); }, sock);
+	}
+
+	auto remote_endpoint() const -> boost::asio::ip::tcp::endpoint
+	{
+		return std::visit([](auto& s) { return s.remote_endpoint(); }, sock);
+	}
+
+	bool is_open() const noexcept
+	{
+		return std::visit([](auto& s) { return s.is_open(); }, sock);
+	}
+
+	void shutdown(shutdown_type what, boost::system::error_code& ec) noexcept
+	{
+		std::visit([&](auto& s) { s.shutdown(what, ec); }, sock);
+	}
+
+	template <typename Handler>
+	void async_read_some(boost::asio::mutable_buffer buf, Handler&& handler)
+	{
+		std::visit([&](auto& s) { s.async_read_some(buf, std::forward<Handler>(handler)); }, sock);
+	}
+
+	// completes when data or EOF can be read, without reading it
+	template <typename Handler>
+	void async_wait_read(Handler&& handler)
+	{
+		std::visit([&](auto& s) { wait_read(s, std::forward<Handler>(handler)); }, sock);
+	}
+
+	template <typename ConstBufferSequence, typename Handler>
+	void async_write(const ConstBufferSequence& buffers, Handler&& handler)
+	{
+		std::visit([&](auto& s)
+		{
+			using boost::asio::async_write;
+			async_write(s, buffers, std::forward<Handler>(handler));
+		}, sock);
+	}
+
+	// sends some bytes of a file, at most the size, waiting for room in the socket
+	template <typename Handler>
+	void async_send_file_some(int fd, std::uint64_t offset, std::size_t size, Handler&& handler)
+	{
+		std::visit([&](auto& s) { send_file_some(s, fd, offset, size, std::forward<Handler>(handler)); }, sock);
+	}
+
+private:
+	template <typename Handler>
+	static void send_file_some(Asio& s, int fd, std::uint64_t offset, std::size_t size, Handler&& handler)
+	{
+		boost::system::error_code ec;
+		s.native_non_blocking(true, ec);
+		if (ec)
+			return boost::asio::post(s.get_executor(), [ec, h = std::forward<Handler>(handler)]() mutable { h(ec, 0); });
+		s.async_wait(Asio::wait_write,
+			detail::SendFileHandler<std::decay_t<Handler>>{ s, fd, offset, size, std::forward<Handler>(handler) });
+	}
+
+	template <typename Handler>
+	static void wait_read(Asio& s, Handler&& handler)
+	{
+		s.async_wait(Asio::wait_read, std::forward<Handler>(handler));
+	}
+#ifdef LEMON_IO_URING
+	template <typename Handler>
+	static void wait_read(uring::Socket& s, Handler&& handler)
+	{
+		s.async_wait_read(std::forward<Handler>(handler));
+	}
+
+	template <typename Handler>
+	static void send_file_some(uring::Socket& s, int fd, std::uint64_t offset, std::size_t size, Handler&& handler)
+	{
+		s.async_send_file_some(fd, offset, size, std::forward<Handler>(handler));
+	}
+
+	std::variant<Asio, uring::Socket> sock;
+#else
+	std::variant<Asio> sock;
+#endif
+};
+}
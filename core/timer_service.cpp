@@ -0,0 +1,59 @@
+#include "timer_service.hpp"
+#include <boost/asio/io_context.hpp>
+
+boost::asio::execution_context::id TimerService::id;
+
+TimerService::TimerService(boost::asio::execution_context& ctx):
+	boost::asio::execution_context::service{ ctx },
+	origin{ Clock::now() },
+	ticker{ static_cast<boost::asio::io_context&>(ctx) }
+{
+	start_tick();
+}
+
+void TimerService::start(Timer& t, Clock::time_point deadline)
+{
+	// the tick is processed after it ends, so it is never early
+	const auto at = ticks_at(deadline);
+	std::lock_guard lock{ mutex };
+	if (shut_down)
+		return;
+	wheel.start(t, at > wheel.now() ? at - wheel.now() : 0);
+}
+
+void TimerService::cancel(Timer& t) noexcept
+{
+	std::lock_guard lock{ mutex };
+	wheel.cancel(t);
+}
+
+void TimerService::shutdown()
+{
+	std::lock_guard lock{ mutex };
+	shut_down = true;
+	wheel.clear();
+	ticker.cancel();
+}
+
+void TimerService::start_tick()
+{
+	ticker.expires_at(origin + (wheel.now() + 1) * tick);
+	ticker.async_wait([this](const boost::system::error_code& ec)
+	{
+		if (ec)
+			return;
+		std::lock_guard lock{ mutex };
+		if (shut_down)
+			return;
+		// the ticks missed by a busy thread are caught up with
+		const auto now = ticks_at(Clock::now());
+		if (now > wheel.now())
+			wheel.advance(now - wheel.now());
+		start_tick();
+	});
+}
+
+auto TimerService::ticks_at(Clock::time_point tp) const noexcept -> TimerWheel::Ticks
+{
+	return tp > origin ? static_cast<TimerWheel::Ticks>((tp - origin) / tick) : 0;
+}
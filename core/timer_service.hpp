@@ -0,0 +1,38 @@
+#pragma once
+#include "timer_wheel.hpp"
+#include <boost/asio/execution_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <mutex>
+
+// Timer wheel of an io_context, ticking with a coarse period.
+// Timers expire within one tick after their deadline. Expiration handlers
+// are called under the lock, so they may not start or cancel timers,
+// but a timer cancelled from another thread is not being expired after that.
+class TimerService: public boost::asio::execution_context::service
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	using Timer = TimerWheel::Timer;
+
+	using key_type = TimerService;
+	static boost::asio::execution_context::id id;
+
+	static constexpr Clock::duration tick = std::chrono::milliseconds{ 100 };
+
+	explicit TimerService(boost::asio::execution_context& ctx);
+
+	void start(Timer& t, Clock::time_point deadline);
+	void cancel(Timer& t) noexcept;
+
+private:
+	void shutdown() override;
+	void start_tick();
+	auto ticks_at(Clock::time_point tp) const noexcept -> TimerWheel::Ticks;
+
+	std::mutex mutex;
+	TimerWheel wheel;
+	const Clock::time_point origin;
+	boost::asio::steady_timer ticker;
+	bool shut_down = false;
+};
@@ -0,0 +1,67 @@
+#include "timer_wheel.hpp"
+#include <boost/assert.hpp>
+#include <algorithm>
+
+TimerWheel::~TimerWheel()
+{
+	clear();
+}
+
+void TimerWheel::start(Timer& t, Ticks ticks) noexcept
+{
+	t.unlink();
+	t.expiry = current + std::min(ticks, max_ticks);
+	place(t);
+}
+
+void TimerWheel::clear() noexcept
+{
+	for (auto& level : levels)
+		for (auto& slot : level)
+			slot.clear();
+}
+
+void TimerWheel::advance(Ticks ticks) noexcept
+{
+	while (ticks--)
+		tick();
+}
+
+void TimerWheel::place(Timer& t) noexcept
+{
+	// a timer goes to the finest level covering its expiry
+	const auto delta = t.expiry - current;
+	unsigned level = 0;
+	while (level + 1 < n_levels && delta >> (slot_bits * (level + 1)))
+		++level;
+	levels[level][(t.expiry >> (slot_bits * level)) & slot_mask].push_back(t);
+}
+
+auto TimerWheel::cascade(unsigned level) noexcept -> Ticks
+{
+	const auto index = (current >> (slot_bits * level)) & slot_mask;
+	auto& slot = levels[level][index];
+	while (!slot.empty()) {
+		auto& t = slot.front();
+		slot.pop_front();
+		place(t);
+	}
+	return index;
+}
+
+void TimerWheel::tick() noexcept
+{
+	// a coarser level is cascaded when the finer one wraps around
+	if ((current & slot_mask) == 0)
+		for (unsigned level = 1; level < n_levels && cascade(level) == 0; ++level)
+			;
+
+	auto& slot = levels[0][current & slot_mask];
+	while (!slot.empty()) {
+		auto& t = slot.front();
+		slot.pop_front();
+		BOOST_ASSERT(t.expiry == current);
+		t.expire();
+	}
+	++current;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <boost/core/noncopyable.hpp>
+#include <boost/intrusive/list.hpp>
+#include <array>
+#include <cstdint>
+
+// Hierarchical timing wheel counting time in ticks.
+// Starting and cancelling a timer is O(1); a timer is moved to a finer level
+// a few times at most before it expires. Not thread-safe.
+class TimerWheel: boost::noncopyable
+{
+public:
+	using Ticks = std::uint64_t;
+
+	class Timer: public boost::intrusive::list_base_hook<
+		boost::intrusive::link_mode<boost::intrusive::auto_unlink>>
+	{
+	public:
+		virtual ~Timer() = default;
+
+		auto is_armed() const noexcept -> bool { return is_linked(); }
+
+	private:
+		// called by the wheel, the timer is not armed already
+		virtual void expire() noexcept = 0;
+
+		Ticks expiry = 0;
+
+		friend class TimerWheel;
+	};
+
+	static constexpr unsigned slot_bits = 6;
+	static constexpr unsigned n_levels = 4;
+	// longer timeouts are cut down to this
+	static constexpr Ticks max_ticks = (Ticks{ 1 } << (slot_bits * n_levels)) - 1;
+
+	TimerWheel() = default;
+	~TimerWheel();
+
+	// number of ticks passed
+	auto now() const noexcept -> Ticks { return current; }
+
+	// the timer expires when the time is now() + ticks
+	void start(Timer& t, Ticks ticks) noexcept;
+	void cancel(Timer& t) noexcept { t.unlink(); }
+	// forgets all the timers without expiring them
+	void clear() noexcept;
+
+	// expires timers on the way
+	void advance(Ticks ticks) noexcept;
+
+private:
+	static constexpr unsigned n_slots = 1u << slot_bits;
+	static constexpr Ticks slot_mask = n_slots - 1;
+
+	using Slot = boost::intrusive::list<Timer, boost::intrusive::constant_time_size<false>>;
+	using Level = std::array<Slot, n_slots>;
+
+	void place(Timer& t) noexcept;
+	// moves the slot timers of the level to finer levels; returns the slot index
+	auto cascade(unsigned level) noexcept -> Ticks;
+	void tick() noexcept;
+
+	std::array<Level, n_levels> levels;
+	// the tick to be processed next
+	Ticks current = 0;
+};
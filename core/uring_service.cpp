@@ -0,0 +1,353 @@
+#include "uring_service.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/assert.hpp>
+#include <boost/system/system_error.hpp>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace uring
+{
+namespace
+{
+constexpr unsigned max_buffers = 1u << 16;
+
+[[noreturn]] void throw_error(int err, const char* what)
+{
+	throw boost::system::system_error{ { err, boost::system::system_category() }, what };
+}
+
+template <typename T>
+T* at(void* base, unsigned offset) noexcept
+{
+	return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+auto map(std::size_t size, int fd, off_t offset) -> void*
+{
+	auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+	if (p == MAP_FAILED)
+		throw_error(errno, "io_uring mmap");
+	return p;
+}
+
+auto map_anonymous(std::size_t size) -> void*
+{
+	auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		throw_error(errno, "io_uring buffers mmap");
+	return p;
+}
+
+template <typename T>
+T load_acquire(const T* p) noexcept { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+
+template <typename T>
+void store_release(T* p, T v) noexcept { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+}
+
+boost::asio::execution_context::id Service::id;
+
+Service::Service(boost::asio::execution_context& ctx):
+	Service{ ctx, Params{} }
+{}
+
+Service::Service(boost::asio::execution_context& ctx, const Params& params):
+	boost::asio::execution_context::service{ ctx },
+	ctx{ static_cast<boost::asio::io_context&>(ctx) },
+	params{ params }
+{
+	if (params.n_buffers == 0 || params.n_buffers > max_buffers)
+		throw std::runtime_error{ "io_uring: buffer count should be from 1 to "
+			+ std::to_string(max_buffers) };
+
+	try {
+		setup(params.entries);
+		setup_buffers();
+		watch.emplace(this->ctx, fd);
+	} catch (...) {
+		release();
+		throw;
+	}
+	start_wait();
+}
+
+Service::~Service()
+{
+	release();
+}
+
+auto Service::release() noexcept -> void
+{
+	if (watch) {
+		watch->release();
+		watch.reset();
+	}
+	if (buffers)
+		munmap(buffers, params.n_buffers * params.buffer_size);
+	if (sq.sqes)
+		munmap(sq.sqes, sqes_size);
+	if (cq_ring && cq_ring != sq_ring)
+		munmap(cq_ring, cq_ring_size);
+	if (sq_ring)
+		munmap(sq_ring, sq_ring_size);
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+	buffers = nullptr;
+	sq.sqes = nullptr;
+	cq_ring = sq_ring = nullptr;
+}
+
+auto Service::setup(unsigned entries) -> void
+{
+	io_uring_params p{};
+	p.flags = IORING_SETUP_CQSIZE;
+	// multishot requests post many completions per submission
+	p.cq_entries = entries * 4;
+	fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+	if (fd < 0)
+		throw_error(errno, "io_uring_setup");
+	if (!(p.features & IORING_FEAT_NODROP))
+		throw std::runtime_error{ "io_uring: kernel is too old" };
+
+	sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	const auto single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap)
+		sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+	sq_ring = map(sq_ring_size, fd, IORING_OFF_SQ_RING);
+	cq_ring = single_mmap ? sq_ring : map(cq_ring_size, fd, IORING_OFF_CQ_RING);
+	sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+	sq.sqes = static_cast<io_uring_sqe*>(map(sqes_size, fd, IORING_OFF_SQES));
+
+	sq.head = at<unsigned>(sq_ring, p.sq_off.head);
+	sq.tail = at<unsigned>(sq_ring, p.sq_off.tail);
+	sq.mask = *at<unsigned>(sq_ring, p.sq_off.ring_mask);
+	sq.entries = *at<unsigned>(sq_ring, p.sq_off.ring_entries);
+	sq.flags = at<unsigned>(sq_ring, p.sq_off.flags);
+	sq.array = at<unsigned>(sq_ring, p.sq_off.array);
+	sq.local_tail = sq.submitted_tail = *sq.tail;
+
+	cq.head = at<unsigned>(cq_ring, p.cq_off.head);
+	cq.tail = at<unsigned>(cq_ring, p.cq_off.tail);
+	cq.mask = *at<unsigned>(cq_ring, p.cq_off.ring_mask);
+	cq.cqes = at<io_uring_cqe>(cq_ring, p.cq_off.cqes);
+}
+
+auto Service::setup_buffers() -> void
+{
+	buffers = static_cast<char*>(map_anonymous(params.n_buffers * params.buffer_size));
+	recycled.reserve(params.n_buffers);
+	provide(0, params.n_buffers);
+}
+
+auto Service::shutdown() -> void
+{
+	shut_down = true;
+	while (!ops.empty()) {
+		auto& op = ops.front();
+		op.unlink();
+		op.abandon();
+	}
+	while (!buffer_waiters.empty()) {
+		auto& w = buffer_waiters.front();
+		w.unlink();
+		w.abandon_wait();
+	}
+	// the reactor is shut down too, the descriptor is closed by us
+	if (watch) {
+		watch->release();
+		watch.reset();
+	}
+}
+
+auto Service::buffer(unsigned short id) const noexcept -> char*
+{
+	return buffers + id * params.buffer_size;
+}
+
+auto Service::recycle(unsigned short id) noexcept -> void
+{
+	recycled.push_back(id);
+	schedule_flush();
+}
+
+auto Service::wait_buffers(BufferWaiter& w) noexcept -> void
+{
+	if (!w.is_linked())
+		buffer_waiters.push_back(w);
+}
+
+auto Service::provide(unsigned short first, unsigned n) -> void
+{
+	auto& sqe = next_sqe();
+	sqe.opcode = IORING_OP_PROVIDE_BUFFERS;
+	sqe.fd = static_cast<int>(n);
+	sqe.addr = reinterpret_cast<std::uintptr_t>(buffer(first));
+	sqe.len = static_cast<unsigned>(params.buffer_size);
+	sqe.off = first;
+	sqe.buf_group = buffer_group();
+}
+
+auto Service::provide_recycled() -> void
+{
+	// buffers are given back in runs of adjacent ones
+	std::sort(recycled.begin(), recycled.end());
+	for (auto it = recycled.begin(); it != recycled.end();) {
+		auto last = it + 1;
+		while (last != recycled.end() && *last == *(last - 1) + 1)
+			++last;
+		provide(*it, static_cast<unsigned>(last - it));
+		it = last;
+	}
+	recycled.clear();
+
+	// the receives are submitted after the buffers
+	auto waiters = std::move(buffer_waiters);
+	while (!waiters.empty()) {
+		auto& w = waiters.front();
+		w.unlink();
+		w.buffers_provided();
+	}
+}
+
+auto Service::schedule_flush() noexcept -> void
+{
+	if (flush_scheduled)
+		return;
+	flush_scheduled = true;
+	post(ctx, [this] { flush(); });
+}
+
+auto Service::next_sqe() -> io_uring_sqe&
+{
+	BOOST_ASSERT(!shut_down);
+
+	if (sq.local_tail - load_acquire(sq.head) == sq.entries) {
+		submit();
+		if (sq.local_tail - load_acquire(sq.head) == sq.entries)
+			throw std::runtime_error{ "io_uring: submission queue is full" };
+	}
+
+	const auto index = sq.local_tail & sq.mask;
+	auto& sqe = sq.sqes[index];
+	std::memset(&sqe, 0, sizeof sqe);
+	sq.array[index] = index;
+	++sq.local_tail;
+
+	schedule_flush();
+	return sqe;
+}
+
+auto Service::prepare(Operation& op) -> io_uring_sqe&
+{
+	// a receive is likely to wait for the buffers
+	if (!recycled.empty())
+		provide_recycled();
+
+	auto& sqe = next_sqe();
+	sqe.user_data = reinterpret_cast<std::uintptr_t>(&op);
+	if (!op.is_linked())
+		ops.push_back(op);
+	return sqe;
+}
+
+auto Service::cancel(Operation& op) -> void
+{
+	if (shut_down)
+		return;
+
+	auto& sqe = next_sqe();
+	sqe.opcode = IORING_OP_ASYNC_CANCEL;
+	sqe.addr = reinterpret_cast<std::uintptr_t>(&op);
+	// no user_data: the result is not interesting
+}
+
+auto Service::enter(unsigned to_submit, unsigned flags, unsigned min_complete) -> int
+{
+	int ret;
+	do
+		ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+			nullptr, 0));
+	while (ret < 0 && errno == EINTR);
+	return ret;
+}
+
+auto Service::flush() -> void
+{
+	flush_scheduled = false;
+	// requests completed inline by io_uring_enter do not wake up the reactor
+	while (!shut_down) {
+		if (!recycled.empty())
+			provide_recycled();
+		if (!submit())
+			break;
+		// the kernel refused the submissions: wait for a completion instead of spinning
+		if (!reap() && sq.submitted_tail != sq.local_tail)
+			enter(0, IORING_ENTER_GETEVENTS, 1);
+	}
+}
+
+auto Service::submit() -> bool
+{
+	const auto to_submit = sq.local_tail - sq.submitted_tail;
+	if (to_submit == 0)
+		return false;
+
+	store_release(sq.tail, sq.local_tail);
+	const auto ret = enter(to_submit, 0);
+	if (ret < 0) {
+		// completions have to be reaped first, retry then
+		if (errno == EBUSY || errno == EAGAIN)
+			return true;
+		throw_error(errno, "io_uring_enter");
+	}
+	sq.submitted_tail += static_cast<unsigned>(ret);
+	return true;
+}
+
+auto Service::start_wait() -> void
+{
+	watch->async_wait(boost::asio::posix::stream_descriptor::wait_read,
+		[this](const boost::system::error_code& ec)
+		{
+			if (ec || shut_down)
+				return;
+			start_wait();
+			reap();
+			flush();
+		});
+}
+
+auto Service::reap() -> bool
+{
+	auto reaped = false;
+	for (;;) {
+		auto head = *cq.head;
+		const auto tail = load_acquire(cq.tail);
+		if (head == tail) {
+			if (!(load_acquire(sq.flags) & IORING_SQ_CQ_OVERFLOW))
+				return reaped;
+			enter(0, IORING_ENTER_GETEVENTS);
+			continue;
+		}
+
+		for (; head != tail; ++head) {
+			const auto cqe = cq.cqes[head & cq.mask];
+			store_release(cq.head, head + 1);
+			reaped = true;
+			if (cqe.user_data)
+				reinterpret_cast<Operation*>(cqe.user_data)->complete(cqe.res, cqe.flags);
+			if (shut_down)
+				return reaped;
+		}
+	}
+}
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <boost/asio/execution_context.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/intrusive/list.hpp>
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace uring
+{
+// Request submitted to the ring; its address is user_data of the SQEs
+struct Operation: boost::intrusive::list_base_hook<
+	boost::intrusive::link_mode<boost::intrusive::auto_unlink>>
+{
+	virtual ~Operation() = default;
+
+	virtual void complete(int res, unsigned flags) = 0;
+	// the ring is shut down, no completion will come
+	virtual void abandon() noexcept = 0;
+};
+
+// Receive waiting for provided buffers to be given back to the ring
+struct BufferWaiter: boost::intrusive::list_base_hook<boost::intrusive::tag<BufferWaiter>,
+	boost::intrusive::link_mode<boost::intrusive::auto_unlink>>
+{
+	virtual ~BufferWaiter() = default;
+
+	virtual void buffers_provided() = 0;
+	// the ring is shut down, no buffers will come
+	virtual void abandon_wait() noexcept = 0;
+};
+
+// io_uring instance of an io_context, which has to be run by one thread.
+// Completions are reaped when the ring descriptor becomes readable;
+// submissions are batched and flushed once per handler run.
+class Service: public boost::asio::execution_context::service
+{
+public:
+	struct Params
+	{
+		unsigned entries = 256;
+		unsigned n_buffers = 1024;
+		std::size_t buffer_size = 4096;
+	};
+
+	using key_type = Service;
+	static boost::asio::execution_context::id id;
+
+	explicit Service(boost::asio::execution_context& ctx);
+	Service(boost::asio::execution_context& ctx, const Params& params);
+	~Service() override;
+
+	auto prepare(Operation& op) -> io_uring_sqe&;
+	auto cancel(Operation& op) -> void;
+	auto is_shut_down() const noexcept -> bool { return shut_down; }
+
+	// provided buffers for receive
+	auto buffer_group() const noexcept -> unsigned short { return 0; }
+	auto buffer(unsigned short id) const noexcept -> char*;
+	auto recycle(unsigned short id) noexcept -> void;
+	// the receive is resumed when buffers are recycled, not by the flush loop
+	auto wait_buffers(BufferWaiter& w) noexcept -> void;
+
+private:
+	struct Sq
+	{
+		unsigned* head;
+		unsigned* tail;
+		unsigned mask;
+		unsigned entries;
+		unsigned* array;
+		unsigned* flags;
+		io_uring_sqe* sqes;
+		unsigned local_tail;
+		unsigned submitted_tail;
+	};
+
+	struct Cq
+	{
+		unsigned* head;
+		unsigned* tail;
+		unsigned mask;
+		io_uring_cqe* cqes;
+	};
+
+	auto shutdown() -> void override;
+	auto release() noexcept -> void;
+	auto setup(unsigned entries) -> void;
+	auto setup_buffers() -> void;
+	auto next_sqe() -> io_uring_sqe&;
+	auto provide(unsigned short first, unsigned n) -> void;
+	auto provide_recycled() -> void;
+	auto schedule_flush() noexcept -> void;
+	auto start_wait() -> void;
+	// returns whether there were any completions
+	auto reap() -> bool;
+	auto flush() -> void;
+	auto submit() -> bool;
+	auto enter(unsigned to_submit, unsigned flags, unsigned min_complete = 0) -> int;
+
+	boost::asio::io_context& ctx;
+	const Params params;
+	int fd = -1;
+	void* sq_ring = nullptr;
+	std::size_t sq_ring_size = 0;
+	void* cq_ring = nullptr;
+	std::size_t cq_ring_size = 0;
+	std::size_t sqes_size = 0;
+	Sq sq{};
+	Cq cq{};
+	char* buffers = nullptr;
+	std::vector<unsigned short> recycled;
+	std::optional<boost::asio::posix::stream_descriptor> watch;
+	boost::intrusive::list<Operation, boost::intrusive::constant_time_size<false>> ops;
+	boost::intrusive::list<BufferWaiter, boost::intrusive::base_hook<
+		boost::intrusive::list_base_hook<boost::intrusive::tag<BufferWaiter>,
+			boost::intrusive::link_mode<boost::intrusive::auto_unlink>>>,
+		boost::intrusive::constant_time_size<false>> buffer_waiters;
+	bool flush_scheduled = false;
+	bool shut_down = false;
+};
+}
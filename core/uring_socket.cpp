@@ -0,0 +1,334 @@
+#include "uring_socket.hpp"
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/assert.hpp>
+#include <boost/container/deque.hpp>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+namespace uring
+{
+namespace
+{
+using boost::system::error_code;
+using std::size_t;
+
+auto buffer_id(unsigned flags) noexcept -> unsigned short
+{
+	return static_cast<unsigned short>(flags >> IORING_CQE_BUFFER_SHIFT);
+}
+}
+
+namespace detail
+{
+// Recv of a socket into the provided buffers; outlives the socket until the
+// request is finished. It is armed only for a waiting reader which has got all
+// the data received before, so a paused or slow reader holds one buffer at most
+// and the rest is left to TCP flow control. A multishot recv would fill buffers
+// as long as the peer sends.
+class Receiver final: public Operation, public BufferWaiter
+{
+public:
+	Receiver(Service& service, int fd) noexcept: service{ service }, fd{ fd } {}
+
+	auto read(ReadWaiter& w, error_code& ec, size_t& n) -> bool;
+	void orphan() noexcept;
+
+private:
+	struct Chunk
+	{
+		unsigned short id;
+		unsigned offset;
+		unsigned size;
+	};
+
+	void complete(int res, unsigned flags) override;
+	void abandon() noexcept override;
+	void buffers_provided() override;
+	void abandon_wait() noexcept override;
+	void arm();
+	void resume();
+	auto consume(boost::asio::mutable_buffer buf) noexcept -> size_t;
+
+	Service& service;
+	const int fd;
+	boost::container::deque<Chunk> chunks;
+	error_code error;
+	ReadWaiter* waiter = nullptr;
+	bool armed = false;
+	bool orphaned = false;
+};
+
+auto Receiver::read(ReadWaiter& w, error_code& ec, size_t& n) -> bool
+{
+	BOOST_ASSERT(!waiter);
+
+	if (!chunks.empty()) {
+		n = consume(w.buf);
+		return true;
+	}
+	if (error || service.is_shut_down()) {
+		ec = error ? error : boost::asio::error::operation_aborted;
+		return true;
+	}
+
+	waiter = &w;
+	resume();
+	return false;
+}
+
+void Receiver::orphan() noexcept
+{
+	BOOST_ASSERT(!waiter);
+
+	orphaned = true;
+	if (!service.is_shut_down())
+		for (auto& c : chunks)
+			service.recycle(c.id);
+	chunks.clear();
+
+	if (armed)
+		service.cancel(*this);
+	else
+		delete this;
+}
+
+void Receiver::arm()
+{
+	auto& sqe = service.prepare(*this);
+	sqe.opcode = IORING_OP_RECV;
+	sqe.fd = fd;
+	sqe.flags = IOSQE_BUFFER_SELECT;
+	sqe.buf_group = service.buffer_group();
+	armed = true;
+}
+
+void Receiver::resume()
+{
+	if (waiter && chunks.empty() && !error && !armed && !BufferWaiter::is_linked())
+		arm();
+}
+
+void Receiver::complete(int res, unsigned flags)
+{
+	armed = false;
+	Operation::unlink();
+
+	if (res > 0) {
+		BOOST_ASSERT(flags & IORING_CQE_F_BUFFER);
+		if (orphaned)
+			service.recycle(buffer_id(flags));
+		else
+			chunks.push_back({ buffer_id(flags), 0, static_cast<unsigned>(res) });
+	} else if (res == 0) {
+		error = boost::asio::error::eof;
+	} else if (res == -ENOBUFS) {
+		// not an error: rearming at once would spin, wait for some to be recycled
+		if (!orphaned)
+			service.wait_buffers(*this);
+	} else if (res != -ECANCELED) {
+		error = { -res, boost::system::system_category() };
+	}
+
+	if (orphaned) {
+		delete this;
+		return;
+	}
+
+	if (!waiter)
+		return;
+	if (chunks.empty() && !error) {
+		resume();
+		return;
+	}
+
+	auto w = std::exchange(waiter, nullptr);
+	error_code ec;
+	size_t n = 0;
+	if (!chunks.empty())
+		n = consume(w->buf);
+	else
+		ec = error;
+	// the socket may be destroyed by the handler
+	w->complete(w, ec, n, true);
+}
+
+void Receiver::abandon() noexcept
+{
+	armed = false;
+	chunks.clear();
+	if (orphaned) {
+		delete this;
+		return;
+	}
+	if (auto w = std::exchange(waiter, nullptr))
+		w->complete(w, boost::asio::error::operation_aborted, 0, false);
+}
+
+void Receiver::buffers_provided()
+{
+	resume();
+}
+
+void Receiver::abandon_wait() noexcept
+{
+	abandon();
+}
+
+auto Receiver::consume(boost::asio::mutable_buffer buf) noexcept -> size_t
+{
+	size_t n = 0;
+	while (!chunks.empty() && buf.size() != 0) {
+		auto& c = chunks.front();
+		const auto len = std::min<size_t>(c.size - c.offset, buf.size());
+		std::memcpy(buf.data(), service.buffer(c.id) + c.offset, len);
+		buf += len;
+		n += len;
+		c.offset += static_cast<unsigned>(len);
+		if (c.offset == c.size) {
+			service.recycle(c.id);
+			chunks.pop_front();
+		}
+	}
+	return n;
+}
+}
+
+Socket::Socket(boost::asio::io_context& context, int fd) noexcept:
+	context{ &context },
+	service{ &boost::asio::use_service<Service>(context) },
+	fd{ fd }
+{}
+
+Socket::Socket(Socket&& rhs) noexcept:
+	context{ rhs.context },
+	service{ rhs.service },
+	fd{ std::exchange(rhs.fd, -1) },
+	receiver{ std::exchange(rhs.receiver, nullptr) }
+{}
+
+Socket::~Socket()
+{
+	if (receiver)
+		receiver->orphan();
+	if (fd >= 0)
+		close(fd);
+}
+
+auto Socket::remote_endpoint() const -> boost::asio::ip::tcp::endpoint
+{
+	boost::asio::ip::tcp::endpoint ep;
+	auto len = static_cast<socklen_t>(ep.capacity());
+	if (getpeername(fd, ep.data(), &len) != 0)
+		throw boost::system::system_error{
+			{ errno, boost::system::system_category() }, "remote_endpoint" };
+	ep.resize(len);
+	return ep;
+}
+
+void Socket::shutdown(shutdown_type what, error_code& ec) noexcept
+{
+	ec = {};
+	if (::shutdown(fd, what) != 0)
+		ec = { errno, boost::system::system_category() };
+}
+
+auto Socket::read(detail::ReadWaiter& w, error_code& ec, size_t& n) -> bool
+{
+	if (!receiver)
+		receiver = new detail::Receiver{ *service, fd };
+	return receiver->read(w, ec, n);
+}
+
+class Acceptor::Listener final: public Operation
+{
+public:
+	Listener(boost::asio::io_context& context, int fd, Handler handler) noexcept:
+		context{ context }, fd{ fd }, handler{ std::move(handler) } {}
+	~Listener() override { close(fd); }
+
+	void arm(std::shared_ptr<Listener> self);
+	void orphan() noexcept;
+
+	std::atomic<bool> orphaned = false;
+
+private:
+	void complete(int res, unsigned flags) override;
+	void abandon() noexcept override;
+
+	boost::asio::io_context& context;
+	const int fd;
+	Handler handler;
+	// keeps the listener alive while the request is in the ring
+	std::shared_ptr<Listener> armed;
+};
+
+void Acceptor::Listener::arm(std::shared_ptr<Listener> self)
+{
+	auto& service = boost::asio::use_service<Service>(context);
+	if (orphaned || service.is_shut_down())
+		return;
+
+	auto& sqe = service.prepare(*this);
+	sqe.opcode = IORING_OP_ACCEPT;
+	sqe.fd = fd;
+	sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe.accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	armed = std::move(self);
+}
+
+void Acceptor::Listener::orphan() noexcept
+{
+	if (armed)
+		boost::asio::use_service<Service>(context).cancel(*this);
+}
+
+void Acceptor::Listener::complete(int res, unsigned flags)
+{
+	auto self = armed;
+	if (!(flags & IORING_CQE_F_MORE)) {
+		armed.reset();
+		unlink();
+	}
+
+	if (orphaned) {
+		if (res >= 0)
+			close(res);
+		return;
+	}
+
+	if (res >= 0)
+		handler({}, Socket{ context, res });
+	else if (res != -ECANCELED)
+		handler({ -res, boost::system::system_category() }, Socket{ context, -1 });
+
+	if (!armed)
+		arm(self);
+}
+
+void Acceptor::Listener::abandon() noexcept
+{
+	armed.reset();
+}
+
+Acceptor::Acceptor(boost::asio::io_context& context, int listen_fd, Handler handler):
+	context{ context }
+{
+	// the listening socket may be closed before the request is submitted
+	const auto fd = dup(listen_fd);
+	if (fd < 0)
+		throw boost::system::system_error{ { errno, boost::system::system_category() }, "dup" };
+	listener = std::make_shared<Listener>(context, fd, std::move(handler));
+
+	post(context, [l = listener]() mutable { l->arm(l); });
+}
+
+Acceptor::~Acceptor()
+{
+	listener->orphaned = true;
+	post(context, [l = std::move(listener)] { l->orphan(); });
+}
+}
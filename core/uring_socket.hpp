@@ -0,0 +1,362 @@
+#pragma once
+#include "uring_service.hpp"
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace uring
+{
+namespace detail
+{
+// Operation object allocated with the associated allocator of its handler
+template <typename Op, typename Handler>
+struct OpAllocator
+{
+	using Alloc = typename std::allocator_traits<
+		boost::asio::associated_allocator_t<Handler>>::template rebind_alloc<Op>;
+
+	template <typename H>
+	static Op* make(H&& h)
+	{
+		Alloc a{ boost::asio::get_associated_allocator(h) };
+		auto p = std::allocator_traits<Alloc>::allocate(a, 1);
+		try {
+			return new (p) Op{ Handler{ std::forward<H>(h) } };
+		} catch (...) {
+			std::allocator_traits<Alloc>::deallocate(a, p, 1);
+			throw;
+		}
+	}
+
+	// releases the operation memory before the handler is invoked
+	static Handler take(Op* op) noexcept
+	{
+		Alloc a{ boost::asio::get_associated_allocator(op->h) };
+		Handler h = std::move(op->h);
+		op->~Op();
+		std::allocator_traits<Alloc>::deallocate(a, op, 1);
+		return h;
+	}
+};
+
+// Read request waiting for received data
+struct ReadWaiter
+{
+	using Complete = void (*)(ReadWaiter* self, const boost::system::error_code& ec,
+		std::size_t n, bool invoke);
+
+	explicit ReadWaiter(Complete complete) noexcept: complete{ complete } {}
+
+	boost::asio::mutable_buffer buf;
+	const Complete complete;
+};
+
+template <typename Handler>
+struct ReadOp: ReadWaiter
+{
+	explicit ReadOp(Handler&& h): ReadWaiter{ &do_complete }, h{ std::move(h) } {}
+
+	static void do_complete(ReadWaiter* self, const boost::system::error_code& ec,
+		std::size_t n, bool invoke)
+	{
+		auto h = OpAllocator<ReadOp, Handler>::take(static_cast<ReadOp*>(self));
+		if (invoke)
+			h(ec, n);
+	}
+
+	Handler h;
+};
+
+// Completes a wait by an empty read, keeping the allocator of the handler
+template <typename Handler>
+struct WaitHandler
+{
+	using allocator_type = boost::asio::associated_allocator_t<Handler>;
+
+	allocator_type get_allocator() const noexcept
+	{
+		return boost::asio::get_associated_allocator(h);
+	}
+
+	void operator()(const boost::system::error_code& ec, std::size_t)
+	{
+		h(ec);
+	}
+
+	Handler h;
+};
+
+// Read completed at once, posted with the allocator of the handler
+template <typename Handler>
+struct ReadResult
+{
+	using allocator_type = boost::asio::associated_allocator_t<Handler>;
+
+	allocator_type get_allocator() const noexcept
+	{
+		return boost::asio::get_associated_allocator(h);
+	}
+
+	void operator()()
+	{
+		h(ec, n);
+	}
+
+	Handler h;
+	boost::system::error_code ec;
+	std::size_t n;
+};
+
+class Receiver;
+}
+
+// Connected TCP socket working through the ring of its io_context.
+// Data is received by a recv into the provided buffers of the ring
+// and is copied to the reader buffer, so no buffer is held by idle connection.
+class Socket: boost::noncopyable
+{
+public:
+	using executor_type = boost::asio::io_context::executor_type;
+	using shutdown_type = boost::asio::socket_base::shutdown_type;
+
+	Socket(boost::asio::io_context& context, int fd) noexcept;
+	Socket(Socket&& rhs) noexcept;
+	~Socket();
+
+	executor_type get_executor() noexcept { return context->get_executor(); }
+	bool is_open() const noexcept { return fd >= 0; }
+	auto remote_endpoint() const -> boost::asio::ip::tcp::endpoint;
+	void shutdown(shutdown_type what, boost::system::error_code& ec) noexcept;
+
+	template <typename Handler>
+	void async_read_some(boost::asio::mutable_buffer buf, Handler&& handler);
+	// an empty read: the received data stays in the ring buffers
+	template <typename Handler>
+	void async_wait_read(Handler&& handler);
+
+	template <typename ConstBufferSequence, typename Handler>
+	friend void async_write(Socket& sock, const ConstBufferSequence& buffers, Handler&& handler);
+
+	// sends some bytes of a file, at most the size, when the socket is writable
+	template <typename Handler>
+	void async_send_file_some(int file_fd, std::uint64_t offset, std::size_t size, Handler&& handler);
+
+private:
+	// returns false if the waiter has to wait for data
+	auto read(detail::ReadWaiter& w, boost::system::error_code& ec, std::size_t& n) -> bool;
+
+	boost::asio::io_context* context;
+	Service* service;
+	int fd;
+	detail::Receiver* receiver = nullptr;
+};
+
+namespace detail
+{
+// Sends the whole buffer sequence, IOV_MAX buffers per sendmsg
+template <typename Handler>
+struct WriteOp final: Operation
+{
+	explicit WriteOp(Handler&& h): h{ std::move(h) } {}
+
+	template <typename ConstBufferSequence>
+	void start(Service& s, int sock_fd, const ConstBufferSequence& buffers)
+	{
+		service = &s;
+		fd = sock_fd;
+		for (auto it = boost::asio::buffer_sequence_begin(buffers);
+				it != boost::asio::buffer_sequence_end(buffers); ++it) {
+			const boost::asio::const_buffer b{ *it };
+			if (b.size() != 0)
+				iov.push_back({ const_cast<void*>(b.data()), b.size() });
+		}
+		// an empty sequence goes as a SENDMSG of no iovecs, which completes
+		// with zero bytes, so that the handler is still called asynchronously
+		submit();
+	}
+
+	void submit()
+	{
+		msg.msg_iov = iov.data() + done_iov;
+		msg.msg_iovlen = std::min<std::size_t>(iov.size() - done_iov, IOV_MAX);
+		auto& sqe = service->prepare(*this);
+		sqe.opcode = IORING_OP_SENDMSG;
+		sqe.fd = fd;
+		sqe.addr = reinterpret_cast<std::uintptr_t>(&msg);
+		sqe.msg_flags = MSG_NOSIGNAL;
+	}
+
+	void complete(int res, unsigned) override
+	{
+		unlink();
+		if (res < 0)
+			return finish({ -res, boost::system::system_category() }, sent);
+
+		auto n = static_cast<std::size_t>(res);
+		sent += n;
+		while (done_iov != iov.size() && n >= iov[done_iov].iov_len)
+			n -= iov[done_iov++].iov_len;
+		if (done_iov == iov.size())
+			return finish({}, sent);
+
+		auto& rest = iov[done_iov];
+		rest.iov_base = static_cast<char*>(rest.iov_base) + n;
+		rest.iov_len -= n;
+		submit();
+	}
+
+	void abandon() noexcept override
+	{
+		OpAllocator<WriteOp, Handler>::take(this);
+	}
+
+	void finish(const boost::system::error_code& ec, std::size_t n)
+	{
+		auto handler = OpAllocator<WriteOp, Handler>::take(this);
+		handler(ec, n);
+	}
+
+	Handler h;
+	Service* service = nullptr;
+	int fd = -1;
+	boost::container::small_vector<iovec, 16> iov;
+	std::size_t done_iov = 0;
+	std::size_t sent = 0;
+	msghdr msg{};
+};
+
+// The ring has no sendfile: the socket is polled for room, then sendfile is called
+template <typename Handler>
+struct SendFileOp final: Operation
+{
+	explicit SendFileOp(Handler&& h): h{ std::move(h) } {}
+
+	void submit()
+	{
+		auto& sqe = service->prepare(*this);
+		sqe.opcode = IORING_OP_POLL_ADD;
+		sqe.fd = fd;
+		sqe.poll32_events = POLLOUT;
+	}
+
+	void complete(int res, unsigned) override
+	{
+		unlink();
+		if (res < 0)
+			return finish({ -res, boost::system::system_category() }, 0);
+
+		auto off = static_cast<off_t>(offset);
+		const auto n = ::sendfile(fd, file_fd, &off, size);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return submit();
+		if (n < 0)
+			return finish({ errno, boost::system::system_category() }, 0);
+		// the file is shorter than it was
+		if (n == 0)
+			return finish(boost::asio::error::eof, 0);
+		finish({}, static_cast<std::size_t>(n));
+	}
+
+	void abandon() noexcept override
+	{
+		OpAllocator<SendFileOp, Handler>::take(this);
+	}
+
+	void finish(const boost::system::error_code& ec, std::size_t n)
+	{
+		auto handler = OpAllocator<SendFileOp, Handler>::take(this);
+		handler(ec, n);
+	}
+
+	Handler h;
+	Service* service = nullptr;
+	int fd = -1;
+	int file_fd = -1;
+	std::uint64_t offset = 0;
+	std::size_t size = 0;
+};
+}
+
+template <typename Handler>
+void Socket::async_read_some(boost::asio::mutable_buffer buf, Handler&& handler)
+{
+	using Op = detail::ReadOp<std::decay_t<Handler>>;
+	using Alloc = detail::OpAllocator<Op, std::decay_t<Handler>>;
+
+	auto op = Alloc::make(std::forward<Handler>(handler));
+	op->buf = buf;
+	boost::system::error_code ec;
+	std::size_t n = 0;
+	if (!read(*op, ec, n))
+		return;
+
+	// completed immediately: the handler should not be run from the initiating function
+	post(*context, detail::ReadResult<std::decay_t<Handler>>{ Alloc::take(op), ec, n });
+}
+
+template <typename Handler>
+void Socket::async_wait_read(Handler&& handler)
+{
+	async_read_some(boost::asio::mutable_buffer{},
+		detail::WaitHandler<std::decay_t<Handler>>{ std::forward<Handler>(handler) });
+}
+
+template <typename ConstBufferSequence, typename Handler>
+void async_write(Socket& sock, const ConstBufferSequence& buffers, Handler&& handler)
+{
+	using Op = detail::WriteOp<std::decay_t<Handler>>;
+
+	auto op = detail::OpAllocator<Op, std::decay_t<Handler>>::make(std::forward<Handler>(handler));
+	op->start(*sock.service, sock.fd, buffers);
+}
+
+template <typename Handler>
+void Socket::async_send_file_some(int file_fd, std::uint64_t offset, std::size_t size, Handler&& handler)
+{
+	using Op = detail::SendFileOp<std::decay_t<Handler>>;
+
+	auto op = detail::OpAllocator<Op, std::decay_t<Handler>>::make(std::forward<Handler>(handler));
+	op->service = service;
+	op->fd = fd;
+	op->file_fd = file_fd;
+	op->offset = offset;
+	op->size = size;
+	op->submit();
+}
+
+// Multishot accept on a listening socket
+class Acceptor: boost::noncopyable
+{
+public:
+	using Handler = std::function<void(const boost::system::error_code& ec, Socket sock)>;
+
+	// may be created and destroyed from any thread
+	Acceptor(boost::asio::io_context& context, int listen_fd, Handler handler);
+	~Acceptor();
+
+private:
+	class Listener;
+
+	boost::asio::io_context& context;
+	std::shared_ptr<Listener> listener;
+};
+}
@@ -0,0 +1,101 @@
+#include "byte_ranges.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace http
+{
+namespace
+{
+constexpr auto max_position = std::numeric_limits<std::uint64_t>::max();
+
+auto is_space(char c) noexcept -> bool
+{
+	return c == ' ' || c == '\t';
+}
+
+auto trim(string_view s) noexcept -> string_view
+{
+	while (!s.empty() && is_space(s.front()))
+		s.remove_prefix(1);
+	while (!s.empty() && is_space(s.back()))
+		s.remove_suffix(1);
+	return s;
+}
+
+// a too large number is taken as the largest
+auto parse_position(string_view s) noexcept -> std::optional<std::uint64_t>
+{
+	if (s.empty())
+		return {};
+	std::uint64_t n = 0;
+	for (auto c : s) {
+		if (c < '0' || c > '9')
+			return {};
+		const auto digit = static_cast<std::uint64_t>(c - '0');
+		n = n > (max_position - digit) / 10 ? max_position : n * 10 + digit;
+	}
+	return n;
+}
+
+auto is_bytes_unit(string_view s) noexcept -> bool
+{
+	constexpr auto unit = "bytes"sv;
+	return s.size() == unit.size() && std::equal(s.begin(), s.end(), unit.begin(),
+		[](char c, char u) { return (c | 0x20) == u; });
+}
+}
+
+auto parse_ranges(string_view value, std::uint64_t size, std::size_t max_ranges)
+	-> std::optional<ByteRanges>
+{
+	value = trim(value);
+	const auto eq = value.find('=');
+	if (eq == string_view::npos || !is_bytes_unit(value.substr(0, eq)))
+		return {};
+
+	// built in place: moving a small vector copies its inline elements
+	std::optional<ByteRanges> result{ std::in_place };
+	auto& ranges = *result;
+	std::size_t n_specs = 0;
+	auto specs = value.substr(eq + 1);
+	while (!specs.empty()) {
+		const auto comma = specs.find(',');
+		const auto spec = trim(specs.substr(0, comma));
+		specs = comma == string_view::npos ? string_view{} : specs.substr(comma + 1);
+		// empty elements of a list are allowed
+		if (spec.empty())
+			continue;
+		if (++n_specs > max_ranges)
+			return {};
+
+		const auto dash = spec.find('-');
+		if (dash == string_view::npos)
+			return {};
+		const auto first = spec.substr(0, dash);
+		const auto last = parse_position(spec.substr(dash + 1));
+		if (first.empty()) {
+			// the suffix of the length
+			if (!last)
+				return {};
+			if (*last != 0 && size != 0)
+				ranges.push_back({ size - std::min(*last, size), std::min(*last, size) });
+			continue;
+		}
+
+		const auto from = parse_position(first);
+		if (!from || (dash + 1 != spec.size() && !last) || (last && *last < *from))
+			return {};
+		if (*from >= size)
+			continue;
+		const auto to = last ? std::min(*last, size - 1) : size - 1;
+		ranges.push_back({ *from, to - *from + 1 });
+	}
+	if (!n_specs)
+		return {};
+	std::uint64_t total = 0;
+	for (auto r : ranges)
+		if ((total += r.size) > size)
+			return {};
+	return result;
+}
+}
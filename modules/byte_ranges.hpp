@@ -0,0 +1,30 @@
+#pragma once
+#include "string_view.hpp"
+#include <boost/container/small_vector.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace http
+{
+struct ByteRange
+{
+	std::uint64_t first;
+	std::uint64_t size;
+
+	bool operator==(const ByteRange& rhs) const noexcept
+	{
+		return first == rhs.first && size == rhs.size;
+	}
+};
+
+using ByteRanges = boost::container::small_vector<ByteRange, 4>;
+
+// The ranges of a Range header value within a representation of the size.
+// None if the header is to be ignored: its unit is not bytes, its syntax is
+// wrong, it has more than the maximum of ranges, or they overlap so much that
+// they sum up to more than the whole. Empty if no range is satisfiable.
+// A range past the end is cut there.
+auto parse_ranges(string_view value, std::uint64_t size, std::size_t max_ranges)
+	-> std::optional<ByteRanges>;
+}
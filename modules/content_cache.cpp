@@ -0,0 +1,161 @@
+#include "content_cache.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+
+namespace
+{
+// files expected in a shard of that size
+auto n_items(std::size_t size) noexcept -> std::size_t
+{
+	constexpr std::size_t typical_file_size = 4 * 1024;
+	return std::max<std::size_t>(size / typical_file_size, 64);
+}
+
+auto round_up_to_power_of_2(std::size_t n) noexcept -> std::size_t
+{
+	std::size_t p = 1;
+	while (p < n)
+		p *= 2;
+	return p;
+}
+
+// the whole file, or nothing if it is not of the size any more
+auto read_file(const OpenFileCache::File& file) -> std::shared_ptr<ContentCache::Content>
+{
+	auto content = std::make_shared<ContentCache::Content>(file.size, '\0');
+	std::size_t done = 0;
+	while (done < content->size()) {
+		const auto n = ::pread(file.fd, content->data() + done, content->size() - done,
+			static_cast<off_t>(done));
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return nullptr;
+		done += static_cast<std::size_t>(n);
+	}
+	return content;
+}
+}
+
+ContentCache::Sketch::Sketch(std::size_t n_items):
+	counters(n_rows * round_up_to_power_of_2(n_items)),
+	mask{ round_up_to_power_of_2(n_items) - 1 },
+	sample_size{ 10 * (mask + 1) }
+{}
+
+auto ContentCache::Sketch::add(std::size_t hash) noexcept -> void
+{
+	for (std::size_t row = 0; row < n_rows; ++row) {
+		auto& c = counters[index(hash, row)];
+		if (c < max_count)
+			++c;
+	}
+	if (++n_added == sample_size)
+		age();
+}
+
+auto ContentCache::Sketch::frequency(std::size_t hash) const noexcept -> unsigned
+{
+	unsigned f = max_count;
+	for (std::size_t row = 0; row < n_rows; ++row)
+		f = std::min<unsigned>(f, counters[index(hash, row)]);
+	return f;
+}
+
+auto ContentCache::Sketch::index(std::size_t hash, std::size_t row) const noexcept -> std::size_t
+{
+	// a different mix of the hash for every row
+	std::uint64_t x = hash + (row + 1) * 0x9e3779b97f4a7c15u;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9u;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebu;
+	x ^= x >> 31;
+	return row * (mask + 1) + (static_cast<std::size_t>(x) & mask);
+}
+
+auto ContentCache::Sketch::age() noexcept -> void
+{
+	for (auto& c : counters)
+		c /= 2;
+	n_added /= 2;
+}
+
+ContentCache::ContentCache(const Params& params):
+	params{ params },
+	max_shard_size{ params.max_size / n_shards }
+{
+	if (!max_shard_size)
+		return;
+	shards.reserve(n_shards);
+	for (std::size_t i = 0; i < n_shards; ++i)
+		shards.push_back(std::make_unique<Shard>(n_items(max_shard_size)));
+}
+
+auto ContentCache::get(string_view path, const OpenFileCache::File& file) -> std::shared_ptr<const Content>
+{
+	if (shards.empty() || file.error || file.size > std::min(params.max_file_size, max_shard_size))
+		return nullptr;
+
+	const auto hash = std::hash<string_view>{}(path);
+	auto& s = *shards[hash % shards.size()];
+	const auto size = static_cast<std::size_t>(file.size);
+	{
+		std::lock_guard lock{ s.mutex };
+		s.sketch.add(hash);
+		if (auto it = s.index.find(path); it != s.index.end()) {
+			auto entry = it->second;
+			if (entry->file_id == file.id) {
+				s.lru.splice(s.lru.begin(), s.lru, entry);
+				return entry->content;
+			}
+			// the file has been opened again since
+			erase(s, entry);
+		}
+		if (!admits(s, hash, size))
+			return nullptr;
+	}
+
+	auto content = read_file(file);
+	if (!content)
+		return nullptr;
+
+	std::lock_guard lock{ s.mutex };
+	if (s.index.count(path))
+		return content;
+	while (s.size + size > max_shard_size)
+		erase(s, std::prev(s.lru.end()));
+	s.lru.push_front({ std::string{ path }, hash, file.id, content });
+	s.index.emplace(s.lru.front().path, s.lru.begin());
+	s.size += size;
+	return content;
+}
+
+auto ContentCache::size() const -> std::size_t
+{
+	std::size_t n = 0;
+	for (auto& s : shards) {
+		std::lock_guard lock{ s->mutex };
+		n += s->size;
+	}
+	return n;
+}
+
+auto ContentCache::admits(const Shard& s, std::size_t hash, std::size_t size) const noexcept -> bool
+{
+	const auto frequency = s.sketch.frequency(hash);
+	auto room = max_shard_size - s.size;
+	for (auto it = s.lru.rbegin(); room < size; ++it) {
+		if (s.sketch.frequency(it->hash) >= frequency)
+			return false;
+		room += it->content->size();
+	}
+	return true;
+}
+
+auto ContentCache::erase(Shard& s, std::list<Entry>::iterator it) noexcept -> void
+{
+	s.size -= it->content->size();
+	s.index.erase(it->path);
+	s.lru.erase(it);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "open_file_cache.hpp"
+#include "string_view.hpp"
+#include <boost/core/noncopyable.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Contents of small files in memory, shared read-only by all the threads.
+// The memory is limited by the sum of the sizes. A file is admitted by
+// TinyLFU: when others have to be evicted for it, it has to be used more
+// often than each of them. Frequencies are approximated by a count-min
+// sketch, which is halved after a number of uses to forget the old ones.
+// A content belongs to one open file of the open file cache, and so it is
+// stale once inotify has made the open file cache drop that file.
+class ContentCache: boost::noncopyable
+{
+public:
+	struct Params
+	{
+		// no caching if zero
+		std::size_t max_size = 32 * 1024 * 1024;
+		std::size_t max_file_size = 64 * 1024;
+	};
+
+	using Content = std::string;
+
+	explicit ContentCache(const Params& params);
+
+	// the content of the open file, or null if it is not kept
+	auto get(string_view path, const OpenFileCache::File& file) -> std::shared_ptr<const Content>;
+
+	// the sum of the cached sizes
+	auto size() const -> std::size_t;
+
+private:
+	struct Entry
+	{
+		std::string path;
+		std::size_t hash;
+		std::uint64_t file_id;
+		std::shared_ptr<const Content> content;
+	};
+
+	class Sketch
+	{
+	public:
+		explicit Sketch(std::size_t n_items);
+
+		auto add(std::size_t hash) noexcept -> void;
+		auto frequency(std::size_t hash) const noexcept -> unsigned;
+
+	private:
+		static constexpr std::size_t n_rows = 4;
+		static constexpr std::uint8_t max_count = 15;
+
+		auto index(std::size_t hash, std::size_t row) const noexcept -> std::size_t;
+		auto age() noexcept -> void;
+
+		std::vector<std::uint8_t> counters;
+		const std::size_t mask;
+		const std::size_t sample_size;
+		std::size_t n_added = 0;
+	};
+
+	struct Shard
+	{
+		explicit Shard(std::size_t n_items): sketch{ n_items } {}
+
+		mutable std::mutex mutex;
+		// the most recently used first
+		std::list<Entry> lru;
+		// keys refer to the paths of the entries
+		std::unordered_map<string_view, std::list<Entry>::iterator> index;
+		std::size_t size = 0;
+		Sketch sketch;
+	};
+
+	static constexpr std::size_t n_shards = 16;
+
+	auto admits(const Shard& s, std::size_t hash, std::size_t size) const noexcept -> bool;
+	auto erase(Shard& s, std::list<Entry>::iterator it) noexcept -> void;
+
+	const Params params;
+	const std::size_t max_shard_size;
+	std::vector<std::unique_ptr<Shard>> shards;
+};
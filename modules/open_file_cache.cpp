@@ -0,0 +1,248 @@
+#include "open_file_cache.hpp"
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+#include <system_error>
+
+namespace
+{
+constexpr std::uint32_t watch_mask = IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+	| IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// the answer stays the same until the file system changes
+auto is_lasting(int error) noexcept -> bool
+{
+	return error == 0 || error == ENOENT || error == ENOTDIR || error == EACCES
+		|| error == EISDIR || error == EINVAL;
+}
+
+auto dir_name(string_view path) -> std::string
+{
+	const auto slash = path.rfind('/');
+	if (slash == string_view::npos)
+		return ".";
+	return std::string{ path.substr(0, slash == 0 ? 1 : slash) };
+}
+
+std::atomic<std::uint64_t> last_id = 0;
+
+auto open_file(const std::string& path) -> std::shared_ptr<OpenFileCache::File>
+{
+	auto f = std::make_shared<OpenFileCache::File>();
+	f->id = ++last_id;
+	f->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if (f->fd < 0 || ::fstat(f->fd, &st) != 0) {
+		f->error = errno;
+		return f;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		f->error = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+		return f;
+	}
+	f->size = static_cast<std::uint64_t>(st.st_size);
+	f->mtime = st.st_mtim;
+	f->inode = st.st_ino;
+	return f;
+}
+}
+
+OpenFileCache::File::~File()
+{
+	if (fd >= 0)
+		::close(fd);
+}
+
+OpenFileCache::OpenFileCache(const Params& params):
+	params{ params },
+	max_shard_entries{ std::max<std::size_t>(params.max_entries / max_shards, 1) },
+	shards(std::min(params.max_entries, max_shards))
+{
+	if (!params.max_entries)
+		return;
+	// without inotify the entries are just checked after the validity time
+	inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd < 0)
+		return;
+	stop_fd = ::eventfd(0, EFD_CLOEXEC);
+	if (stop_fd < 0) {
+		::close(inotify_fd);
+		throw std::system_error{ errno, std::system_category(), "eventfd" };
+	}
+	watcher = std::thread{ [this] { run_watcher(); } };
+}
+
+OpenFileCache::~OpenFileCache()
+{
+	if (watcher.joinable()) {
+		const std::uint64_t one = 1;
+		[[maybe_unused]] auto n = ::write(stop_fd, &one, sizeof one);
+		watcher.join();
+	}
+	if (stop_fd >= 0)
+		::close(stop_fd);
+	if (inotify_fd >= 0)
+		::close(inotify_fd);
+}
+
+auto OpenFileCache::open(string_view path) -> std::shared_ptr<const File>
+{
+	if (shards.empty())
+		return open_file(std::string{ path });
+
+	auto& s = shard(path);
+	const auto now = Clock::now();
+	{
+		std::lock_guard lock{ s.mutex };
+		if (auto it = s.index.find(path); it != s.index.end()) {
+			auto entry = it->second;
+			if (entry->valid_until > now) {
+				s.lru.splice(s.lru.begin(), s.lru, entry);
+				return entry->file;
+			}
+			erase(s, entry);
+		}
+	}
+
+	// the directory is watched first, so that no change after the open is missed
+	std::string key{ path };
+	const auto wd = watch(dir_name(key));
+	const auto n_seen = n_changes.load();
+	auto file = open_file(key);
+	if (!is_lasting(file->error)) {
+		unwatch(wd);
+		return file;
+	}
+
+	std::lock_guard lock{ s.mutex };
+	if (n_seen != n_changes.load() || s.index.count(path)) {
+		unwatch(wd);
+		return file;
+	}
+	s.lru.push_front({ move(key), file, now + params.valid, wd });
+	s.index.emplace(s.lru.front().path, s.lru.begin());
+	if (s.lru.size() > max_shard_entries)
+		erase(s, std::prev(s.lru.end()));
+	return file;
+}
+
+auto OpenFileCache::size() const -> std::size_t
+{
+	std::size_t n = 0;
+	for (auto& s : shards) {
+		std::lock_guard lock{ s.mutex };
+		n += s.lru.size();
+	}
+	return n;
+}
+
+auto OpenFileCache::shard(string_view path) -> Shard&
+{
+	return shards[std::hash<string_view>{}(path) % shards.size()];
+}
+
+auto OpenFileCache::watch(const std::string& path) -> int
+{
+	if (inotify_fd < 0)
+		return -1;
+	// under the lock, so that the watch is not removed by another thread meanwhile
+	std::lock_guard lock{ dirs_mutex };
+	const auto wd = ::inotify_add_watch(inotify_fd, path.c_str(), watch_mask);
+	if (wd < 0)
+		return -1;
+	auto& dir = dirs[wd];
+	// one directory may be named in several ways
+	if (std::find(dir.paths.begin(), dir.paths.end(), path) == dir.paths.end())
+		dir.paths.push_back(path);
+	++dir.n_entries;
+	return wd;
+}
+
+auto OpenFileCache::unwatch(int wd) noexcept -> void
+{
+	if (wd < 0)
+		return;
+	std::lock_guard lock{ dirs_mutex };
+	auto it = dirs.find(wd);
+	// the directory may be gone already
+	if (it == dirs.end() || --it->second.n_entries)
+		return;
+	::inotify_rm_watch(inotify_fd, wd);
+	dirs.erase(it);
+}
+
+auto OpenFileCache::erase(Shard& s, std::list<Entry>::iterator it) noexcept -> void
+{
+	unwatch(it->wd);
+	s.index.erase(it->path);
+	s.lru.erase(it);
+}
+
+auto OpenFileCache::invalidate(const std::string& path) -> void
+{
+	++n_changes;
+	auto& s = shard(path);
+	std::lock_guard lock{ s.mutex };
+	if (auto it = s.index.find(path); it != s.index.end())
+		erase(s, it->second);
+}
+
+auto OpenFileCache::clear() -> void
+{
+	++n_changes;
+	for (auto& s : shards) {
+		std::lock_guard lock{ s.mutex };
+		while (!s.lru.empty())
+			erase(s, s.lru.begin());
+	}
+}
+
+auto OpenFileCache::run_watcher() -> void
+{
+	alignas(inotify_event) char events[4096];
+	pollfd fds[] = { { inotify_fd, POLLIN, 0 }, { stop_fd, POLLIN, 0 } };
+	while (true) {
+		if (::poll(fds, 2, -1) < 0 && errno != EINTR)
+			return clear();
+		if (fds[1].revents)
+			return;
+		const auto n = ::read(inotify_fd, events, sizeof events);
+		if (n > 0)
+			handle_events(events, static_cast<std::size_t>(n));
+	}
+}
+
+auto OpenFileCache::handle_events(const char* events, std::size_t size) -> void
+{
+	for (std::size_t pos = 0; pos < size; ) {
+		const auto& e = *reinterpret_cast<const inotify_event*>(events + pos);
+		pos += sizeof(inotify_event) + e.len;
+
+		std::vector<std::string> paths;
+		bool is_watched = false;
+		{
+			std::lock_guard lock{ dirs_mutex };
+			if (auto it = dirs.find(e.wd); it != dirs.end()) {
+				paths = it->second.paths;
+				is_watched = true;
+				// removed by the system
+				if (e.mask & IN_IGNORED)
+					dirs.erase(it);
+			}
+		}
+
+		// events lost, or the directory itself has changed
+		if ((e.mask & IN_Q_OVERFLOW) || (is_watched && (e.len == 0 || (e.mask & IN_IGNORED)))) {
+			clear();
+			continue;
+		}
+		for (auto& dir : paths)
+			invalidate(dir + (dir.back() == '/' ? "" : "/") + e.name);
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "string_view.hpp"
+#include <boost/core/noncopyable.hpp>
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Open descriptors and metadata of files by their paths, like open_file_cache
+// of nginx. A file which is missing or not a regular one is remembered too.
+// The least recently used entries of a shard are evicted over the limit.
+// An entry is dropped when inotify reports a change in its directory, and is
+// checked again after the validity time anyway, for the changes inotify misses.
+class OpenFileCache: boost::noncopyable
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Params
+	{
+		// no caching if zero
+		std::size_t max_entries = 10000;
+		Clock::duration valid = std::chrono::seconds{ 60 };
+	};
+
+	// the descriptor is closed when the last user releases it
+	struct File: boost::noncopyable
+	{
+		~File();
+
+		// tells apart the files opened by one path, as each open makes a new one
+		std::uint64_t id = 0;
+		int fd = -1;
+		// errno of the failed open, or EISDIR for a directory and EINVAL for other types
+		int error = 0;
+		std::uint64_t size = 0;
+		std::timespec mtime{};
+		ino_t inode = 0;
+	};
+
+	explicit OpenFileCache(const Params& params);
+	~OpenFileCache();
+
+	// a failure is returned as the error of the file
+	auto open(string_view path) -> std::shared_ptr<const File>;
+
+	auto size() const -> std::size_t;
+
+private:
+	struct Entry
+	{
+		std::string path;
+		std::shared_ptr<const File> file;
+		Clock::time_point valid_until;
+		// of the directory, or -1
+		int wd;
+	};
+
+	struct Shard
+	{
+		mutable std::mutex mutex;
+		// the most recently used first
+		std::list<Entry> lru;
+		// keys refer to the paths of the entries
+		std::unordered_map<string_view, std::list<Entry>::iterator> index;
+	};
+
+	// spellings of a watched directory path, and the entries in it
+	struct Dir
+	{
+		std::vector<std::string> paths;
+		std::size_t n_entries = 0;
+	};
+
+	static constexpr std::size_t max_shards = 16;
+
+	auto shard(string_view path) -> Shard&;
+	auto watch(const std::string& path) -> int;
+	auto unwatch(int wd) noexcept -> void;
+	auto erase(Shard& s, std::list<Entry>::iterator it) noexcept -> void;
+	auto invalidate(const std::string& path) -> void;
+	auto clear() -> void;
+	auto run_watcher() -> void;
+	auto handle_events(const char* events, std::size_t size) -> void;
+
+	const Params params;
+	const std::size_t max_shard_entries;
+	std::vector<Shard> shards;
+	// changes seen, so that a file opened before a change is not cached after it
+	std::atomic<std::uint64_t> n_changes = 0;
+	int inotify_fd = -1;
+	int stop_fd = -1;
+	std::mutex dirs_mutex;
+	std::unordered_map<int, Dir> dirs;
+	std::thread watcher;
+};
@@ -1,29 +1,74 @@
 #include "static_file.hpp"
 #include "arena.hpp"
+#include "byte_ranges.hpp"
 #include "config.hpp"
+#include "content_cache.hpp"
 #include "http_error.hpp"
 #include "http_message.hpp"
 #include "http_request_handler.hpp"
 #include "logger.hpp"
+#include "open_file_cache.hpp"
 #include "string.hpp"
 #include "string_builder.hpp"
 #include "string_view.hpp"
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
 
-//TODO chunked send
-//TODO caching
-//TODO Linux sendfile?
+using namespace std::string_literals;
 
 namespace http
 {
 namespace
 {
-const std::fstream::pos_type max_size = 100 * 1024 * 1024;
+using Content = ContentCache::Content;
+using File = OpenFileCache::File;
+using Known = Request::Header::Known;
+
+// the boundaries of the parts of different responses differ
+std::atomic<std::uint64_t> n_multiparts = 0;
+
+auto copy(Arena& a, string_view s) -> string_view
+{
+	auto p = static_cast<char*>(a.aligned_alloc(1, s.size(), "StaticFile header"));
+	std::copy(s.begin(), s.end(), p);
+	return { p, s.size() };
+}
+
+// as an IMF-fixdate of HTTP
+auto http_date(const std::timespec& t, Arena& a) -> string_view
+{
+	static constexpr const char* days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static constexpr const char* months[] = {
+		"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	std::tm tm;
+	if (!gmtime_r(&t.tv_sec, &tm))
+		return {};
+	char buf[32];
+	const auto n = std::snprintf(buf, sizeof buf, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+		days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+	return copy(a, { buf, static_cast<std::size_t>(n) });
+}
+
+auto content_range(ByteRange r, std::uint64_t size) -> std::string
+{
+	return "bytes " + std::to_string(r.first) + "-" + std::to_string(r.first + r.size - 1)
+		+ "/" + std::to_string(size);
+}
 
 struct RhStaticFile : RequestHandler
 {
-	explicit RhStaticFile(std::string root)
-		: www_dir{move(root)}
+	RhStaticFile(std::string root, const OpenFileCache::Params& cache_params,
+			const ContentCache::Params& content_params, std::size_t max_ranges)
+		: www_dir{move(root)}, cache{cache_params}, contents{content_params}, max_ranges{max_ranges}
 	{}
 	
 	auto get_name() const noexcept -> string_view override
@@ -33,56 +78,142 @@ struct RhStaticFile : RequestHandler
 
 	auto get(Request& req, Response& resp, Context& ctx) -> void override
 	{
-		auto [f, length] = open_file(req, ctx);
+		const auto fname = file_name(req, ctx);
+		auto f = open_file(fname, ctx);
+		auto content = contents.get(fname, *f);
+		const auto modified = http_date(f->mtime, ctx.a);
 
-		f.seekg(0, std::ios::beg);
-		auto body_mem = ctx.a.alloc(length, "StaticFile buffer");
-		auto buffer = static_cast<char*>(body_mem);
-		f.read(buffer, length);
+		std::optional<ByteRanges> ranges;
+		// a range of another version of the file is not sent
+		if (auto range = req.header(Known::range); range && max_ranges) {
+			auto if_range = req.header(Known::if_range);
+			if (!if_range || (!modified.empty() && if_range->value == modified))
+				ranges = parse_ranges(range->value, f->size, max_ranges);
+		}
 
-		resp.body.emplace_back(buffer, length);
-		finalize(req, resp, ctx, length);
+		const auto size = f->size;
+		if (!ranges) {
+			send_part(resp, f, content, { 0, size });
+			finalize(req, resp, ctx, size, modified);
+		} else if (ranges->empty()) {
+			not_satisfiable(req, resp, ctx, size);
+		} else if (ranges->size() == 1) {
+			const auto r = ranges->front();
+			ctx.lg.debug("range: "sv, r.first, ", size: "sv, r.size);
+			send_part(resp, f, content, r);
+			resp.headers.emplace_back("Content-Range"sv, copy(ctx.a, content_range(r, size)));
+			finalize(req, resp, ctx, r.size, modified);
+			resp.code = Response::Status::partial_content;
+		} else {
+			const auto length = send_parts(resp, ctx, f, move(content), *ranges);
+			finalize(req, resp, ctx, length, modified);
+			resp.code = Response::Status::partial_content;
+		}
 	}
 	
 	auto head(Request& req, Response& resp, Context& ctx) -> void override
 	{
-		auto length = open_file(req, ctx).second;
-		finalize(req, resp, ctx, length);
+		auto f = open_file(file_name(req, ctx), ctx);
+		finalize(req, resp, ctx, f->size, http_date(f->mtime, ctx.a));
 	}
 
 private:
-	auto open_file(const Request& req, const Context& ctx) const -> std::pair<std::ifstream, std::size_t>
+	auto file_name(const Request& req, const Context& ctx) const -> lemon::String
 	{
 		const auto path = req.url.path;
 		lemon::String fname{ www_dir.begin(), www_dir.end(), ctx.a.make_allocator<char>() };
 		fname.append(path.begin(), path.end());
+		return fname;
+	}
 
-		//TODO consider other IO APIs
-		std::ifstream f{ fname.c_str(), std::ios::in | std::ios::binary | std::ios::ate };
-		if (!f.is_open())
+	auto open_file(const lemon::String& fname, const Context& ctx) -> std::shared_ptr<const File>
+	{
+		auto f = cache.open(fname);
+		if (f->error)
 			throw Exception{ Response::Status::not_found };
-		f.exceptions(std::ios::badbit | std::ios::failbit);
+		ctx.lg.debug("open file: '"sv, fname, "', size: "sv, f->size);
+		return f;
+	}
 
-		//TODO size from metadata
-		auto size = f.tellg();
-		ctx.lg.debug("open file: '"sv, fname, "', size: "sv, size);
-		if (size > max_size)
-			throw Exception{ Response::Status::payload_too_large };
-		auto mem_length = static_cast<std::size_t>(size);
+	static auto send_part(Response& resp, std::shared_ptr<const File>& f,
+		std::shared_ptr<const Content>& content, ByteRange r) -> void
+	{
+		if (content) {
+			// a small file used often is sent from the memory
+			resp.body.emplace_back(string_view{ *content }.substr(r.first, r.size));
+			resp.body_owner = move(content);
+		} else {
+			// the body is sent from the file by the kernel
+			resp.set_file({ f->fd, r.first, r.size, move(f) });
+		}
+	}
+
+	// multipart/byteranges, with the ranges sent from the file by the kernel
+	// as parts of it; returns the length
+	static auto send_parts(Response& resp, Context& ctx, std::shared_ptr<const File>& f,
+		std::shared_ptr<const Content> content, const ByteRanges& ranges) -> std::uint64_t
+	{
+		char boundary[21];
+		std::snprintf(boundary, sizeof boundary, "%020llu", static_cast<unsigned long long>(++n_multiparts));
+		const std::string delimiter = "\r\n--"s + boundary;
+		resp.headers.emplace_back("Content-Type"sv,
+			copy(ctx.a, "multipart/byteranges; boundary="s + boundary));
 
-		return { move(f), mem_length };
+		const auto size = f->size;
+		std::uint64_t length = 0;
+		for (auto& r : ranges) {
+			const auto part_head = copy(ctx.a,
+				delimiter + "\r\nContent-Range: "s + content_range(r, size) + "\r\n\r\n"s);
+			length += part_head.size() + r.size;
+			if (content) {
+				resp.body.push_back(part_head);
+				resp.body.push_back(string_view{ *content }.substr(r.first, r.size));
+			} else if (&r == &ranges.front()) {
+				resp.body.push_back(part_head);
+				resp.set_file({ f->fd, r.first, r.size, f });
+			} else {
+				resp.file_parts.push_back({ part_head, r.first, r.size });
+			}
+		}
+		const auto close = copy(ctx.a, delimiter + "--\r\n"s);
+		length += close.size();
+		if (content) {
+			resp.body.push_back(close);
+			resp.body_owner = move(content);
+		} else {
+			resp.file_parts.push_back({ close, 0, 0 });
+		}
+		return length;
 	}
 
-	static auto finalize(Request& req, Response& resp, Context& ctx, std::size_t length) -> void
+	static auto not_satisfiable(Request& req, Response& resp, Context& ctx, std::uint64_t size) -> void
+	{
+		resp.http_version = req.http_version;
+		resp.code = Response::Status::range_not_satisfiable;
+		resp.body.emplace_back(to_string(resp.code));
+		resp.headers.emplace_back("Content-Type"sv, "text/plain"sv);
+		resp.headers.emplace_back("Content-Length"sv, StringBuilder{ ctx.a }.convert(resp.body.front().size()));
+		resp.headers.emplace_back("Content-Range"sv, copy(ctx.a, "bytes */" + std::to_string(size)));
+	}
+
+	static auto finalize(Request& req, Response& resp, Context& ctx, std::uint64_t length,
+		string_view modified) -> void
 	{
 		resp.http_version = req.http_version;
 		//TODO Content-Type
 		resp.headers.emplace_back("Content-Length"sv, StringBuilder{ ctx.a }.convert(length));
+		resp.headers.emplace_back("Accept-Ranges"sv, "bytes"sv);
+		if (!modified.empty())
+			resp.headers.emplace_back("Last-Modified"sv, modified);
 		resp.code = Response::Status::ok;
 	}
 	
 	//TODO server-specific root
 	const std::string www_dir;
+	OpenFileCache cache;
+	ContentCache contents;
+	// Range is ignored if it has more
+	const std::size_t max_ranges;
 };
 }
 }
@@ -98,9 +229,42 @@ auto ModuleStaticFile::init(Logger& lg, const config::Table* config) -> HandlerL
 		throw std::runtime_error{ "config is mandatory for this module" };
 	auto& root = (*config)["root"].as<config::String>();
 	lg.debug("root directory: ", root);
+
+	OpenFileCache::Params cache_params;
+	if (auto& cache = (*config)["open_file_cache"]; cache) {
+		using std::chrono::seconds;
+		auto& t = cache.as<config::Table>();
+		const auto max = t["max"].get_or(static_cast<config::Integer>(cache_params.max_entries));
+		const auto valid = t["valid"].get_or(
+			static_cast<config::Integer>(std::chrono::duration_cast<seconds>(cache_params.valid).count()));
+		if (max < 0 || valid < 0)
+			throw std::runtime_error{ "open_file_cache: negative value" };
+		cache_params = { static_cast<std::size_t>(max), seconds{ valid } };
+	}
+	lg.debug("open file cache: max entries ", cache_params.max_entries);
+
+	ContentCache::Params content_params;
+	if (auto& cache = (*config)["content_cache"]; cache) {
+		auto& t = cache.as<config::Table>();
+		const auto max = t["max_size"].get_or(static_cast<config::Integer>(content_params.max_size));
+		const auto max_file = t["max_file_size"].get_or(static_cast<config::Integer>(content_params.max_file_size));
+		if (max < 0 || max_file < 0)
+			throw std::runtime_error{ "content_cache: negative value" };
+		content_params = { static_cast<std::size_t>(max), static_cast<std::size_t>(max_file) };
+	}
+	// contents are told stale by the open files they were read from
+	if (!cache_params.max_entries)
+		content_params.max_size = 0;
+	lg.debug("content cache: max size ", content_params.max_size);
+
+	// zero turns range requests off
+	const auto max_ranges = (*config)["max_ranges"].get_or(config::Integer{ 16 });
+	if (max_ranges < 0)
+		throw std::runtime_error{ "max_ranges: negative value" };
 	
 	HandlerList handlers = {
-		std::make_shared<http::RhStaticFile>(root),
+		std::make_shared<http::RhStaticFile>(root, cache_params, content_params,
+			static_cast<std::size_t>(max_ranges)),
 	};
 
 	return handlers;
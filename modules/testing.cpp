@@ -5,8 +5,6 @@
 #include "http_request_handler.hpp"
 #include "logger.hpp"
 #include "string_builder.hpp"
-#include <boost/assign/std/list.hpp>
-#include <boost/range/algorithm/find_if.hpp>
 #include <functional>
 
 namespace http
@@ -36,14 +34,14 @@ struct TestIndex : Test
 
 	auto get(Request& req, Response& resp, Context& ctx) -> void override
 	{
-		resp.body = { "It works!"sv };
+		resp.body.assign({ "It works!"sv });
 		finalize(req, resp, ctx);
 	}
 
 	auto method(string_view method_name, Request& req, Response& resp, Context& ctx) -> void override
 	{
 		if (method_name == "DELETE")
-			resp.body = { "del"sv };
+			resp.body.assign({ "del"sv });
 		else
 			throw Exception{ Response::Status::method_not_allowed };
 
@@ -58,8 +56,7 @@ struct TestHeaders : Test
 	auto get(Request& req, Response& resp, Context& ctx) -> void override
 	{
 		for (const auto& hdr : req.headers) {
-			using namespace boost::assign;
-			resp.body += hdr.name, Message::Header::sep, hdr.value, Message::nl;
+			resp.body.insert(resp.body.end(), { hdr.name, Message::Header::sep, hdr.value, Message::nl });
 		}
 		finalize(req, resp, ctx);
 	}
@@ -71,9 +68,8 @@ struct TestUa : Test
 
 	auto get(Request& req, Response& resp, Context& ctx) -> void override
 	{
-		auto it = boost::find_if(req.headers, Request::Header::make_is("user-agent"sv));
-		if (it != req.headers.end())
-			resp.body = { it->value };
+		if (auto ua = req.header(Request::Header::Known::user_agent))
+			resp.body.assign({ ua->value });
 		finalize(req, resp, ctx);
 	}
 };
@@ -86,11 +82,11 @@ struct TestTitle : Test
 
 	auto get(Request& req, Response& resp, Context& ctx) -> void override
 	{
-		resp.body = {
+		resp.body.assign({
 			"<!DOCTYPE html><html><body><h1>",
 			title,
 			"</h1></body></html>"
-		};
+		});
 		finalize(req, resp, ctx, "text/html");
 	}
 
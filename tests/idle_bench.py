@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+# Opens many idle connections to the server and reports its memory usage.
+# Needs a high enough open file limit on both sides (ulimit -n).
+
+import argparse
+import resource
+import socket
+import struct
+import time
+
+host = '127.0.0.1'
+port = 8080
+pid = None
+count = 100000
+request = False
+hold = 0
+debug = lambda *_: None
+
+# a destination port allows about 28000 connections from one source address
+CONNECTIONS_PER_SOURCE = 25000
+# lets connect() pick the source port, so ports in TIME_WAIT are reused
+IP_BIND_ADDRESS_NO_PORT = getattr(socket, 'IP_BIND_ADDRESS_NO_PORT', 24)
+REQUEST = b'GET /index HTTP/1.1\r\nHost: localhost\r\n\r\n'
+
+def parse_command_line():
+    global host, port, pid, count, request, hold, debug
+    parser = argparse.ArgumentParser()
+    parser.add_argument('pid', type=int, help='server process id')
+    parser.add_argument('-a', '--host', help='server IPv4 address')
+    parser.add_argument('-p', '--port', type=int, help='server port')
+    parser.add_argument('-n', '--count', type=int, help='number of connections')
+    parser.add_argument('-r', '--request', action='store_true',
+                        help='send one keep-alive request on every connection first')
+    parser.add_argument('-w', '--wait', type=int, help='seconds to hold connections after measuring')
+    parser.add_argument('-v', '--verbose', action='store_true')
+    args = parser.parse_args()
+    pid = args.pid
+    if args.host:
+        host = args.host
+    if args.port:
+        port = args.port
+    if args.count:
+        count = args.count
+    request = args.request
+    if args.wait:
+        hold = args.wait
+    if args.verbose:
+        debug = print
+
+def rss_kib():
+    with open('/proc/%d/status' % pid) as f:
+        for line in f:
+            if line.startswith('VmRSS:'):
+                return int(line.split()[1])
+    raise RuntimeError('no VmRSS for process %d' % pid)
+
+def source_address(n):
+    # loopback has the whole 127.0.0.0/8, so more sources are easy to get
+    if not host.startswith('127.'):
+        return None
+    k = n // CONNECTIONS_PER_SOURCE + 1
+    return ('127.0.%d.%d' % (k // 254, k % 254 + 1), 0)
+
+def open_connections():
+    conns = []
+    for n in range(count):
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        source = source_address(n)
+        if source:
+            s.setsockopt(socket.IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, 1)
+            s.bind(source)
+        s.connect((host, port))
+        conns.append(s)
+        if (n + 1) % 10000 == 0:
+            debug('connections:', n + 1)
+    return conns
+
+def make_requests(conns):
+    # one by one, so that the peak memory of the requests does not count
+    for s in conns:
+        s.sendall(REQUEST)
+        data = b''
+        while b'\r\n\r\n' not in data:
+            chunk = s.recv(4096)
+            if not chunk:
+                raise RuntimeError('connection closed by server')
+            data += chunk
+
+def settle():
+    # idle connections release their cached memory after a second
+    time.sleep(3)
+    return rss_kib()
+
+def main():
+    parse_command_line()
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (min(hard, max(soft, count + 100)), hard))
+
+    base = settle()
+    conns = open_connections()
+    if request:
+        make_requests(conns)
+    loaded = settle()
+
+    per_conn = (loaded - base) * 1024 / max(count, 1)
+    print('connections: %d' % count)
+    print('server RSS before: %d KiB, after: %d KiB' % (base, loaded))
+    print('per idle connection: %.0f bytes' % per_conn)
+
+    time.sleep(hold)
+    # reset, not to leave thousands of ports in TIME_WAIT
+    linger = struct.pack('ii', 1, 0)
+    for s in conns:
+        s.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, linger)
+        s.close()
+
+
+if __name__ == "__main__":
+    main()
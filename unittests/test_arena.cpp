@@ -1,13 +1,16 @@
 // Effective with Address Sanitizer
 
+#include "arena_footprint.hpp"
 #include "arena_imp.hpp"
 #include "logger_imp.hpp"
 #include <boost/align/is_aligned.hpp> 
 #include <boost/asio/buffer.hpp>
 #include <boost/range/algorithm/for_each.hpp>
 #include <boost/test/unit_test.hpp>
+#include <chrono>
 #include <cstddef>
 #include <cstring>
+#include <list>
 #include <memory>
 #include <tuple>
 #include <utility>
@@ -104,4 +107,164 @@ BOOST_AUTO_TEST_CASE(test_allocator_compare)
 	BOOST_TEST(a.make_allocator<char>() != a2.make_allocator<char>());
 }
 
-BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
+BOOST_AUTO_TEST_CASE(test_cache_reuse)
+{
+	ArenaCache cache{ 64 * 1024 };
+	const void* blocks[2];
+	{
+		ArenaImp a1{ lg, &cache };
+		blocks[0] = a1.alloc(100);
+		blocks[1] = a1.alloc(10'000);
+	}
+	BOOST_TEST(cache.n_bytes_cached() > 10'000u);
+
+	ArenaImp a2{ lg, &cache };
+	BOOST_TEST(a2.alloc(10'000) == blocks[1]);
+	BOOST_TEST(a2.alloc(100) == blocks[0]);
+	BOOST_TEST(cache.n_bytes_cached() == 0u);
+	test({ { a2.alloc(1'000), 1'000 } });
+}
+
+BOOST_AUTO_TEST_CASE(test_cache_limit)
+{
+	ArenaCache cache{ 8 * 1024 };
+	{
+		ArenaImp a1{ lg, &cache };
+		for (auto size : sizes)
+			test({ { a1.alloc(size), size } });
+	}
+	BOOST_TEST(cache.n_bytes_cached() > 0u);
+	BOOST_TEST(cache.n_bytes_cached() <= 8 * 1024u);
+
+	cache.clear();
+	BOOST_TEST(cache.n_bytes_cached() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_free_reuse)
+{
+	const auto p = a.alloc(1'000);
+	a.free(p, 1'000);
+	BOOST_TEST(a.alloc(600) == p);
+
+	// small chunks are not reused
+	const auto q = a.alloc(100);
+	a.free(q, 100);
+	BOOST_TEST(a.alloc(100) != q);
+}
+
+BOOST_AUTO_TEST_CASE(test_vector_growth)
+{
+	std::vector<int, Arena::Allocator<int>> v{ a.make_allocator<int>() };
+	for (int i = 0; i < 500; ++i)
+		v.push_back(i);
+	const auto n_bytes = a.n_bytes_allocated();
+	v.clear();
+	v.shrink_to_fit();
+	for (int i = 0; i < 500; ++i)
+		v.push_back(i);
+	BOOST_TEST(a.n_bytes_allocated() == n_bytes);
+}
+
+BOOST_AUTO_TEST_CASE(test_reserve)
+{
+	std::ignore = a.alloc(100);
+	a.reserve(100'000);
+	const auto n_blocks = a.n_blocks_allocated();
+	buffer_list buffers;
+	for (auto size : { 50'000, 1'000, 10'000, 100, 3'000 })
+		buffers.emplace_back(a.alloc(size), size);
+	BOOST_TEST(a.n_blocks_allocated() == n_blocks);
+	test(buffers);
+
+	// small reservations need no block of their own
+	ArenaImp a2{ lg };
+	a2.reserve(1'000);
+	BOOST_TEST(a2.n_blocks_allocated() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_bytes_used)
+{
+	std::ignore = a.alloc(100);
+	std::ignore = a.alloc(10'000);
+	BOOST_TEST(a.n_bytes_used() == 10'100u);
+	BOOST_TEST(a.n_bytes_allocated() >= a.n_bytes_used());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(arena_footprint_tests)
+
+BOOST_AUTO_TEST_CASE(test_expected)
+{
+	ArenaFootprint f;
+	BOOST_TEST(f.expected() == 0u);
+	for (int i = 0; i < 1'000; ++i)
+		f.add(i % 20 ? 20'000 : 500'000);
+	BOOST_TEST(f.expected() >= 20'000u);
+	BOOST_TEST(f.expected() < 40'000u);
+}
+
+BOOST_AUTO_TEST_CASE(test_follows_change)
+{
+	ArenaFootprint f;
+	for (int i = 0; i < 1'000; ++i)
+		f.add(100'000);
+	BOOST_TEST(f.expected() >= 100'000u);
+	for (int i = 0; i < 1'000; ++i)
+		f.add(3'000);
+	BOOST_TEST(f.expected() >= 3'000u);
+	BOOST_TEST(f.expected() < 6'000u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// Run explicitly: test_lemon --run_test=arena_bench --log_level=message
+BOOST_AUTO_TEST_SUITE(arena_bench, *boost::unit_test::disabled())
+
+namespace
+{
+using bench_clock = std::chrono::steady_clock;
+
+// nanoseconds per allocation in an arena of many partly used blocks
+double alloc_cost(size_t n_blocks)
+{
+	const size_t n_allocs = 10'000;
+	ArenaImp a{ lg };
+	// every block keeps a little space, too little for the measured size
+	while (a.n_blocks_allocated() < n_blocks)
+		std::ignore = a.alloc(250);
+
+	const auto start = bench_clock::now();
+	for (size_t i = 0; i < n_allocs; ++i)
+		std::ignore = a.alloc(224);
+	const std::chrono::duration<double, std::nano> elapsed = bench_clock::now() - start;
+	return elapsed.count() / n_allocs;
+}
+}
+
+BOOST_AUTO_TEST_CASE(bench_growing_arena)
+{
+	const double base = alloc_cost(1);
+	for (size_t n_blocks : { 1, 10, 100, 1'000, 10'000 }) {
+		const double cost = alloc_cost(n_blocks);
+		BOOST_TEST_MESSAGE("blocks: " << n_blocks << ", ns per alloc: " << cost);
+		BOOST_TEST_WARN(cost < 4 * base);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(bench_vector_growth)
+{
+	const size_t n_rounds = 1'000;
+	ArenaImp a{ lg };
+	const auto start = bench_clock::now();
+	for (size_t i = 0; i < n_rounds; ++i) {
+		std::vector<char, Arena::Allocator<char>> v{ a.make_allocator<char>() };
+		for (int j = 0; j < 2'000; ++j)
+			v.push_back('x');
+	}
+	const std::chrono::duration<double, std::micro> elapsed = bench_clock::now() - start;
+	BOOST_TEST_MESSAGE("us per vector: " << elapsed.count() / n_rounds
+		<< ", arena bytes: " << a.n_bytes_allocated());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
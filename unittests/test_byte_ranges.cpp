@@ -0,0 +1,78 @@
+#include "modules/byte_ranges.hpp"
+#include <boost/test/unit_test.hpp>
+#include <ostream>
+#include <vector>
+
+namespace http
+{
+static std::ostream& operator<<(std::ostream& s, const ByteRange& r)
+{
+	return s << r.first << '+' << r.size;
+}
+}
+
+namespace
+{
+using namespace http;
+
+constexpr std::size_t max_ranges = 4;
+
+auto ranges(string_view value, std::uint64_t size = 1000) -> std::vector<ByteRange>
+{
+	auto r = parse_ranges(value, size, max_ranges);
+	BOOST_TEST_REQUIRE(r.has_value(), value);
+	return { r->begin(), r->end() };
+}
+
+auto is_ignored(string_view value, std::uint64_t size = 1000) -> bool
+{
+	return !parse_ranges(value, size, max_ranges);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(byte_ranges_tests)
+
+BOOST_AUTO_TEST_CASE(test_one_range)
+{
+	using V = std::vector<ByteRange>;
+	BOOST_TEST(ranges("bytes=0-499") == (V{ { 0, 500 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=500-999") == (V{ { 500, 500 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=500-") == (V{ { 500, 500 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=-300") == (V{ { 700, 300 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=-5000") == (V{ { 0, 1000 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=900-5000") == (V{ { 900, 100 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=999-999") == (V{ { 999, 1 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges(" BYTES=0-0 ") == (V{ { 0, 1 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=0-99999999999999999999999") == (V{ { 0, 1000 } }), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(test_many_ranges)
+{
+	using V = std::vector<ByteRange>;
+	BOOST_TEST(ranges("bytes=0-0,-1") == (V{ { 0, 1 }, { 999, 1 } }), boost::test_tools::per_element());
+	BOOST_TEST(ranges("bytes=0-9, 20-29 ,,40-") == (V{ { 0, 10 }, { 20, 10 }, { 40, 960 } }),
+		boost::test_tools::per_element());
+	// unsatisfiable ones are left out
+	BOOST_TEST(ranges("bytes=2000-3000,0-9") == (V{ { 0, 10 } }), boost::test_tools::per_element());
+	BOOST_TEST(is_ignored("bytes=0-0,1-1,2-2,3-3,4-4"));
+	BOOST_TEST(is_ignored("bytes=0-,0-"));
+	BOOST_TEST(ranges("bytes=0-499,-500").size() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_not_satisfiable)
+{
+	BOOST_TEST(ranges("bytes=1000-").empty());
+	BOOST_TEST(ranges("bytes=1000-2000,5000-").empty());
+	BOOST_TEST(ranges("bytes=-0").empty());
+	BOOST_TEST(ranges("bytes=0-", 0).empty());
+	BOOST_TEST(ranges("bytes=-10", 0).empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_ignored)
+{
+	for (auto v : { "", "bytes", "bytes=", "bytes=,", "items=0-1", "bytes =0-1", "bytes=1",
+		"bytes=a-b", "bytes=5-4", "bytes=0-1x", "bytes=--1", "bytes=0 - 1", "bytes=-" })
+		BOOST_TEST(is_ignored(v), '"' << v << '"');
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+#include "modules/content_cache.hpp"
+#include "modules/open_file_cache.hpp"
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+namespace
+{
+struct Fixture
+{
+	Fixture()
+	{
+		std::ofstream{ path } << "hello";
+	}
+
+	~Fixture()
+	{
+		std::remove(path.c_str());
+	}
+
+	auto write(const std::string& content) const -> void
+	{
+		std::ofstream{ path } << content;
+	}
+
+	const std::string path = "/tmp/lemon_test_content_cache";
+	OpenFileCache files{ { 0, std::chrono::seconds{ 0 } } };
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(content_cache_tests, Fixture)
+
+BOOST_AUTO_TEST_CASE(test_hit)
+{
+	ContentCache cache{ {} };
+	auto f = files.open(path);
+
+	auto content = cache.get(path, *f);
+	BOOST_TEST_REQUIRE(content);
+	BOOST_TEST(*content == "hello");
+	BOOST_TEST(cache.get(path, *f) == content);
+	BOOST_TEST(cache.size() == 5u);
+}
+
+BOOST_AUTO_TEST_CASE(test_file_opened_again)
+{
+	ContentCache cache{ {} };
+	auto content = cache.get(path, *files.open(path));
+	BOOST_TEST_REQUIRE(content);
+
+	write("hello, world");
+	auto f = files.open(path);
+	auto new_content = cache.get(path, *f);
+	BOOST_TEST_REQUIRE(new_content);
+	BOOST_TEST(*new_content == "hello, world");
+	BOOST_TEST(*content == "hello");
+	BOOST_TEST(cache.get(path, *f) == new_content);
+	BOOST_TEST(cache.size() == 12u);
+}
+
+BOOST_AUTO_TEST_CASE(test_not_kept)
+{
+	auto f = files.open(path);
+	BOOST_TEST(!ContentCache({ 0, 64 }).get(path, *f));
+	BOOST_TEST(!ContentCache({ 1024 * 1024, 4 }).get(path, *f));
+	BOOST_TEST(!ContentCache({}).get(path, *files.open(path + ".none")));
+}
+
+BOOST_AUTO_TEST_CASE(test_admission)
+{
+	// shards of 100 bytes hold one file of 60
+	write(std::string(60, 'x'));
+	auto f = files.open(path);
+	ContentCache cache{ { 16 * 100, 100 } };
+
+	auto popular = cache.get("popular", *f);
+	for (int i = 0; i < 4; ++i)
+		BOOST_TEST(cache.get("popular", *f) == popular);
+
+	// files used once do not evict a file used often, as they would by LRU
+	for (int i = 0; i < 1000; ++i)
+		cache.get("once" + std::to_string(i), *f);
+	BOOST_TEST(cache.get("popular", *f) == popular);
+	BOOST_TEST(cache.size() <= 16 * 100u);
+
+	// a file used more often than the one kept takes its place
+	for (int i = 0; i < 10; ++i)
+		cache.get("rising", *f);
+	BOOST_TEST(cache.get("rising", *f) != nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,99 @@
+#include "memory_budget.hpp"
+#include "arena_imp.hpp"
+#include "logger_imp.hpp"
+#include <boost/test/unit_test.hpp>
+#include <tuple>
+
+namespace
+{
+BaseLogger lg;
+
+struct BudgetFixture
+{
+	MemoryBudget budget;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(memory_budget_tests, BudgetFixture)
+
+BOOST_AUTO_TEST_CASE(test_usage)
+{
+	MemoryBudget::Account a1{ budget, 0 };
+	MemoryBudget::Account a2{ budget, 0 };
+	a1.charge(1'000);
+	a2.charge(500);
+	BOOST_TEST(budget.used() == 1'500u);
+	a1.release(1'000);
+	BOOST_TEST(budget.used() == 500u);
+	BOOST_TEST(budget.peak() == 1'500u);
+	BOOST_TEST(a2.used() == 500u);
+	a2.release(500);
+}
+
+BOOST_AUTO_TEST_CASE(test_limits)
+{
+	budget.set_limit(1'000);
+	MemoryBudget::Account a1{ budget, 600 };
+	MemoryBudget::Account a2{ budget, 0 };
+
+	a1.charge(500);
+	try {
+		a1.charge(200);
+		BOOST_FAIL("account limit is not checked");
+	} catch (MemoryBudget::Exceeded& e) {
+		BOOST_TEST(e.by_account);
+	}
+	try {
+		a2.charge(600);
+		BOOST_FAIL("budget limit is not checked");
+	} catch (MemoryBudget::Exceeded& e) {
+		BOOST_TEST(!e.by_account);
+	}
+	BOOST_TEST(budget.used() == 500u);
+	BOOST_TEST(a2.used() == 0u);
+
+	// not enforced
+	a2.charge(600, false);
+	BOOST_TEST(budget.used() == 1'100u);
+	a2.release(600);
+	a1.release(500);
+}
+
+BOOST_AUTO_TEST_CASE(test_heavy)
+{
+	budget.set_limit(1'000);
+	MemoryBudget::Account a1{ budget, 0 };
+	MemoryBudget::Account a2{ budget, 0 };
+	a1.charge(500);
+	a2.charge(100);
+	BOOST_TEST(!budget.is_tight());
+	BOOST_TEST(!a1.is_heavy());
+
+	a2.charge(200);
+	BOOST_TEST(budget.is_tight());
+	BOOST_TEST(a1.is_heavy());
+	BOOST_TEST(!a2.is_heavy());
+	a1.release(500);
+	a2.release(300);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena)
+{
+	MemoryBudget::Account account{ budget, 20'000 };
+	{
+		ArenaImp a{ lg, nullptr, &account };
+		std::ignore = a.alloc(100);
+		std::ignore = a.alloc(10'000);
+		BOOST_TEST(account.used() == a.n_bytes_allocated());
+		BOOST_CHECK_THROW(std::ignore = a.alloc(10'000), MemoryBudget::Exceeded);
+		BOOST_TEST(account.used() == a.n_bytes_allocated());
+
+		a.allow_overdraft();
+		std::ignore = a.alloc(10'000);
+		BOOST_TEST(account.used() > 20'000u);
+	}
+	BOOST_TEST(account.used() == 0u);
+	BOOST_TEST(budget.used() == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
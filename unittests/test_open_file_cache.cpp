@@ -0,0 +1,175 @@
+#include "modules/open_file_cache.hpp"
+#include <boost/test/unit_test.hpp>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace
+{
+struct TempDir
+{
+	TempDir()
+	{
+		char name[] = "/tmp/lemon_test_XXXXXX";
+		BOOST_TEST_REQUIRE(::mkdtemp(name));
+		path = name;
+	}
+
+	~TempDir()
+	{
+		const auto cmd = "rm -rf " + path;
+		BOOST_TEST(std::system(cmd.c_str()) == 0);
+	}
+
+	auto write(const std::string& name, const std::string& content) const -> std::string
+	{
+		const auto file = path + "/" + name;
+		std::ofstream{ file } << content;
+		return file;
+	}
+
+	std::string path;
+};
+
+// inotify events come asynchronously
+template <typename Condition>
+auto eventually(Condition cond) -> bool
+{
+	for (int i = 0; i < 200; ++i) {
+		if (cond())
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+	}
+	return false;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(open_file_cache_tests)
+
+BOOST_AUTO_TEST_CASE(test_hit)
+{
+	TempDir dir;
+	const auto path = dir.write("a", "hello");
+	OpenFileCache cache{ {} };
+
+	auto f = cache.open(path);
+	BOOST_TEST(f->error == 0);
+	BOOST_TEST(f->size == 5u);
+	BOOST_TEST(f->fd >= 0);
+	BOOST_TEST(f->inode != 0u);
+	BOOST_TEST(cache.open(path) == f);
+	BOOST_TEST(cache.size() == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_not_regular)
+{
+	TempDir dir;
+	OpenFileCache cache{ {} };
+
+	auto missing = cache.open(dir.path + "/none");
+	BOOST_TEST(missing->error == ENOENT);
+	BOOST_TEST(missing->fd < 0);
+	BOOST_TEST(cache.open(dir.path + "/none") == missing);
+	BOOST_TEST(cache.open(dir.path)->error == EISDIR);
+	BOOST_TEST(cache.open(dir.path + "/none/x")->error == ENOENT);
+}
+
+BOOST_AUTO_TEST_CASE(test_changes)
+{
+	TempDir dir;
+	const auto path = dir.write("a", "hello");
+	OpenFileCache cache{ {} };
+
+	auto f = cache.open(path);
+	dir.write("a", "hello, world");
+	BOOST_TEST(eventually([&] { return cache.open(path)->size == 12u; }));
+
+	std::remove(path.c_str());
+	BOOST_TEST(eventually([&] { return cache.open(path)->error == ENOENT; }));
+	// the file stays open for the one using it
+	BOOST_TEST(f->size == 5u);
+	char c;
+	BOOST_TEST(::pread(f->fd, &c, 1, 0) == 1);
+
+	dir.write("a", "x");
+	BOOST_TEST(eventually([&] { return cache.open(path)->size == 1u; }));
+
+	const auto other = dir.write("b", "other");
+	BOOST_TEST(cache.open(path)->size == 1u);
+	BOOST_TEST(std::rename(other.c_str(), path.c_str()) == 0);
+	BOOST_TEST(eventually([&] { return cache.open(path)->size == 5u; }));
+}
+
+BOOST_AUTO_TEST_CASE(test_validity)
+{
+	TempDir dir;
+	const auto path = dir.write("a", "hello");
+	OpenFileCache cache{ { 100, std::chrono::seconds{ 0 } } };
+
+	auto f = cache.open(path);
+	BOOST_TEST(cache.open(path) != f);
+	BOOST_TEST(cache.open(path)->size == 5u);
+}
+
+BOOST_AUTO_TEST_CASE(test_max_entries)
+{
+	TempDir dir;
+	OpenFileCache cache{ { 2, std::chrono::seconds{ 60 } } };
+
+	std::string paths[3];
+	for (int i = 0; i < 3; ++i)
+		paths[i] = dir.write(std::to_string(i), "x");
+	for (auto& p : paths)
+		BOOST_TEST(cache.open(p)->error == 0);
+	BOOST_TEST(cache.size() <= 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_no_cache)
+{
+	TempDir dir;
+	const auto path = dir.write("a", "hello");
+	OpenFileCache cache{ { 0, std::chrono::seconds{ 60 } } };
+
+	auto f = cache.open(path);
+	BOOST_TEST(f->size == 5u);
+	BOOST_TEST(cache.open(path) != f);
+	BOOST_TEST(cache.size() == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+// Run explicitly: test_lemon --run_test=open_file_cache_bench --log_level=message
+BOOST_AUTO_TEST_SUITE(open_file_cache_bench, *boost::unit_test::disabled())
+
+BOOST_AUTO_TEST_CASE(bench_open)
+{
+	using bench_clock = std::chrono::steady_clock;
+	constexpr int n_rounds = 100'000;
+
+	TempDir dir;
+	const auto path = dir.write("a", "hello");
+	const auto missing = dir.path + "/none";
+
+	for (std::size_t max : { 0, 10000 }) {
+		OpenFileCache cache{ { max, std::chrono::seconds{ 60 } } };
+		std::size_t n_found = 0;
+		const auto start = bench_clock::now();
+		for (int i = 0; i < n_rounds; ++i) {
+			n_found += cache.open(path)->error == 0;
+			n_found += cache.open(missing)->error == 0;
+		}
+		const std::chrono::duration<double, std::nano> time = bench_clock::now() - start;
+
+		BOOST_TEST(n_found == static_cast<std::size_t>(n_rounds));
+		BOOST_TEST_MESSAGE("max entries: " << max
+			<< ", ns per found and missing pair: " << time.count() / n_rounds);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
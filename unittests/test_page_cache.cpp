@@ -0,0 +1,184 @@
+#include "page_cache.hpp"
+#include <boost/align/is_aligned.hpp>
+#include <boost/test/unit_test.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr auto page_size = PageCache::page_size;
+
+struct LimitGuard
+{
+	explicit LimitGuard(std::size_t bytes) noexcept { PageCache::set_limit(bytes); }
+	~LimitGuard() { PageCache::set_limit(1024 * 1024); }
+};
+
+struct HugePagesGuard
+{
+	explicit HugePagesGuard(PageCache::HugePages mode) noexcept
+	{ PageCache::set_huge_pages(mode, PageCache::huge_page_size); }
+	~HugePagesGuard() { PageCache::set_huge_pages(PageCache::HugePages::off, 0); }
+};
+}
+
+BOOST_AUTO_TEST_SUITE(page_cache_tests)
+
+BOOST_AUTO_TEST_CASE(test_reuse)
+{
+	PageCache cache;
+	const auto before = PageCache::stats();
+
+	auto p = cache.take();
+	BOOST_TEST(boost::alignment::is_aligned(p, page_size));
+	std::memset(p, 1, page_size);
+	cache.give(p);
+	BOOST_TEST(cache.take() == p);
+	cache.give(p);
+
+	const auto after = PageCache::stats();
+	BOOST_TEST(after.misses - before.misses == 1u);
+	BOOST_TEST(after.hits - before.hits == 1u);
+	BOOST_TEST(after.retained_bytes - before.retained_bytes == page_size);
+}
+
+BOOST_AUTO_TEST_CASE(test_limit)
+{
+	LimitGuard limit{ 2 * page_size };
+	PageCache cache;
+	const auto before = PageCache::stats();
+
+	std::vector<void*> pages;
+	for (int i = 0; i < 4; ++i)
+		pages.push_back(cache.take());
+	for (auto p : pages)
+		cache.give(p);
+
+	BOOST_TEST(PageCache::stats().retained_bytes - before.retained_bytes == 2 * page_size);
+}
+
+BOOST_AUTO_TEST_CASE(test_trim_if_idle)
+{
+	LimitGuard limit{ 8 * page_size };
+	PageCache cache;
+	const auto before = PageCache::stats();
+
+	std::vector<void*> pages;
+	for (int i = 0; i < 8; ++i)
+		pages.push_back(cache.take());
+	for (auto p : pages)
+		cache.give(p);
+
+	// busy since the last check
+	cache.trim_if_idle();
+	BOOST_TEST(PageCache::stats().retained_bytes - before.retained_bytes == 8 * page_size);
+
+	cache.trim_if_idle();
+	BOOST_TEST(PageCache::stats().retained_bytes - before.retained_bytes == 2 * page_size);
+
+	// a page given back to the system is still usable
+	auto p = cache.take();
+	std::memset(p, 1, page_size);
+	cache.give(p);
+}
+
+BOOST_AUTO_TEST_CASE(test_trim_releases_memory)
+{
+	if (sysconf(_SC_PAGESIZE) != static_cast<long>(page_size))
+		return;
+	// an idle thread keeps all of them
+	LimitGuard limit{ 4 * 8 * page_size };
+	PageCache cache;
+	const auto before = PageCache::stats();
+
+	std::vector<void*> pages;
+	for (int i = 0; i < 8; ++i) {
+		auto p = cache.take();
+		std::memset(p, 1, page_size);
+		pages.push_back(p);
+	}
+	for (auto p : pages)
+		cache.give(p);
+	cache.trim();
+	BOOST_TEST(PageCache::stats().advised_bytes - before.advised_bytes == 8 * page_size);
+
+	for (auto p : pages) {
+		unsigned char resident = 1;
+		BOOST_TEST(mincore(p, page_size, &resident) == 0);
+		BOOST_TEST((resident & 1) == 0);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_trim_all_if_idle)
+{
+	LimitGuard limit{ 8 * page_size };
+	PageCache cache;
+	std::vector<void*> pages;
+	for (int i = 0; i < 8; ++i)
+		pages.push_back(cache.take());
+	// the other caches are trimmed too, and stay so
+	PageCache::trim_all_if_idle();
+	PageCache::trim_all_if_idle();
+
+	for (auto p : pages)
+		cache.give(p);
+	const auto before = PageCache::stats();
+	PageCache::trim_all_if_idle();
+	BOOST_TEST(PageCache::stats().retained_bytes == before.retained_bytes);
+	PageCache::trim_all_if_idle();
+	BOOST_TEST(before.retained_bytes - PageCache::stats().retained_bytes == 6 * page_size);
+}
+
+BOOST_AUTO_TEST_CASE(test_other_thread)
+{
+	std::vector<void*> pages;
+	std::thread{ [&pages]
+	{
+		for (int i = 0; i < 4; ++i)
+			pages.push_back(PageCache::local().take());
+	} }.join();
+
+	PageCache cache;
+	for (auto p : pages)
+		cache.give(p);
+	BOOST_TEST(cache.take() == pages.back());
+	cache.give(pages.back());
+}
+
+BOOST_AUTO_TEST_CASE(test_huge_pages)
+{
+	LimitGuard limit{ 0 };
+	HugePagesGuard huge{ PageCache::HugePages::transparent };
+	const auto before = PageCache::stats();
+
+	std::vector<void*> pages;
+	{
+		PageCache cache;
+		for (int i = 0; i < 4; ++i) {
+			auto p = cache.take();
+			BOOST_TEST(boost::alignment::is_aligned(p, page_size));
+			std::memset(p, 1, page_size);
+			pages.push_back(p);
+		}
+		BOOST_TEST(static_cast<char*>(pages[1]) - static_cast<char*>(pages[0]) == page_size);
+		for (auto p : pages)
+			cache.give(p);
+	}
+
+	const auto after = PageCache::stats();
+	BOOST_TEST(after.huge_bytes - before.huge_bytes == PageCache::huge_page_size);
+	BOOST_TEST(after.huge_misses - before.huge_misses == 4u);
+
+	// pages not kept by a thread, and the rest of its region, are given to the others
+	PageCache cache;
+	const auto p = static_cast<char*>(cache.take());
+	const auto region = static_cast<char*>(pages[0]);
+	BOOST_TEST((p >= region && p < region + PageCache::huge_page_size));
+	cache.give(p);
+	BOOST_TEST(PageCache::stats().huge_bytes == after.huge_bytes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
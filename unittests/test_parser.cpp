@@ -1,13 +1,18 @@
 #include "http_parser_.hpp"
+#include "http_simd_parser.hpp"
 #include "arena_imp.hpp"
 #include "http_message.hpp"
 #include "logger_imp.hpp"
 #include <boost/mpl/bool.hpp>
+#include <boost/range/algorithm/find_if.hpp>
 #include <boost/test/data/monomorphic.hpp>
 #include <boost/test/data/test_case.hpp>
 #include <boost/test/unit_test.hpp>
+#include <chrono>
 #include <deque>
+#include <string>
 #include <utility>
+#include <vector>
 
 using namespace http;
 
@@ -52,18 +57,16 @@ struct GoodTestCase
 	Message::ProtocolVersion version;
 	std::vector<Request::Header> headers;
 	std::string body;
-
-	auto lowercased_headers() const
-	{
-		decltype(headers) result{headers.begin(), headers.end()};
-		for (auto& hdr : result)
-		{
-			hdr.lowercase_name = hdr.name;
-		}
-		return result;
-	}
 };
 
+std::string request_with_headers(int n_headers)
+{
+	std::string r = "GET /index HTTP/1.1\r\n";
+	for (int i = 0; i < n_headers; ++i)
+		r += "X-Header-" + std::to_string(i) + ": value " + std::to_string(i) + "\r\n";
+	return r + "\r\n";
+}
+
 std::ostream& operator<<(std::ostream& s, const GoodTestCase& t)
 {
 	return s << "No " << t.no << ": " << t.request;
@@ -340,7 +343,7 @@ BOOST_DATA_TEST_CASE(test_simple,
 	BOOST_TEST(req.method.name == sample.method_name);
 	BOOST_TEST(req.url.path == sample.url);
 	BOOST_TEST(req.http_version == sample.version);
-	BOOST_TEST(req.headers == sample.lowercased_headers(), boost::test_tools::per_element());
+	BOOST_TEST(req.headers == sample.headers, boost::test_tools::per_element());
 	BOOST_TEST(body(req) == sample.body);
 }
 
@@ -373,7 +376,7 @@ BOOST_DATA_TEST_CASE(test_pipeline, fragmented_pipeline_dataset{})
 			cases.pop_front();
 
 			BOOST_TEST(req.http_version == expected.version);
-			BOOST_TEST(req.headers == expected.lowercased_headers(), boost::test_tools::per_element());
+			BOOST_TEST(req.headers == expected.headers, boost::test_tools::per_element());
 			BOOST_TEST(body(req) == expected.body);
 
 			reset();
@@ -383,6 +386,80 @@ BOOST_DATA_TEST_CASE(test_pipeline, fragmented_pipeline_dataset{})
 	BOOST_TEST(cases.empty());
 }
 
+BOOST_AUTO_TEST_CASE(test_headers_in_chunks)
+{
+	const string_view request = "GET /index HTTP/1.1\r\nHost: localhost\r\nAccept: */*\r\n\r\n";
+	const auto line_end = request.find("Host");
+	const auto host_end = request.find("Accept");
+
+	auto [result, rest] = p.parse_chunk(request.substr(0, line_end));
+	BOOST_TEST(std::holds_alternative<Parser::RequestLine>(result));
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST(std::holds_alternative<Parser::IncompleteRequest>(result));
+
+	std::tie(result, rest) = p.parse_chunk(request.substr(line_end, host_end - line_end));
+	BOOST_TEST(std::holds_alternative<Parser::IncompleteRequest>(result));
+
+	std::tie(result, rest) = p.parse_chunk(request.substr(host_end));
+	BOOST_TEST_REQUIRE(std::holds_alternative<Parser::CompleteRequest>(result));
+	BOOST_TEST(rest.empty());
+	p.finalize(req);
+	BOOST_TEST(req.url.path == "/index");
+	BOOST_TEST(req.headers.size() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_url_in_chunks)
+{
+	const string_view request = "GET /index HTTP/1.1\r\n\r\n";
+	for (auto url_end : { request.find("dex"), request.find(" HTTP") }) {
+		auto [result, rest] = p.parse_chunk(request.substr(0, url_end));
+		BOOST_TEST(std::holds_alternative<Parser::IncompleteRequest>(result));
+
+		std::tie(result, rest) = p.parse_chunk(request.substr(url_end));
+		BOOST_TEST_REQUIRE(std::holds_alternative<Parser::RequestLine>(result));
+		BOOST_TEST(req.url.path == "/index");
+		reset();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_max_content_length)
+{
+	const string_view request = "POST /index HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world";
+	p.reset(req, drop_mode, 10);
+	auto [result, rest] = p.parse_chunk(request);
+	if (std::holds_alternative<Parser::RequestLine>(result))
+		std::tie(result, rest) = p.parse_chunk(rest);
+	auto r = std::get_if<Error>(&result);
+	BOOST_TEST_REQUIRE(r);
+	BOOST_TEST(r->code == Response::Status::payload_too_large);
+
+	reset();
+	p.reset(req, drop_mode, 11);
+	std::tie(result, rest) = p.parse_chunk(request);
+	if (std::holds_alternative<Parser::RequestLine>(result))
+		std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST(std::holds_alternative<Parser::CompleteRequest>(result));
+}
+
+BOOST_AUTO_TEST_CASE(test_report_headers)
+{
+	const string_view request = "POST /index HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+	p.reset(req, drop_mode, 0, true);
+	auto [result, rest] = p.parse_chunk(request);
+	BOOST_TEST_REQUIRE(std::holds_alternative<Parser::RequestLine>(result));
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<Parser::HeadersComplete>(result));
+	BOOST_TEST(p.headers_complete());
+	BOOST_TEST(body(req).empty());
+
+	// the body goes as the route needs
+	drop_mode = true;
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<Parser::CompleteRequest>(result));
+	BOOST_TEST(rest.empty());
+	BOOST_TEST(body(req).empty());
+}
+
 BOOST_DATA_TEST_CASE(test_errors, boost::unit_test::data::make(bad_request_samples))
 {
 	Parser::Result::first_type result = Parser::CompleteRequest{};
@@ -398,4 +475,371 @@ BOOST_DATA_TEST_CASE(test_errors, boost::unit_test::data::make(bad_request_sampl
 	BOOST_TEST(r->code == sample.code.value_or(Response::Status::bad_request));
 }
 
-BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
+BOOST_AUTO_TEST_CASE(test_many_headers)
+{
+	const auto n_headers = 3 * Message::n_inline_headers;
+	const auto request = request_with_headers(n_headers);
+	auto [result, rest] = p.parse_chunk(request);
+	BOOST_TEST_REQUIRE(std::holds_alternative<Parser::RequestLine>(result));
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<Parser::CompleteRequest>(result));
+	p.finalize(req);
+
+	BOOST_TEST_REQUIRE(req.headers.size() == n_headers);
+	BOOST_TEST(req.headers.front().value == "value 0");
+	BOOST_TEST(req.headers.back().is("x-header-" + std::to_string(n_headers - 1)));
+}
+
+BOOST_AUTO_TEST_CASE(test_known_headers)
+{
+	const string_view request = "GET /index HTTP/1.1\r\nHOST: localhost\r\nX-Host: other\r\n"
+		"Content-Length: 0\r\nhost: again\r\nUser-Agenda: no\r\n\r\n";
+	auto [result, rest] = p.parse_chunk(request);
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<Parser::CompleteRequest>(result));
+	p.finalize(req);
+
+	using Known = Request::Header::Known;
+	auto host = req.header(Known::host);
+	BOOST_TEST_REQUIRE(host);
+	BOOST_TEST(host->value == "localhost");
+	BOOST_TEST(host->is("host"sv));
+	BOOST_TEST(req.header(Known::content_length) == &req.headers[2]);
+	BOOST_TEST(!req.header(Known::user_agent));
+	BOOST_TEST(!req.header(Known::other));
+	BOOST_TEST((req.headers[1].known == Known::other));
+	BOOST_TEST((req.headers[4].known == Known::other));
+
+	// the known headers are forgotten with the request
+	reset();
+	BOOST_TEST(!req.header(Known::host));
+}
+
+BOOST_AUTO_TEST_CASE(test_lowercase_name)
+{
+	const string_view name = "X-Very-Long-Header-Name-With-Some-Digits-0123456789-@[`{";
+	BOOST_TEST(Request::Header(name, {}).lowercase_name(a) == "x-very-long-header-name-with-some-digits-0123456789-@[`{");
+	BOOST_TEST(Request::Header("\xC0Z"sv, {}).lowercase_name(a) == "\xC0z");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+namespace
+{
+// What a parser makes of the chunks, one line per step, for comparison
+// of parsers. Unparsed bytes are given again before the next chunk.
+template <typename P>
+std::vector<std::string> parse_trace(const std::vector<string_view>& chunks,
+	std::size_t max_content_length = 0)
+{
+	BaseLogger lg;
+	ArenaImp a{ lg };
+	Request req{ a };
+	P p;
+	bool drop_mode = false;
+	p.reset(req, drop_mode, max_content_length);
+
+	std::vector<std::string> trace;
+	std::deque<string_view> input{ chunks.begin(), chunks.end() };
+	while (!input.empty()) {
+		auto [result, rest] = p.parse_chunk(input.front());
+		input.pop_front();
+		if (!rest.empty())
+			input.emplace_front(rest);
+
+		auto step = std::to_string(result.index()) + " rest " + std::to_string(rest.size());
+		if (auto error = std::get_if<Error>(&result)) {
+			trace.push_back(step + " error " + std::to_string(static_cast<int>(error->code)));
+			break;
+		}
+		if (std::holds_alternative<typename P::RequestLine>(result))
+			step += " " + std::string{ req.method.name } + " "
+				+ std::to_string(static_cast<int>(req.method.type)) + " "
+				+ std::string{ req.url.path } + " ? " + std::string{ req.url.query };
+		if (std::holds_alternative<typename P::CompleteRequest>(result)) {
+			p.finalize(req);
+			step += " version " + std::to_string(static_cast<int>(req.http_version))
+				+ " keep-alive " + std::to_string(req.keep_alive);
+			for (auto& h : req.headers)
+				step += " [" + std::string{ h.name } + ": " + std::string{ h.value } + "]";
+			step += " body " + body(req);
+			req.url = {};
+			req.headers.clear();
+			req.body.clear();
+			p.reset(req, drop_mode, max_content_length);
+		}
+		trace.push_back(step);
+	}
+	return trace;
+}
+
+void check_same_trace(const std::vector<string_view>& chunks, std::size_t max_content_length = 0)
+{
+	const auto expected = parse_trace<Parser>(chunks, max_content_length);
+	const auto actual = parse_trace<SimdParser>(chunks, max_content_length);
+	BOOST_TEST(actual == expected, boost::test_tools::per_element());
+}
+}
+
+BOOST_AUTO_TEST_SUITE(simd_parser_tests)
+
+BOOST_DATA_TEST_CASE(test_same_as_parser,
+	boost::unit_test::data::make(good_request_samples)
+	+ boost::unit_test::data::make(good_last_request_samples))
+{
+	check_same_trace({ sample.request });
+}
+
+BOOST_DATA_TEST_CASE(test_same_errors, boost::unit_test::data::make(bad_request_samples))
+{
+	check_same_trace({ sample.request });
+}
+
+BOOST_DATA_TEST_CASE(test_same_pipeline, fragmented_pipeline_dataset{})
+{
+	check_same_trace({ sample.chunks.begin(), sample.chunks.end() });
+}
+
+BOOST_AUTO_TEST_CASE(test_same_in_chunks)
+{
+	const string_view request = "GET /index?a=b HTTP/1.1\r\nHost: localhost\r\n"
+		"Accept: */*\r\nConnection: keep-alive\r\n\r\n";
+	for (std::size_t pos = 1; pos < request.size(); ++pos)
+		check_same_trace({ request.substr(0, pos), request.substr(pos) });
+
+	const std::vector<std::string> requests = {
+		"GET http://localhost:8080/a/b?c HTTP/1.1\r\n\r\n",
+		"OPTIONS * HTTP/1.1\r\n\r\n",
+		"HEAD / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n",
+		"POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+			"a;ext=1\r\n0123456789\r\n0\r\n\r\n",
+		"GET / HTTP/3.1\r\n\r\n",
+		"BAD /index HTTP/1.1\r\n\r\n",
+		"PATCH /index HTTP/1.1\r\n\r\n",
+		"SOURCE /index HTTP/1.1\r\n\r\n",
+		request_with_headers(3 * Message::n_inline_headers),
+	};
+	for (auto& r : requests)
+		BOOST_TEST_CONTEXT(r)
+			check_same_trace({ r });
+}
+
+BOOST_AUTO_TEST_CASE(test_same_max_content_length)
+{
+	const string_view request = "POST /index HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world";
+	for (std::size_t max : { 10, 11 })
+		check_same_trace({ request }, max);
+}
+
+BOOST_AUTO_TEST_CASE(test_header_values)
+{
+	BaseLogger lg;
+	ArenaImp a{ lg };
+	Request req{ a };
+	SimdParser p;
+	bool drop_mode = false;
+
+	// optional whitespace around a value is not a part of it
+	p.reset(req, drop_mode);
+	auto [result, rest] = p.parse_chunk("GET / HTTP/1.1\r\nHost:\t spaced value \t\r\n\r\n"sv);
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::CompleteRequest>(result));
+	p.finalize(req);
+	BOOST_TEST_REQUIRE(req.headers.size() == 1u);
+	BOOST_TEST(req.headers[0].value == "spaced value");
+
+	for (auto request : { "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n"sv,
+		"GET / HTTP/1.1\r\nContent-Length: x\r\n\r\n"sv,
+		"GET / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n"sv,
+		"GET / HTTP/1.1\r\nX: a\x01b\r\n\r\n"sv }) {
+		req.headers.clear();
+		p.reset(req, drop_mode);
+		std::tie(result, rest) = p.parse_chunk(request);
+		std::tie(result, rest) = p.parse_chunk(rest);
+		auto error = std::get_if<Error>(&result);
+		BOOST_TEST_REQUIRE(error, request);
+		BOOST_TEST(error->code == Response::Status::bad_request);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_chunked_codings)
+{
+	BaseLogger lg;
+	ArenaImp a{ lg };
+	Request req{ a };
+	SimdParser p;
+	bool drop_mode = false;
+	p.reset(req, drop_mode);
+
+	const string_view request = "POST / HTTP/1.1\r\nTransfer-Encoding: gzip, Chunked\r\n\r\n"
+		"5\r\nhello\r\n0\r\nTrailer: x\r\n\r\nGET";
+	auto [result, rest] = p.parse_chunk(request);
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::CompleteRequest>(result));
+	p.finalize(req);
+	BOOST_TEST(body(req) == "hello");
+	BOOST_TEST(rest == "GET");
+}
+
+BOOST_AUTO_TEST_CASE(test_headers_not_contiguous)
+{
+	BaseLogger lg;
+	ArenaImp a{ lg };
+	Request req{ a };
+	SimdParser p;
+	bool drop_mode = false;
+	p.reset(req, drop_mode);
+
+	const std::string line = "GET / HTTP/1.1\r\nHost: local", end = "host\r\n\r\n";
+	auto [result, rest] = p.parse_chunk(line);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::RequestLine>(result));
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::IncompleteRequest>(result));
+	std::tie(result, rest) = p.parse_chunk(end);
+	auto error = std::get_if<Error>(&result);
+	BOOST_TEST_REQUIRE(error);
+	BOOST_TEST(error->code == Response::Status::request_header_fields_too_large);
+}
+
+BOOST_AUTO_TEST_CASE(test_report_headers)
+{
+	BaseLogger lg;
+	ArenaImp a{ lg };
+	Request req{ a };
+	SimdParser p;
+	bool drop_mode = false;
+	p.reset(req, drop_mode, 0, true);
+
+	const string_view request = "POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+	auto [result, rest] = p.parse_chunk(request);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::RequestLine>(result));
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::HeadersComplete>(result));
+	BOOST_TEST(rest == "hello");
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::CompleteRequest>(result));
+	p.finalize(req);
+	BOOST_TEST(body(req) == "hello");
+
+	// a request without a body is complete with its headers
+	p.reset(req, drop_mode, 0, true);
+	std::tie(result, rest) = p.parse_chunk("GET / HTTP/1.1\r\n\r\n");
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST(std::holds_alternative<SimdParser::CompleteRequest>(result));
+}
+
+BOOST_AUTO_TEST_CASE(test_move_unfinished)
+{
+	BaseLogger lg;
+	ArenaImp a{ lg };
+	Request req{ a };
+	SimdParser p;
+	bool drop_mode = false;
+	p.reset(req, drop_mode);
+
+	const std::string line = "GET / HTTP/1.1\r\nHost: local", end = "host\r\n\r\n";
+	auto [result, rest] = p.parse_chunk(line);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::RequestLine>(result));
+	std::tie(result, rest) = p.parse_chunk(rest);
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::IncompleteRequest>(result));
+	BOOST_TEST(p.unfinished() == "Host: local");
+
+	// the next buffer starts with the unfinished line
+	std::string next(p.unfinished().size() + end.size(), '\0');
+	p.move_unfinished(next.data());
+	end.copy(next.data() + p.unfinished().size(), end.size());
+	std::tie(result, rest) = p.parse_chunk(string_view{ next }.substr(p.unfinished().size()));
+	BOOST_TEST_REQUIRE(std::holds_alternative<SimdParser::CompleteRequest>(result));
+	p.finalize(req);
+	BOOST_TEST_REQUIRE(req.headers.size() == 1u);
+	BOOST_TEST(req.headers[0].value == "localhost");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+// Run explicitly: test_lemon --run_test=parser_bench --log_level=message
+BOOST_AUTO_TEST_SUITE(parser_bench, *boost::unit_test::disabled())
+
+namespace
+{
+using bench_clock = std::chrono::steady_clock;
+constexpr int n_rounds = 10'000;
+}
+
+BOOST_AUTO_TEST_CASE(bench_parse_and_lookup)
+{
+	for (int n_headers : { 10, 30, 100 }) {
+		auto request = request_with_headers(n_headers);
+		// a known header last, the worst case for a search
+		request.insert(request.size() - 2, "User-Agent: bench\r\n");
+		const auto last = "x-header-" + std::to_string(n_headers - 1);
+		bench_clock::duration parse_time{}, lookup_time{}, known_time{};
+		std::size_t n_found = 0;
+
+		for (int i = 0; i < n_rounds; ++i) {
+			ParserFixture f;
+			auto start = bench_clock::now();
+			auto [result, rest] = f.p.parse_chunk(request);
+			std::tie(result, rest) = f.p.parse_chunk(rest);
+			f.p.finalize(f.req);
+			auto parsed = bench_clock::now();
+			// a header near the end, and one which is absent
+			for (auto name : { string_view{ last }, "accept"sv })
+				n_found += boost::find_if(f.req.headers, Request::Header::make_is(name)) != f.req.headers.end();
+			auto searched = bench_clock::now();
+			n_found += f.req.header(Request::Header::Known::user_agent) != nullptr;
+			n_found += f.req.header(Request::Header::Known::accept) != nullptr;
+			known_time += bench_clock::now() - searched;
+			lookup_time += searched - parsed;
+			parse_time += parsed - start;
+		}
+
+		BOOST_TEST(n_found == static_cast<std::size_t>(2 * n_rounds));
+		const std::chrono::duration<double, std::nano> parse_ns = parse_time,
+			lookup_ns = lookup_time, known_ns = known_time;
+		BOOST_TEST_MESSAGE("headers: " << n_headers
+			<< ", ns per parse: " << parse_ns.count() / n_rounds
+			<< ", ns per lookup: " << lookup_ns.count() / n_rounds / 2
+			<< ", ns per known lookup: " << known_ns.count() / n_rounds / 2);
+	}
+}
+
+namespace
+{
+template <typename P>
+double parse_ns(const std::string& request)
+{
+	BaseLogger lg;
+	P p;
+	bool drop_mode = false;
+	bench_clock::duration time{};
+
+	for (int i = 0; i < n_rounds; ++i) {
+		ArenaImp a{ lg };
+		Request req{ a };
+		p.reset(req, drop_mode);
+		auto start = bench_clock::now();
+		auto [result, rest] = p.parse_chunk(request);
+		std::tie(result, rest) = p.parse_chunk(rest);
+		p.finalize(req);
+		time += bench_clock::now() - start;
+		BOOST_TEST_REQUIRE(std::holds_alternative<typename P::CompleteRequest>(result));
+	}
+	return std::chrono::duration<double, std::nano>{ time }.count() / n_rounds;
+}
+}
+
+BOOST_AUTO_TEST_CASE(bench_parser_engines)
+{
+	for (int n_headers : { 0, 10, 30, 100 }) {
+		const auto request = request_with_headers(n_headers);
+		const auto http_parser_ns = parse_ns<Parser>(request);
+		const auto simd_ns = parse_ns<SimdParser>(request);
+		BOOST_TEST_MESSAGE("headers: " << n_headers << ", bytes: " << request.size()
+			<< ", ns per parse: http-parser " << http_parser_ns << ", simd " << simd_ns);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,169 @@
+#include "regex_set.hpp"
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace
+{
+const std::vector<std::string> patterns = {
+	"path[0-9]+",
+	"v1|v2|[abc]",
+	"^/api/v[0-9]+/users/\\d+$",
+	"/static/.*\\.(css|js|png)",
+	"/blog/[0-9]{4}/[0-9]{2}/[a-z0-9-]+",
+	"/a(b|c)*d?",
+	"/x{2,3}y{1,}z{0,1}",
+	"[^/]+/[\\w.-]+",
+	"(?:ab)+?c",
+	"\\s*\\S+",
+	"[\\]a-]x",
+	"\\x41.\\.",
+	"()|a*",
+};
+
+// every string of the alphabet up to the length
+std::vector<std::string> all_strings(std::string alphabet, std::size_t max_length)
+{
+	std::vector<std::string> strings{ "" };
+	for (std::size_t i = 0; i < strings.size(); ++i)
+		if (strings[i].size() < max_length)
+			for (auto c : alphabet)
+				strings.push_back(strings[i] + c);
+	return strings;
+}
+
+std::vector<std::string> samples()
+{
+	auto s = all_strings("/abcdxyz.9 \n", 4);
+	for (auto x : { "path0", "path10", "path1a", "/api/v2/users/17", "/api/v/users/1",
+		"/static/css/site.css", "/static/a.jpg", "/blog/2020/01/hello-world",
+		"/blog/20/01/x", "/abcbd", "/xxxyy", "/xxxxy", "a/b.c", "ababc", "]x", "-x",
+		"A\n.", "A..", "  tab", "" })
+		s.push_back(x);
+	return s;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(regex_set_tests)
+
+BOOST_AUTO_TEST_CASE(test_same_as_std_regex)
+{
+	const auto strings = samples();
+	for (auto& p : patterns) {
+		RegexSet set;
+		BOOST_TEST_REQUIRE(set.add(p), p);
+		BOOST_TEST_REQUIRE(set.compile());
+		const std::regex re{ p };
+		for (auto& s : strings)
+			BOOST_TEST(set.match(s).empty() == !std::regex_match(s, re), p << " on \"" << s << "\"");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_all_matches)
+{
+	RegexSet set;
+	for (auto& p : patterns)
+		BOOST_TEST_REQUIRE(set.add(p));
+	BOOST_TEST_REQUIRE(set.compile());
+	BOOST_TEST(set.size() == patterns.size());
+
+	std::vector<std::regex> res;
+	for (auto& p : patterns)
+		res.emplace_back(p);
+	for (auto& s : samples()) {
+		std::vector<RegexSet::Index> expected;
+		for (std::size_t i = 0; i < res.size(); ++i)
+			if (std::regex_match(s, res[i]))
+				expected.push_back(static_cast<RegexSet::Index>(i));
+		BOOST_TEST(set.match(s) == expected, boost::test_tools::per_element());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_not_understood)
+{
+	RegexSet set;
+	for (auto p : { "(a)\\1", "a\\b", "(?=a)a", "a^b", "a$b", "x{2000}", "(a", "a)", "[a", "\\u0041" })
+		BOOST_TEST(!set.add(p), p);
+	BOOST_TEST(set.size() == 0u);
+	BOOST_TEST(set.compile());
+	BOOST_TEST(set.match("a").empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_too_many_states)
+{
+	// the automaton remembers the last 12 bytes
+	RegexSet set;
+	BOOST_TEST_REQUIRE(set.add(".*a.{11}"));
+	BOOST_TEST(!set.compile(1000));
+	BOOST_TEST(set.compile(100'000));
+	BOOST_TEST(set.match("xa0123456789x").size() == 1u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+// Run explicitly: test_lemon --run_test=regex_set_bench --log_level=message
+BOOST_AUTO_TEST_SUITE(regex_set_bench, *boost::unit_test::disabled())
+
+BOOST_AUTO_TEST_CASE(bench_route_table)
+{
+	using bench_clock = std::chrono::steady_clock;
+	constexpr int n_rounds = 20'000;
+
+	std::vector<std::string> table;
+	for (auto resource : { "users", "orders", "items", "carts", "reviews" }) {
+		const std::string r = resource;
+		table.push_back("/api/v[0-9]+/" + r);
+		table.push_back("/api/v[0-9]+/" + r + "/[0-9]+");
+		table.push_back("/api/v[0-9]+/" + r + "/[0-9]+/(history|details|status)");
+	}
+	table.push_back("/static/.*\\.(css|js|png|jpg|svg|woff2?)");
+	table.push_back("/blog/[0-9]{4}/[0-9]{2}/[a-z0-9-]+");
+	table.push_back("/(en|de|fr|ja)/docs/[a-z0-9/-]+\\.html");
+	table.push_back("/download/[A-Za-z0-9_.-]+\\.(tar\\.gz|zip)");
+
+	const std::vector<std::string> paths = {
+		"/api/v2/users",
+		"/api/v1/reviews/123456/status",
+		"/static/fonts/inter-var.woff2",
+		"/blog/2021/07/how-we-route-requests",
+		"/ja/docs/guide/getting-started.html",
+		"/not/routed/anywhere/at/all",
+	};
+
+	std::vector<std::regex> res;
+	RegexSet set;
+	for (auto& p : table) {
+		res.emplace_back(p, std::regex_constants::optimize);
+		BOOST_TEST_REQUIRE(set.add(p));
+	}
+	BOOST_TEST_REQUIRE(set.compile());
+
+	std::size_t n_std = 0, n_set = 0;
+	auto start = bench_clock::now();
+	for (int i = 0; i < n_rounds; ++i)
+		for (auto& path : paths)
+			for (auto& re : res)
+				if (std::regex_match(path, re)) {
+					++n_std;
+					break;
+				}
+	const std::chrono::duration<double, std::nano> std_time = bench_clock::now() - start;
+
+	start = bench_clock::now();
+	for (int i = 0; i < n_rounds; ++i)
+		for (auto& path : paths)
+			n_set += !set.match(path).empty();
+	const std::chrono::duration<double, std::nano> set_time = bench_clock::now() - start;
+
+	BOOST_TEST(n_std == n_set);
+	const auto n_matches = static_cast<double>(n_rounds * paths.size());
+	BOOST_TEST_MESSAGE("patterns: " << table.size()
+		<< ", ns per path: std::regex " << std_time.count() / n_matches
+		<< ", RegexSet " << set_time.count() / n_matches);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+#include "reorder_ring.hpp"
+#include <boost/test/unit_test.hpp>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace
+{
+template <typename T>
+auto take_all(ReorderRing<T>& r)
+{
+	std::vector<T> v;
+	while (auto p = r.front()) {
+		v.push_back(*p);
+		r.pop();
+	}
+	return v;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(reorder_ring_tests)
+
+BOOST_AUTO_TEST_CASE(test_capacity)
+{
+	BOOST_TEST(ReorderRing<int>(1, 1).capacity() == 1u);
+	BOOST_TEST(ReorderRing<int>(1, 5).capacity() == 8u);
+	BOOST_TEST(ReorderRing<int>(1, 64).capacity() == 64u);
+}
+
+BOOST_AUTO_TEST_CASE(test_order)
+{
+	ReorderRing<int> r{ 1, 4 };
+	BOOST_TEST(!r.has_front());
+	r.put(3, 3);
+	r.put(2, 2);
+	BOOST_TEST(!r.has_front());
+	BOOST_TEST(take_all(r).empty());
+
+	r.put(1, 1);
+	BOOST_TEST(r.has_front());
+	const std::vector<int> expected{ 1, 2, 3 };
+	BOOST_TEST(take_all(r) == expected, boost::test_tools::per_element());
+	BOOST_TEST(r.front_id() == 4u);
+}
+
+BOOST_AUTO_TEST_CASE(test_window)
+{
+	ReorderRing<int> r{ 1, 4 };
+	BOOST_TEST(r.fits(4));
+	BOOST_TEST(!r.fits(5));
+	BOOST_TEST(!r.fits(0));
+
+	r.put(1, 1);
+	r.pop();
+	BOOST_TEST(r.fits(5));
+	BOOST_TEST(!r.fits(1));
+}
+
+BOOST_AUTO_TEST_CASE(test_wrap_around)
+{
+	constexpr auto last = std::numeric_limits<ReorderRing<int>::Ident>::max();
+	ReorderRing<int> r{ last - 1, 4 };
+	BOOST_TEST(r.fits(1));
+	r.put(0, 3);
+	r.put(last, 2);
+	r.put(last - 1, 1);
+	const std::vector<int> expected{ 1, 2, 3 };
+	BOOST_TEST(take_all(r) == expected, boost::test_tools::per_element());
+	BOOST_TEST(r.front_id() == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_put)
+{
+	constexpr unsigned n_threads = 4;
+	constexpr unsigned n_items = 10000;
+	ReorderRing<unsigned> r{ 0, 16 };
+
+	std::vector<std::thread> producers;
+	for (unsigned i = 0; i < n_threads; ++i)
+		producers.emplace_back([&r, i]
+		{
+			for (auto id = i; id < n_items; id += n_threads) {
+				while (!r.fits(id))
+					std::this_thread::yield();
+				r.put(id, id);
+			}
+		});
+
+	unsigned expected = 0;
+	bool ordered = true;
+	while (expected != n_items) {
+		if (auto p = r.front()) {
+			ordered = ordered && *p == expected;
+			r.pop();
+			++expected;
+		}
+	}
+	for (auto& t : producers)
+		t.join();
+	BOOST_TEST(ordered);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
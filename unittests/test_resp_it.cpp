@@ -3,11 +3,17 @@
 #include "logger_imp.hpp"
 #include <boost/test/data/test_case.hpp>
 #include <boost/test/unit_test.hpp>
+#include <chrono>
 #include <numeric>
 #include <ostream>
 #include <string>
 #include <utility>
 #include <vector>
+#ifdef __unix__
+# include <sys/socket.h>
+# include <sys/uio.h>
+# include <unistd.h>
+#endif
 
 using namespace http;
 
@@ -186,4 +192,74 @@ BOOST_DATA_TEST_CASE(test_decrement, boost::unit_test::data::make(response_sampl
 	BOOST_TEST(reverse_response_string == sample.response);
 }
 
+BOOST_DATA_TEST_CASE(test_serialize_head, boost::unit_test::data::make(response_samples))
+{
+	fill(sample);
+
+	auto response_string = std::string{ serialize_head(r) } + concat(r.body.begin(), r.body.end());
+	BOOST_TEST(response_string == sample.response);
+}
+
+#ifdef __unix__
+// Gather list of the response iterator versus serialized head and body
+BOOST_AUTO_TEST_CASE(bench_send_head, * boost::unit_test::disabled())
+{
+	const TestCase c{
+		0, "",
+		{
+			{ "Server", "lemon" },
+			{ "Date", "Sat, 17 Oct 2026 10:00:00 GMT" },
+			{ "Content-Type", "text/html; charset=utf-8" },
+			{ "Content-Length", "1024" },
+			{ "Connection", "keep-alive" },
+			{ "Cache-Control", "max-age=3600" },
+			{ "Last-Modified", "Fri, 16 Oct 2026 10:00:00 GMT" },
+			{ "ETag", "\"5f8a1b2c-400\"" },
+		},
+		{ std::string(1024, 'x') }
+	};
+	fill(c);
+
+	auto to_iovec = [](string_view s) { return iovec{ const_cast<char*>(s.data()), s.size() }; };
+	std::vector<iovec> scattered;
+	for (auto s : r)
+		scattered.push_back(to_iovec(s));
+	std::vector<iovec> gathered{ to_iovec(serialize_head(r)) };
+	for (auto s : r.body)
+		gathered.push_back(to_iovec(s));
+
+	int sv[2];
+	BOOST_TEST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+	constexpr auto n_iterations = 100'000;
+	auto send = [&sv](const std::vector<iovec>& iov)
+	{
+		std::vector<char> buf(64 * 1024);
+		std::size_t bytes = 0;
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < n_iterations; ++i) {
+			msghdr msg{};
+			msg.msg_iov = const_cast<iovec*>(iov.data());
+			msg.msg_iovlen = iov.size();
+			bytes = static_cast<std::size_t>(sendmsg(sv[0], &msg, 0));
+			for (std::size_t n = 0; n < bytes;)
+				n += static_cast<std::size_t>(read(sv[1], buf.data(), buf.size()));
+		}
+		const auto time = std::chrono::steady_clock::now() - start;
+		return std::make_pair(bytes, std::chrono::duration_cast<std::chrono::nanoseconds>(time).count() / n_iterations);
+	};
+
+	const auto [scattered_bytes, scattered_ns] = send(scattered);
+	const auto [gathered_bytes, gathered_ns] = send(gathered);
+	BOOST_TEST_MESSAGE("response iterator: " << scattered.size() << " iovecs, "
+		<< scattered_bytes << " bytes, " << scattered_ns << " ns per sendmsg");
+	BOOST_TEST_MESSAGE("serialized head:   " << gathered.size() << " iovecs, "
+		<< gathered_bytes << " bytes, " << gathered_ns << " ns per sendmsg");
+	BOOST_TEST(scattered_bytes == gathered_bytes);
+
+	close(sv[0]);
+	close(sv[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
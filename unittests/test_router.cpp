@@ -1,10 +1,13 @@
 #include "http_router.hpp"
+#include "http_virtual_hosts.hpp"
 #include "http_request_handler.hpp"
 #include "logger_imp.hpp"
 #include "module_manager.hpp"
 #include "module_provider.hpp"
 #include "options.hpp"
 #include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <string>
 
 using namespace http;
 
@@ -67,8 +70,7 @@ struct RouterFixture
 	TestModuleProvider module_provider{ { h1, h2 } };
 	GlobalLogger glg;
 	ModuleManager man{ { &module_provider }, nullptr, glg };
-	decltype(Options::servers) servers = { {} };
-	Options::RouteList& routes = servers.at(0).routes;
+	Options::RouteList routes;
 };
 }
 
@@ -143,4 +145,208 @@ BOOST_AUTO_TEST_CASE(test_match_regex)
 	assert_no(r, "ab");
 }
 
-BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
+BOOST_AUTO_TEST_CASE(test_first_match)
+{
+	routes.push_back({ Options::Route::Prefix{"/a/b"}, "h1" });
+	routes.push_back({ Options::Route::Equal{"/a/bc"}, "h2" });
+	routes.push_back({ Options::Route::Prefix{"/a"}, "h2" });
+	routes.push_back({ Options::Route::Equal{"/a/b/c"}, "h2" });
+	routes.push_back({ Options::Route::Regex{"/x.*"}, "h1" });
+	routes.push_back({ Options::Route::Prefix{"/x"}, "h2" });
+	const Router r{ man, routes };
+
+	assert_yes(r, "/a/b", h1);
+	assert_yes(r, "/a/bc", h1);
+	assert_yes(r, "/a/b/c", h1);
+	assert_yes(r, "/a/x", h2);
+	assert_yes(r, "/a", h2);
+	// regex routes are tried after the others
+	assert_yes(r, "/xyz", h2);
+	assert_no(r, "/");
+	assert_no(r, "/b");
+}
+
+BOOST_AUTO_TEST_CASE(test_match_regex_order)
+{
+	// a backreference is left to std::regex
+	routes.push_back({ Options::Route::Regex{"/(a)\\1"}, "h1" });
+	routes.push_back({ Options::Route::Regex{"/a+"}, "h2" });
+	routes.push_back({ Options::Route::Regex{"/(b)\\1"}, "h1" });
+	const Router r{ man, routes };
+
+	assert_yes(r, "/aa", h1);
+	assert_yes(r, "/a", h2);
+	assert_yes(r, "/aaa", h2);
+	assert_yes(r, "/bb", h1);
+	assert_no(r, "/b");
+}
+
+BOOST_AUTO_TEST_CASE(test_match_method)
+{
+	routes.push_back({ Options::Route::Equal{"/res"}, "h1", "POST" });
+	routes.push_back({ Options::Route::Equal{"/res"}, "h2", "GET" });
+	routes.push_back({ Options::Route::Regex{"/re+"}, "h1", "PUT" });
+	const Router r{ man, routes };
+
+	BOOST_TEST(r.resolve("/res", "POST") == h1.get());
+	BOOST_TEST(r.resolve("/res", "GET") == h2.get());
+	BOOST_TEST(r.resolve("/res", "HEAD") == h2.get());
+	BOOST_TEST(r.resolve("/ree", "PUT") == h1.get());
+	BOOST_TEST(!r.resolve("/ree", "GET"));
+	BOOST_TEST(!r.resolve("/res", "DELETE"));
+}
+
+BOOST_AUTO_TEST_CASE(test_path_params)
+{
+	routes.push_back({ Options::Route::Equal{"/users/me"}, "h2" });
+	routes.push_back({ Options::Route::Equal{"/users/{id}"}, "h1" });
+	routes.push_back({ Options::Route::Equal{"/users/{id}/posts/{post}"}, "h2" });
+	routes.push_back({ Options::Route::Prefix{"/files/{dir}/"}, "h1" });
+	const Router r{ man, routes };
+	PathParams params;
+
+	const string_view path = "/users/42/posts/7";
+	auto route = r.find(path, "GET", params);
+	BOOST_TEST_REQUIRE(route);
+	BOOST_TEST(route->handler == h2);
+	BOOST_TEST(params.size() == 2u);
+	BOOST_TEST(*params.get("id") == "42");
+	BOOST_TEST(*params.get("post") == "7");
+	BOOST_TEST(!params.get("other"));
+	// the values view the path
+	BOOST_TEST(params.get("post")->data() == path.data() + path.size() - 1);
+
+	route = r.find("/users/me", "GET", params);
+	BOOST_TEST_REQUIRE(route);
+	BOOST_TEST(route->handler == h2);
+	BOOST_TEST(params.empty());
+
+	route = r.find("/users/you", "GET", params);
+	BOOST_TEST_REQUIRE(route);
+	BOOST_TEST(route->handler == h1);
+	BOOST_TEST(*params.get("id") == "you");
+
+	route = r.find("/files/docs/a/b.txt", "GET", params);
+	BOOST_TEST_REQUIRE(route);
+	BOOST_TEST(*params.get("dir") == "docs");
+
+	assert_no(r, "/users/");
+	assert_no(r, "/users/42/");
+	assert_no(r, "/users/42/posts");
+	assert_no(r, "/files/docs");
+}
+
+BOOST_AUTO_TEST_CASE(test_bad_params)
+{
+	for (auto pattern : { "/a/{id", "/a/{}", "/a/{id}.txt",
+		"/{a}/{b}/{c}/{d}/{e}/{f}/{g}/{h}/{i}" }) {
+		routes.clear();
+		routes.push_back({ Options::Route::Equal{ pattern }, "h1" });
+		BOOST_CHECK_THROW(Router(man, routes), Options::Error);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_virtual_hosts)
+{
+	Options::Server server{ 8080, {
+		{ {}, { { Options::Route::Prefix{"/"}, "h1" } } },
+		{ { "example.com", "www.example.com" }, { { Options::Route::Prefix{"/"}, "h2" } } },
+		{ { "*.example.com", "*.EXAMPLE.org" }, { { Options::Route::Prefix{"/"}, "h1" } } },
+		{ { "*.deep.example.com" }, { { Options::Route::Prefix{"/"}, "h2" } } },
+	} };
+	const VirtualHosts hosts{ man, server };
+	BOOST_TEST(hosts.by_name());
+
+	auto handler = [&](string_view host) { return hosts.find(host).resolve("/"); };
+	BOOST_TEST(handler("example.com") == h2.get());
+	BOOST_TEST(handler("Example.COM:8080") == h2.get());
+	BOOST_TEST(handler("www.example.com.") == h2.get());
+	BOOST_TEST(handler("api.example.com") == h1.get());
+	BOOST_TEST(handler("a.b.example.com") == h1.get());
+	BOOST_TEST(handler("x.deep.example.com") == h2.get());
+	BOOST_TEST(handler("deep.example.com") == h1.get());
+	BOOST_TEST(handler("a.example.org") == h1.get());
+	// the first host takes the rest
+	BOOST_TEST(&hosts.find("example.org") == &hosts.find(""));
+	BOOST_TEST(&hosts.find("[::1]:8080") == &hosts.find(""));
+	BOOST_TEST(&hosts.find("example.com") != &hosts.find(""));
+}
+
+BOOST_AUTO_TEST_CASE(test_no_virtual_hosts)
+{
+	Options::Server server{ 8080, { { {}, { { Options::Route::Prefix{"/"}, "h1" } } } } };
+	const VirtualHosts hosts{ man, server };
+	BOOST_TEST(!hosts.by_name());
+	BOOST_TEST(hosts.find("example.com").resolve("/") == h1.get());
+
+	server.hosts.push_back({ { "a*.com" }, {} });
+	BOOST_CHECK_THROW(VirtualHosts(man, server), Options::Error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+// Run explicitly: test_lemon --run_test=router_bench --log_level=message
+BOOST_FIXTURE_TEST_SUITE(router_bench, RouterFixture, *boost::unit_test::disabled())
+
+BOOST_AUTO_TEST_CASE(bench_resolve)
+{
+	using bench_clock = std::chrono::steady_clock;
+	constexpr int n_rounds = 100'000;
+
+	for (int n_routes : { 10, 100, 1000 }) {
+		routes.clear();
+		for (int i = 0; i < n_routes; ++i) {
+			const auto name = "/api/v1/resource" + std::to_string(i);
+			routes.push_back({ Options::Route::Equal{ name }, "h1" });
+			routes.push_back({ Options::Route::Equal{ name + "/{id}" }, "h2" });
+		}
+		routes.push_back({ Options::Route::Prefix{ "/static/" }, "h1" });
+		const Router r{ man, routes };
+		const auto last = "/api/v1/resource" + std::to_string(n_routes - 1) + "/12345";
+		PathParams params;
+
+		std::size_t n_found = 0;
+		const auto start = bench_clock::now();
+		for (int i = 0; i < n_rounds; ++i) {
+			n_found += r.find(last, "GET", params) != nullptr;
+			n_found += r.find("/static/img/logo.png", "GET", params) != nullptr;
+		}
+		const std::chrono::duration<double, std::nano> time = bench_clock::now() - start;
+
+		BOOST_TEST(n_found == static_cast<std::size_t>(2 * n_rounds));
+		BOOST_TEST_MESSAGE("routes: " << 2 * n_routes + 1
+			<< ", ns per resolve: " << time.count() / n_rounds / 2);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(bench_virtual_hosts)
+{
+	using bench_clock = std::chrono::steady_clock;
+	constexpr int n_rounds = 100'000;
+
+	for (int n_hosts : { 10, 1000, 10000 }) {
+		Options::Server server{ 8080, { { {}, {} } } };
+		for (int i = 0; i < n_hosts; ++i) {
+			const auto name = "site" + std::to_string(i) + ".example.com";
+			server.hosts.push_back({ { name, "*." + name }, {} });
+		}
+		const VirtualHosts hosts{ man, server };
+		const auto last = "site" + std::to_string(n_hosts - 1) + ".example.com";
+		const auto sub = "www." + last + ":8080";
+
+		std::size_t n_found = 0;
+		const auto start = bench_clock::now();
+		for (int i = 0; i < n_rounds; ++i) {
+			n_found += &hosts.find(last) != &hosts.find("");
+			n_found += &hosts.find(sub) != &hosts.find("");
+		}
+		const std::chrono::duration<double, std::nano> time = bench_clock::now() - start;
+
+		BOOST_TEST(n_found == static_cast<std::size_t>(2 * n_rounds));
+		BOOST_TEST_MESSAGE("hosts: " << n_hosts
+			<< ", ns per exact and wildcard pair: " << time.count() / n_rounds);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+#include "slab_allocator.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct Object
+{
+	char data[200];
+};
+
+using Allocator = SlabAllocator<Object>;
+}
+
+BOOST_AUTO_TEST_SUITE(slab_allocator_tests)
+
+BOOST_AUTO_TEST_CASE(test_reuse)
+{
+	Allocator a;
+	auto p = a.allocate(1);
+	std::memset(p, 1, sizeof(Object));
+	a.deallocate(p, 1);
+	auto q = a.allocate(1);
+	BOOST_TEST(q == p);
+	a.deallocate(q, 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_many)
+{
+	Allocator a;
+	std::vector<Object*> objects;
+	for (int i = 0; i < 1'000; ++i) {
+		objects.push_back(a.allocate(1));
+		std::memset(objects.back(), i, sizeof(Object));
+	}
+	BOOST_TEST(std::set<Object*>(objects.begin(), objects.end()).size() == objects.size());
+	for (auto p : objects)
+		a.deallocate(p, 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_remote_free)
+{
+	Allocator a;
+	auto p = a.allocate(1);
+	std::thread{ [p] { Allocator{}.deallocate(p, 1); } }.join();
+	// taken back by the owner when its own list is empty
+	std::vector<Object*> objects;
+	for (auto q = a.allocate(1); ; q = a.allocate(1)) {
+		objects.push_back(q);
+		if (q == p)
+			break;
+	}
+	for (auto q : objects)
+		a.deallocate(q, 1);
+}
+
+BOOST_AUTO_TEST_CASE(test_finished_owner)
+{
+	std::vector<Object*> objects;
+	std::thread{ [&objects]
+	{
+		Allocator a;
+		for (int i = 0; i < 100; ++i)
+			objects.push_back(a.allocate(1));
+		a.deallocate(objects.back(), 1);
+		objects.pop_back();
+	} }.join();
+
+	Allocator a;
+	for (auto p : objects) {
+		std::memset(p, 1, sizeof(Object));
+		a.deallocate(p, 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_shared)
+{
+	std::vector<std::shared_ptr<Object>> objects;
+	std::thread{ [&objects]
+	{
+		for (int i = 0; i < 100; ++i)
+			objects.push_back(std::allocate_shared<Object>(Allocator{}));
+	} }.join();
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t)
+		threads.emplace_back([&objects, t]
+		{
+			for (auto i = t; i < 100; i += 4)
+				objects[i].reset();
+			for (int i = 0; i < 1'000; ++i)
+				std::allocate_shared<Object>(Allocator{});
+		});
+	for (auto& t : threads)
+		t.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
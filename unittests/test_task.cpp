@@ -0,0 +1,155 @@
+#include "http_message.hpp"
+#include "http_request_handler.hpp"
+#include "http_task_builder.hpp"
+#include "http_virtual_hosts.hpp"
+#include "logger_imp.hpp"
+#include "module_manager.hpp"
+#include "module_provider.hpp"
+#include "options.hpp"
+#include "tcp_session.hpp"
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <optional>
+#include <string>
+
+using namespace http;
+
+namespace
+{
+// a response with a head larger than the memory of a connection
+struct BigHeadHandler : RequestHandler
+{
+	auto get_name() const noexcept -> string_view override
+	{
+		return "big_head"sv;
+	}
+
+	auto get(Request& req, Response& resp, Context&) -> void override
+	{
+		resp.http_version = req.http_version;
+		resp.code = Response::Status::ok;
+		resp.headers.emplace_back("X-Big"sv, string_view{ value });
+		handled = true;
+	}
+
+	const std::string value = std::string(64 * 1024, 'x');
+	bool handled = false;
+};
+
+struct TestModule : Module
+{
+	TestModule(HandlerList handlers) : handlers(move(handlers)) {}
+
+	auto get_name() const noexcept -> string_view override { return "test_module"; }
+	auto init(Logger&, const config::Table*) -> HandlerList override
+	{
+		return handlers;
+	}
+
+	HandlerList handlers;
+};
+
+struct TestModuleProvider : ModuleProvider
+{
+	TestModuleProvider(Module::HandlerList handlers): handlers(move(handlers)) {}
+
+	auto get_name() const noexcept -> string_view override { return "Test"; }
+
+	auto get() -> List override
+	{
+		List ms;
+		ms.push_back(std::make_unique<TestModule>(handlers));
+		return ms;
+	}
+
+	Module::HandlerList handlers;
+};
+
+auto make_options(std::size_t connection_limit) -> std::shared_ptr<Options>
+{
+	auto opt = std::make_shared<Options>();
+	opt->memory.connection_limit = connection_limit;
+	Options::RouteList routes;
+	routes.push_back({ Options::Route::Equal{ "/" }, "big_head", "" });
+	opt->servers.clear();
+	opt->servers.push_back({ 8080, { { { "test" }, routes } } });
+	return opt;
+}
+
+// a session of a connected socket, which is never run
+struct TaskFixture
+{
+	TaskFixture()
+	{
+		using boost::asio::ip::tcp;
+		tcp::acceptor acceptor{ context, { boost::asio::ip::address_v4::loopback(), 0 } };
+		client.connect(acceptor.local_endpoint());
+		tcp::socket sock{ context };
+		acceptor.accept(sock);
+		session = std::make_shared<::tcp::Session>(::tcp::Socket{ std::move(sock) }, opt, man, hosts, slg);
+	}
+
+	// the results of the request received by the task
+	auto receive(const IncompleteTask& it, string_view request) -> TaskBuilder::Results
+	{
+		auto buf = builder.get_memory(it);
+		BOOST_REQUIRE(buf.size() >= request.size());
+		std::copy(request.begin(), request.end(), static_cast<char*>(buf.data()));
+		return builder.make_tasks(session, it, request.size(), false);
+	}
+
+	// the parsed request, run
+	auto run(string_view request) -> std::string
+	{
+		std::optional<Task::Result> tr;
+		for (auto&& r : receive(builder.prepare_task(session), request))
+			if (auto rt = std::get_if<ReadyTask>(&r))
+				tr = rt->run();
+		BOOST_REQUIRE(tr);
+		std::string response;
+		for (auto& b : *tr)
+			response.append(static_cast<const char*>(b.data()), b.size());
+		return response;
+	}
+
+	const std::shared_ptr<BigHeadHandler> handler = std::make_shared<BigHeadHandler>();
+	TestModuleProvider module_provider{ { handler } };
+	GlobalLogger glg;
+	const std::shared_ptr<ModuleManager> man = std::make_shared<ModuleManager>(
+		std::vector<ModuleProvider*>{ &module_provider }, nullptr, glg);
+	const std::shared_ptr<const Options> opt = make_options(32 * 1024);
+	const std::shared_ptr<const VirtualHosts> hosts = std::make_shared<VirtualHosts>(*man, opt->servers.front());
+	ServerLogger slg{ 8080 };
+	boost::asio::io_context context;
+	boost::asio::ip::tcp::socket client{ context };
+	std::shared_ptr<tcp::Session> session;
+	TaskBuilder builder{ Task::start_id, *opt };
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(task_tests, TaskFixture)
+
+BOOST_AUTO_TEST_CASE(test_head_exceeds_connection_limit)
+{
+	const auto response = run("GET / HTTP/1.1\r\nHost: test\r\n\r\n");
+	// the handler succeeds, but its head does not fit
+	BOOST_TEST(handler->handled);
+	BOOST_TEST(response.compare(0, 12, "HTTP/1.1 413") == 0);
+	BOOST_TEST(response.find("X-Big") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_route_by_host_before_body)
+{
+	// no route: the body is dropped as it comes, into the buffer of the headers
+	const auto it = builder.prepare_task(session);
+	const auto head_buf = builder.get_memory(it);
+	for (auto&& r : receive(it, "POST /none HTTP/1.1\r\nHost: test\r\nContent-Length: 100\r\n\r\n0123456789"))
+		BOOST_TEST(std::holds_alternative<IncompleteTask>(r));
+	BOOST_TEST(builder.get_memory(it).data() == head_buf.data());
+	BOOST_TEST(!handler->handled);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+#include "timer_wheel.hpp"
+#include <boost/test/unit_test.hpp>
+#include <vector>
+
+namespace
+{
+struct TestTimer final: TimerWheel::Timer
+{
+	explicit TestTimer(const TimerWheel& w): w{ w } {}
+
+	void expire() noexcept override { fired.push_back(w.now()); }
+
+	const TimerWheel& w;
+	std::vector<TimerWheel::Ticks> fired;
+};
+}
+
+BOOST_AUTO_TEST_SUITE(timer_wheel_tests)
+
+BOOST_AUTO_TEST_CASE(test_exact_tick)
+{
+	TimerWheel w;
+	TestTimer t{ w };
+	w.start(t, 3);
+	BOOST_TEST(t.is_armed());
+	w.advance(3);
+	BOOST_TEST(t.fired.empty());
+	w.advance(1);
+	BOOST_TEST(t.fired == std::vector<TimerWheel::Ticks>{ 3 });
+	BOOST_TEST(!t.is_armed());
+	w.advance(100);
+	BOOST_TEST(t.fired.size() == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(test_zero)
+{
+	TimerWheel w;
+	w.advance(10);
+	TestTimer t{ w };
+	w.start(t, 0);
+	w.advance(1);
+	BOOST_TEST(t.fired == std::vector<TimerWheel::Ticks>{ 10 });
+}
+
+BOOST_AUTO_TEST_CASE(test_cancel)
+{
+	TimerWheel w;
+	TestTimer t{ w };
+	w.start(t, 5);
+	w.cancel(t);
+	BOOST_TEST(!t.is_armed());
+	w.advance(10);
+	BOOST_TEST(t.fired.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_restart)
+{
+	TimerWheel w;
+	TestTimer t{ w };
+	w.start(t, 5);
+	w.advance(3);
+	w.start(t, 5);
+	w.advance(10);
+	BOOST_TEST(t.fired == std::vector<TimerWheel::Ticks>{ 8 });
+}
+
+BOOST_AUTO_TEST_CASE(test_cascade)
+{
+	TimerWheel w;
+	w.advance(7);
+	for (const TimerWheel::Ticks ticks : { 63, 64, 100, 4095, 4096, 5000, 300000 }) {
+		TestTimer t{ w };
+		const auto start = w.now();
+		w.start(t, ticks);
+		w.advance(ticks + 1);
+		BOOST_TEST(t.fired == std::vector<TimerWheel::Ticks>{ start + ticks });
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_destroyed_timer)
+{
+	TimerWheel w;
+	{
+		TestTimer t{ w };
+		w.start(t, 100);
+	}
+	w.advance(200);
+}
+
+BOOST_AUTO_TEST_CASE(test_clamp)
+{
+	TimerWheel w;
+	TestTimer t{ w };
+	w.start(t, TimerWheel::max_ticks * 2);
+	w.advance(TimerWheel::max_ticks);
+	BOOST_TEST(t.fired.empty());
+	w.advance(1);
+	BOOST_TEST(t.fired == std::vector<TimerWheel::Ticks>{ TimerWheel::max_ticks });
+}
+
+BOOST_AUTO_TEST_SUITE_END()